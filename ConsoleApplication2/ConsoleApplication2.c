@@ -5,21 +5,68 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
+#endif
 #include "types.h"
 #include "pathfinder.h"
 #include "tracker.h"
-
-#define SMALL_DELAY() Sleep(500);
+#include "checkpoint.h"
+#include "instrument.h"
+
+/*
+ * On Windows the tracker runs on its own thread and the scenarios play out in real time. Elsewhere (make sim) there are
+ * no threads: a delay advances the tracker's virtual clock and scans the sensors until the tracker settles, so a
+ * scenario runs as fast as the CPU allows.
+ */
+
+#define SIM_SCAN_PERIOD_MS 1
+#define SMALL_DELAY() SimDelay(500);
+#ifdef _WIN32
 bool Running = true;
+#endif
+
+void PrintChessboard();
+
+void SimDelay(uint32_t milliseconds)
+{
+#ifdef _WIN32
+	SimAdvanceTime(milliseconds);
+	Sleep(milliseconds);
+#else
+	// Once the tracker has gone a whole debounce window without a transition, nothing it has been fed is still settling
+	uint32_t elapsed = 0;
+	uint8_t idleScans = 0;
+	while (elapsed < milliseconds && idleScans < DEBOUNCE_WINDOW)
+	{
+		SimAdvanceTime(SIM_SCAN_PERIOD_MS);
+		elapsed += SIM_SCAN_PERIOD_MS;
+#ifdef TRACKER_ASYNC_SCAN
+		Scan();
+#endif
+		if (Track())
+		{
+			PrintChessboard();
+			idleScans = 0;
+		}
+		else
+		{
+			idleScans++;
+		}
+	}
 
+	// Nothing changes while the board sits still, so skip the rest of the delay
+	SimAdvanceTime(milliseconds - elapsed);
+#endif
+}
 
-void SimMove(uint8_t rowInitial, uint8_t columnInitial, uint8_t rowFinal, uint8_t columnFinal)
+void SimMove(uint8_t from, uint8_t to)
 {
-	SimSetSensor(rowInitial, columnInitial, 0);
-	Sleep(100);
-	SimSetSensor(rowFinal, columnFinal, 1);
+	SimSetSensor(from, 0);
+	SimDelay(100);
+	SimSetSensor(to, 1);
 }
 
 char* ChessPieceTypeToString(enum PieceType pieceType)
@@ -37,59 +84,77 @@ char* ChessPieceTypeToString(enum PieceType pieceType)
 	}
 }
 
+void PrintChessboard()
+{
+	for (int8_t row = NUM_ROWS - 1; row >= 0; row--)
+	{
+		for (uint8_t column = 0; column < NUM_COLS; column++)
+		{
+			Piece piece = GetPiece(SQUARE(row, column));
+			if (PIECE_OWNER(piece) == BLACK)
+			{
+				printf("\033[0;34m");
+			}
+			else if (PIECE_OWNER(piece) == WHITE)
+			{
+				printf("\033[0;31m");
+			}
+			else
+			{
+				printf("\033[0;37m");
+			}
+			printf("%s ", ChessPieceTypeToString(PIECE_TYPE(piece)));
+		}
+		printf("\n");
+	}
+	printf("\033[0;37m");
+	printf("\n\n");
+}
+
+#ifdef _WIN32
+#ifdef TRACKER_ASYNC_SCAN
+DWORD WINAPI ScanningThreadFunction(void* data)
+{
+	while (Running)
+	{
+		Scan();
+		Sleep(1);
+	}
+	return 0;
+}
+#endif
+
 DWORD WINAPI TrackingThreadFunction(void* data)
 {
 	while (Running)
 	{
 		if (Track())
 		{
-			for (int8_t row = NUM_ROWS - 1; row >= 0; row--)
-			{
-				for (uint8_t column = 0; column < NUM_COLS; column++)
-				{
-					struct Piece piece = GetPiece(row, column);
-					if (piece.owner == BLACK)
-					{
-						printf("\033[0;34m");
-					}
-					else if (piece.owner == WHITE)
-					{
-						printf("\033[0;31m");
-					}
-					else
-					{
-						printf("\033[0;37m");
-					}
-					printf("%s ", ChessPieceTypeToString(piece.type));
-				}
-				printf("\n");
-			}
-			printf("\033[0;37m");
-			printf("\n\n");
+			PrintChessboard();
 		}
 		
 		Sleep(1);
 	}
 	return 0;
 }
+#endif
 
-void PrintAllLegalPaths(uint8_t pieceRow, uint8_t pieceColumn)
+void PrintAllLegalPaths(uint8_t pieceSquare)
 {
-	struct PieceCoordinate piece = { GetPiece(pieceRow, pieceColumn), pieceRow, pieceColumn };
 	uint8_t numLegalPaths;
-	struct Coordinate allLegalPaths[MAX_LEGAL_MOVES] = { 0 };
-	CalculateAllLegalPathsAndChecks(piece, allLegalPaths, &numLegalPaths);
+	uint8_t allLegalPaths[MAX_LEGAL_MOVES] = { 0 };
+	CalculateAllLegalPathsAndChecks(GetPieceCoordinate(pieceSquare), allLegalPaths, &numLegalPaths);
 
 	for (int8_t row = NUM_ROWS - 1; row >= 0; row--)
 	{
 		for (uint8_t column = 0; column < NUM_COLS; column++)
 		{
-			struct Piece piece = GetPiece(row, column);
-			if (piece.owner == BLACK)
+			Piece piece = GetPiece(SQUARE(row, column));
+			if (PIECE_OWNER(piece) == BLACK)
 			{
 				printf("\033[0;34m");
 			}
-			else if (piece.owner == WHITE)
+			else if (PIECE_OWNER(piece) == WHITE)
 			{
 				printf("\033[0;31m");
 			}
@@ -98,7 +163,7 @@ void PrintAllLegalPaths(uint8_t pieceRow, uint8_t pieceColumn)
 				printf("\033[0;37m");
 			}
 
-			if (row == pieceRow && column == pieceColumn)
+			if (SQUARE(row, column) == pieceSquare)
 			{
 
 				printf("\033[0;33m");
@@ -107,14 +172,13 @@ void PrintAllLegalPaths(uint8_t pieceRow, uint8_t pieceColumn)
 			// Print legal move positions
 			for (uint8_t i = 0; i < numLegalPaths; i++)
 			{
-				struct Coordinate path = allLegalPaths[i];
-				if (path.row == row && path.column == column)
+				if (allLegalPaths[i] == SQUARE(row, column))
 				{
 					printf("\033[0;32m");
 				}
 			}
 
-			printf("%s ", ChessPieceTypeToString(piece.type));
+			printf("%s ", ChessPieceTypeToString(PIECE_TYPE(piece)));
 		}
 		printf("\n");
 	}
@@ -124,262 +188,259 @@ void PrintAllLegalPaths(uint8_t pieceRow, uint8_t pieceColumn)
 
 void PrintAllLegalPathsForTeam(enum PieceOwner owner)
 {
-	for (int8_t row = 0; row < NUM_ROWS; row++)
+	for (uint8_t square = 0; square < NUM_SQUARES; square++)
 	{
-		for (uint8_t column = 0; column < NUM_COLS; column++)
+		if (PIECE_OWNER(GetPiece(square)) == owner)
 		{
-			if (GetPiece(row, column).owner == owner)
-			{
-				PrintAllLegalPaths(row, column);
-			}
+			PrintAllLegalPaths(square);
 		}
 	}
 }
 
 void TestLegalMoves()
 {
-	PrintAllLegalPaths(1, 0); // Print paths for white pawn
+	PrintAllLegalPaths(SQUARE(1, 0)); // Print paths for white pawn
 	SMALL_DELAY();
-	SimMove(1, 0, 2, 0); // Move white pawn in column 0 from row 1 to 2
+	SimMove(SQUARE(1, 0), SQUARE(2, 0)); // Move white pawn in column 0 from row 1 to 2
 	SMALL_DELAY();
 
-	PrintAllLegalPaths(6, 3); // Print paths for black pawn
+	PrintAllLegalPaths(SQUARE(6, 3)); // Print paths for black pawn
 	SMALL_DELAY();
-	SimMove(6, 3, 5, 3); // Move black pawn in column 3 from row 5 to 6
+	SimMove(SQUARE(6, 3), SQUARE(5, 3)); // Move black pawn in column 3 from row 5 to 6
 	SMALL_DELAY();
 
-	PrintAllLegalPaths(1, 2);
+	PrintAllLegalPaths(SQUARE(1, 2));
 	SMALL_DELAY();
-	SimMove(1, 2, 2, 2); // Move white pawn in column 2 from row 1 to 2
+	SimMove(SQUARE(1, 2), SQUARE(2, 2)); // Move white pawn in column 2 from row 1 to 2
 	SMALL_DELAY();
 
 	// Move bishop
-	PrintAllLegalPaths(7, 2);
+	PrintAllLegalPaths(SQUARE(7, 2));
 	SMALL_DELAY();
-	SimMove(7, 2, 4, 5);
+	SimMove(SQUARE(7, 2), SQUARE(4, 5));
 	SMALL_DELAY();
 
 	// Move pawn
-	PrintAllLegalPaths(1, 7);
+	PrintAllLegalPaths(SQUARE(1, 7));
 	SMALL_DELAY();
-	SimMove(1, 7, 2, 7);
+	SimMove(SQUARE(1, 7), SQUARE(2, 7));
 	SMALL_DELAY();
 
 	// Kill pawn with bishop
-	PrintAllLegalPaths(4, 5);
+	PrintAllLegalPaths(SQUARE(4, 5));
 	SMALL_DELAY();
-	SimSetSensor(2, 7, 0);
+	SimSetSensor(SQUARE(2, 7), 0);
 	SMALL_DELAY();
-	SimSetSensor(4, 5, 0);
+	SimSetSensor(SQUARE(4, 5), 0);
 	SMALL_DELAY();
-	SimSetSensor(2, 7, 1);
+	SimSetSensor(SQUARE(2, 7), 1);
 	SMALL_DELAY();
 
 	// Kill bishop with knight
-	PrintAllLegalPaths(0, 6);
+	PrintAllLegalPaths(SQUARE(0, 6));
 	SMALL_DELAY();
-	SimSetSensor(2, 7, 0);
+	SimSetSensor(SQUARE(2, 7), 0);
 	SMALL_DELAY();
-	SimSetSensor(0, 6, 0);
+	SimSetSensor(SQUARE(0, 6), 0);
 	SMALL_DELAY();
-	SimSetSensor(2, 7, 1);
+	SimSetSensor(SQUARE(2, 7), 1);
 	SMALL_DELAY();
 
 	// Move pawn
-	PrintAllLegalPaths(5, 3);
+	PrintAllLegalPaths(SQUARE(5, 3));
 	SMALL_DELAY();
-	SimMove(5, 3, 4, 3);
+	SimMove(SQUARE(5, 3), SQUARE(4, 3));
 	SMALL_DELAY();
 
 	// Move knight
-	PrintAllLegalPaths(2, 7);
+	PrintAllLegalPaths(SQUARE(2, 7));
 	SMALL_DELAY();
-	SimMove(2, 7, 3, 5);
+	SimMove(SQUARE(2, 7), SQUARE(3, 5));
 	SMALL_DELAY();
 
 	// Move pawn
-	PrintAllLegalPaths(4, 3);
+	PrintAllLegalPaths(SQUARE(4, 3));
 	SMALL_DELAY();
-	SimMove(4, 3, 3, 3);
+	SimMove(SQUARE(4, 3), SQUARE(3, 3));
 	SMALL_DELAY();
 
 	// Kill pawn with pawn
-	PrintAllLegalPaths(2, 2);
+	PrintAllLegalPaths(SQUARE(2, 2));
 	SMALL_DELAY();
-	SimSetSensor(3, 3, 0);
+	SimSetSensor(SQUARE(3, 3), 0);
 	SMALL_DELAY();
-	SimSetSensor(2, 2, 0);
+	SimSetSensor(SQUARE(2, 2), 0);
 	SMALL_DELAY();
-	SimSetSensor(3, 3, 1);
+	SimSetSensor(SQUARE(3, 3), 1);
 	SMALL_DELAY();
 
 	// Kill pawn with queen
-	PrintAllLegalPaths(7, 3);
+	PrintAllLegalPaths(SQUARE(7, 3));
 	SMALL_DELAY();
-	SimSetSensor(3, 3, 0);
+	SimSetSensor(SQUARE(3, 3), 0);
 	SMALL_DELAY();
-	SimSetSensor(7, 3, 0);
+	SimSetSensor(SQUARE(7, 3), 0);
 	SMALL_DELAY();
-	SimSetSensor(3, 3, 1);
+	SimSetSensor(SQUARE(3, 3), 1);
 	SMALL_DELAY();
 
-	PrintAllLegalPaths(0, 7);
+	PrintAllLegalPaths(SQUARE(0, 7));
 	SMALL_DELAY();
-	SimMove(0, 7, 3, 7);
+	SimMove(SQUARE(0, 7), SQUARE(3, 7));
 	SMALL_DELAY();
 
-	PrintAllLegalPaths(3, 3);
+	PrintAllLegalPaths(SQUARE(3, 3));
 	SMALL_DELAY();
-	SimSetSensor(3, 5, 0);
+	SimSetSensor(SQUARE(3, 5), 0);
 	SMALL_DELAY();
-	SimSetSensor(3, 3, 0);
+	SimSetSensor(SQUARE(3, 3), 0);
 	SMALL_DELAY();
-	SimSetSensor(3, 5, 1);
+	SimSetSensor(SQUARE(3, 5), 1);
 	SMALL_DELAY();
 
-	PrintAllLegalPaths(3, 7);
+	PrintAllLegalPaths(SQUARE(3, 7));
 	SMALL_DELAY();
-	SimSetSensor(3, 5, 0);
+	SimSetSensor(SQUARE(3, 5), 0);
 	SMALL_DELAY();
-	SimSetSensor(3, 7, 0);
+	SimSetSensor(SQUARE(3, 7), 0);
 	SMALL_DELAY();
-	SimSetSensor(3, 5, 1);
+	SimSetSensor(SQUARE(3, 5), 1);
 	SMALL_DELAY();
 
-	PrintAllLegalPaths(6, 4);
+	PrintAllLegalPaths(SQUARE(6, 4));
 	SMALL_DELAY();
-	SimMove(6, 4, 5, 4);
+	SimMove(SQUARE(6, 4), SQUARE(5, 4));
 	SMALL_DELAY();
 
-	PrintAllLegalPaths(3, 5);
+	PrintAllLegalPaths(SQUARE(3, 5));
 	SMALL_DELAY();
-	SimSetSensor(6, 5, 0);
+	SimSetSensor(SQUARE(6, 5), 0);
 	SMALL_DELAY();
-	SimSetSensor(3, 5, 0);
+	SimSetSensor(SQUARE(3, 5), 0);
 	SMALL_DELAY();
-	SimSetSensor(6, 5, 1);
+	SimSetSensor(SQUARE(6, 5), 1);
 	SMALL_DELAY();
 
-	PrintAllLegalPaths(7, 4);
+	PrintAllLegalPaths(SQUARE(7, 4));
 	SMALL_DELAY();
-	SimSetSensor(6, 5, 0);
+	SimSetSensor(SQUARE(6, 5), 0);
 	SMALL_DELAY();
-	SimSetSensor(7, 4, 0);
+	SimSetSensor(SQUARE(7, 4), 0);
 	SMALL_DELAY();
-	SimSetSensor(6, 5, 1);
+	SimSetSensor(SQUARE(6, 5), 1);
 	SMALL_DELAY();
 }
 
 void TestIllegalMoves()
 {
-	PrintAllLegalPaths(1, 0); // Print paths for white pawn
+	PrintAllLegalPaths(SQUARE(1, 0)); // Print paths for white pawn
 	SMALL_DELAY();
-	SimMove(1, 0, 4, 0); // Move pawn to illegal spot
+	SimMove(SQUARE(1, 0), SQUARE(4, 0)); // Move pawn to illegal spot
 	SMALL_DELAY();
-	SimMove(4, 0, 1, 0); // Move pawn back to initial spot
+	SimMove(SQUARE(4, 0), SQUARE(1, 0)); // Move pawn back to initial spot
 	SMALL_DELAY();
-	SimMove(1, 0, 3, 0); // Move pawn to legal spot
+	SimMove(SQUARE(1, 0), SQUARE(3, 0)); // Move pawn to legal spot
 	SMALL_DELAY();
 	
-	SimMove(6, 1, 4, 1); // Move black pawn
+	SimMove(SQUARE(6, 1), SQUARE(4, 1)); // Move black pawn
 	SMALL_DELAY();
 	
 	// Kill black pawn but move to wrong spot
-	SimSetSensor(3, 0, 0);
+	SimSetSensor(SQUARE(3, 0), 0);
 	SMALL_DELAY();
-	SimSetSensor(4, 2, 1);
+	SimSetSensor(SQUARE(4, 2), 1);
 	SMALL_DELAY();
-	SimMove(4, 2, 3, 0);
+	SimMove(SQUARE(4, 2), SQUARE(3, 0));
 	SMALL_DELAY();
 	
-	SimSetSensor(4, 1, 0);
+	SimSetSensor(SQUARE(4, 1), 0);
 	SMALL_DELAY();
-	SimSetSensor(3, 0, 0);
+	SimSetSensor(SQUARE(3, 0), 0);
 	SMALL_DELAY();
-	SimSetSensor(5, 1, 1); // Move to wrong spot after killing
+	SimSetSensor(SQUARE(5, 1), 1); // Move to wrong spot after killing
 	SMALL_DELAY();
-	SimSetSensor(5, 1, 0);
+	SimSetSensor(SQUARE(5, 1), 0);
 	SMALL_DELAY();
-	SimSetSensor(4, 1, 1); // Move to right spot after killing
+	SimSetSensor(SQUARE(4, 1), 1); // Move to right spot after killing
 	SMALL_DELAY();
 
-	SimSetSensor(4, 1, 0);
+	SimSetSensor(SQUARE(4, 1), 0);
 	SMALL_DELAY();
-	SimSetSensor(6, 2, 0);
+	SimSetSensor(SQUARE(6, 2), 0);
 	SMALL_DELAY();
-	SimSetSensor(4, 1, 1);
+	SimSetSensor(SQUARE(4, 1), 1);
 	SMALL_DELAY();
-	SimSetSensor(6, 2, 1);
+	SimSetSensor(SQUARE(6, 2), 1);
 	SMALL_DELAY();
 
 	// Move black pawn down
-	SimMove(6, 6, 4, 6);
+	SimMove(SQUARE(6, 6), SQUARE(4, 6));
 	SMALL_DELAY();
 
 	// Move white pawn up
-	SimMove(1, 7, 3, 7);
+	SimMove(SQUARE(1, 7), SQUARE(3, 7));
 	SMALL_DELAY();
 
 	// Kill white pawn with black pawn
-	SimSetSensor(3, 7, 0);
+	SimSetSensor(SQUARE(3, 7), 0);
 	SMALL_DELAY();
-	SimSetSensor(4, 6, 0);
+	SimSetSensor(SQUARE(4, 6), 0);
 	SMALL_DELAY();
-	SimSetSensor(3, 7, 1);
+	SimSetSensor(SQUARE(3, 7), 1);
 	SMALL_DELAY();
 
 	// Kill black pawn with white rook
-	SimSetSensor(3, 7, 0);
+	SimSetSensor(SQUARE(3, 7), 0);
 	SMALL_DELAY();
-	SimSetSensor(0, 7, 0);
+	SimSetSensor(SQUARE(0, 7), 0);
 	SMALL_DELAY();
-	SimSetSensor(3, 7, 1);
+	SimSetSensor(SQUARE(3, 7), 1);
 	SMALL_DELAY();
 
 	// Move black bishop
-	SimMove(7, 5, 6, 6);
+	SimMove(SQUARE(7, 5), SQUARE(6, 6));
 	SMALL_DELAY();
 
 	// Move white rook
-	SimMove(3, 7, 3, 4);
+	SimMove(SQUARE(3, 7), SQUARE(3, 4));
 	SMALL_DELAY();
 
 	// Move black pawn down
-	SimMove(6, 0, 5, 0);
+	SimMove(SQUARE(6, 0), SQUARE(5, 0));
 	SMALL_DELAY();
 
 	// Kill pawn in front of black king with white rook
-	SimSetSensor(6, 4, 0);
+	SimSetSensor(SQUARE(6, 4), 0);
 	SMALL_DELAY();
-	SimSetSensor(3, 4, 0);
+	SimSetSensor(SQUARE(3, 4), 0);
 	SMALL_DELAY();
-	SimSetSensor(6, 4, 1);
+	SimSetSensor(SQUARE(6, 4), 1);
 	SMALL_DELAY();
 	PrintAllLegalPathsForTeam(BLACK);
 	
 	// Kill rook with knight
-	SimSetSensor(6, 4, 0);
+	SimSetSensor(SQUARE(6, 4), 0);
 	SMALL_DELAY();
-	SimSetSensor(7, 6, 0);
+	SimSetSensor(SQUARE(7, 6), 0);
 	SMALL_DELAY();
-	SimSetSensor(6, 4, 1);
+	SimSetSensor(SQUARE(6, 4), 1);
 	SMALL_DELAY();
 
 	// Kill black pawn
-	PrintAllLegalPaths(4, 1);
-	SimSetSensor(5, 0, 0);
+	PrintAllLegalPaths(SQUARE(4, 1));
+	SimSetSensor(SQUARE(5, 0), 0);
 	SMALL_DELAY();
-	SimSetSensor(4, 1, 0);
+	SimSetSensor(SQUARE(4, 1), 0);
 	SMALL_DELAY();
-	SimSetSensor(5, 0, 1);
+	SimSetSensor(SQUARE(5, 0), 1);
 	SMALL_DELAY();
 
 	// Move rook illegally then back legally
-	SimMove(7, 0, 6, 1);
+	SimMove(SQUARE(7, 0), SQUARE(6, 1));
 	SMALL_DELAY();
-	SimMove(6, 1, 7, 0);
+	SimMove(SQUARE(6, 1), SQUARE(7, 0));
 	SMALL_DELAY();
-	SimMove(7, 0, 6, 0);
+	SimMove(SQUARE(7, 0), SQUARE(6, 0));
 	SMALL_DELAY();
 
 
@@ -388,71 +449,211 @@ void TestIllegalMoves()
 void TestCastling()
 {
 	// Move knights
-	SimMove(0, 1, 2, 2);
+	SimMove(SQUARE(0, 1), SQUARE(2, 2));
 	SMALL_DELAY();
-	SimMove(7, 1, 5, 2);
+	SimMove(SQUARE(7, 1), SQUARE(5, 2));
 	SMALL_DELAY();
 
 	// Move pawns
-	SimMove(1, 3, 2, 3);
+	SimMove(SQUARE(1, 3), SQUARE(2, 3));
 	SMALL_DELAY();
-	SimMove(6, 3, 5, 3);
+	SimMove(SQUARE(6, 3), SQUARE(5, 3));
 	SMALL_DELAY();
 
 	// Move bishops
-	SimMove(0, 2, 2, 4);
+	SimMove(SQUARE(0, 2), SQUARE(2, 4));
 	SMALL_DELAY();
-	SimMove(7, 2, 5, 4);
+	SimMove(SQUARE(7, 2), SQUARE(5, 4));
 	SMALL_DELAY();
 
 	// Move queens
-	SimMove(0, 3, 1, 3);
+	SimMove(SQUARE(0, 3), SQUARE(1, 3));
 	SMALL_DELAY();
-	SimMove(7, 3, 6, 3);
+	SimMove(SQUARE(7, 3), SQUARE(6, 3));
 	SMALL_DELAY();
 
 	// Lift rook
-	SimSetSensor(0, 0, 0);
+	SimSetSensor(SQUARE(0, 0), 0);
 	SMALL_DELAY();
 	// Lift king
-	SimSetSensor(0, 4, 0);
+	SimSetSensor(SQUARE(0, 4), 0);
 	SMALL_DELAY();
 
 	// Place king
-	SimSetSensor(0, 2, 1);
+	SimSetSensor(SQUARE(0, 2), 1);
 	SMALL_DELAY();
 	// Place rook in wrong spot
-	SimSetSensor(0, 1, 1);
+	SimSetSensor(SQUARE(0, 1), 1);
 	SMALL_DELAY();
 	// Move rook to right spot
-	SimMove(0, 1, 0, 3);
+	SimMove(SQUARE(0, 1), SQUARE(0, 3));
 	SMALL_DELAY();
 
 	/*
 	// Lift rook
-	SimSetSensor(0, 0, 0);
+	SimSetSensor(SQUARE(0, 0), 0);
 	SMALL_DELAY();
 	// Lift king
-	SimSetSensor(0, 4, 0);
+	SimSetSensor(SQUARE(0, 4), 0);
 	SMALL_DELAY();
 
 	// Place king
-	SimSetSensor(0, 1, 1);
+	SimSetSensor(SQUARE(0, 1), 1);
 	SMALL_DELAY();
 	// Place rook
-	SimSetSensor(0, 2, 1);
+	SimSetSensor(SQUARE(0, 2), 1);
 	SMALL_DELAY();
 	*/
 }
 
-int main()
+/**
+ * @brief Appends recorded trace bytes to the file the scenario is being recorded to
+ */
+void WriteTraceFile(void* file, const uint8_t* bytes, uint8_t length)
+{
+	fwrite(bytes, 1, length, (FILE*)file);
+}
+
+/**
+ * @brief Reads and writes the checkpoint region, which the simulator keeps in a file
+ */
+void ReadCheckpointFile(void* file, uint32_t offset, uint8_t* bytes, uint16_t length)
+{
+	// A region that was never written all the way through reads as zeros, like erased memory
+	memset(bytes, 0, length);
+	if (fseek((FILE*)file, (long)offset, SEEK_SET) == 0)
+	{
+		fread(bytes, 1, length, (FILE*)file);
+	}
+}
+
+void WriteCheckpointFile(void* file, uint32_t offset, const uint8_t* bytes, uint16_t length)
+{
+	fseek((FILE*)file, (long)offset, SEEK_SET);
+	fwrite(bytes, 1, length, (FILE*)file);
+	fflush((FILE*)file);
+}
+
+/**
+ * @brief Prints the moves of a resumed game in coordinate notation
+ */
+void PrintCheckpointMoves(const struct Checkpoint* checkpoint)
+{
+	printf("%u moves:", checkpoint->numMoves);
+	for (uint16_t i = 0; i < checkpoint->numMoves; i++)
+	{
+		uint8_t from = CHECKPOINT_MOVE_FROM(checkpoint->moves[i]);
+		uint8_t to = CHECKPOINT_MOVE_TO(checkpoint->moves[i]);
+		enum PieceType promotion = CHECKPOINT_MOVE_PROMOTION(checkpoint->moves[i]);
+		printf(" %c%c%c%c%s", 'a' + SQUARE_COLUMN(from), '1' + SQUARE_ROW(from), 'a' + SQUARE_COLUMN(to), '1' + SQUARE_ROW(to),
+			promotion != NONE ? ChessPieceTypeToString(promotion) : "");
+	}
+	printf("\n");
+}
+
+#ifdef INSTRUMENT
+void PrintLatencyLine(const char* line)
+{
+	printf("%s\n", line);
+}
+#endif
+
+int main(int argc, char** argv)
 {
 	InitTracker();
+
+	// resume picks up the game saved in a checkpoint file by an earlier run, with the pieces where it left them
+	bool resume = argc > 1 && strcmp(argv[1], "resume") == 0;
+	if (resume && argc != 3)
+	{
+		printf("usage: %s resume <checkpoint file>\n", argv[0]);
+		return 1;
+	}
+
+	// Optionally save the game after every turn, as the firmware does, to a checkpoint file
+	struct CheckpointStore checkpointStore;
+	FILE* checkpointFile = NULL;
+	const char* checkpointPath = resume ? argv[2] : argc > 3 ? argv[3] : NULL;
+	if (checkpointPath)
+	{
+		checkpointFile = fopen(checkpointPath, "r+b");
+		if (!checkpointFile && !resume)
+		{
+			checkpointFile = fopen(checkpointPath, "w+b");
+		}
+		if (!checkpointFile)
+		{
+			printf("cannot open %s\n", checkpointPath);
+			return 1;
+		}
+		OpenCheckpointStore(&checkpointStore, ReadCheckpointFile, WriteCheckpointFile, checkpointFile);
+	}
+
+	if (resume)
+	{
+		// The pieces were left where the game was saved
+		for (uint8_t square = 0; square < NUM_SQUARES; square++)
+		{
+			SimSetSensor(square, GetCheckpointPiece(&checkpointStore.checkpoint, square) != EMPTY_PIECE);
+		}
+
+		uint8_t resumed = ResumeTracker(&checkpointStore);
+		if (resumed)
+		{
+			PrintChessboard();
+			printf("%s to move\n", GetCurrentTurn() == WHITE ? "white" : "black");
+			PrintCheckpointMoves(&checkpointStore.checkpoint);
+		}
+		else
+		{
+			printf("no game to resume in %s\n", checkpointPath);
+		}
+		fclose(checkpointFile);
+		return resumed ? 0 : 1;
+	}
+
+	// Optionally record the scenario's raw sensor frames for tools/replay.c
+	struct TraceWriter traceWriter;
+	FILE* traceFile = NULL;
+	if (argc > 2 && strcmp(argv[2], "-") != 0)
+	{
+		traceFile = fopen(argv[2], "wb");
+		if (!traceFile)
+		{
+			printf("cannot open %s\n", argv[2]);
+			return 1;
+		}
+		InitTraceWriter(&traceWriter, WriteTraceFile, traceFile);
+		SetTraceWriter(&traceWriter);
+	}
+	if (checkpointFile)
+	{
+		SetCheckpointStore(&checkpointStore);
+	}
+#ifdef _WIN32
 	HANDLE trackingThread = CreateThread(NULL, 0, TrackingThreadFunction, NULL, 0, NULL);
+#ifdef TRACKER_ASYNC_SCAN
+	HANDLE scanningThread = CreateThread(NULL, 0, ScanningThreadFunction, NULL, 0, NULL);
+#endif
+#endif
 	bool testLegalMoves = false;
 	bool testIllegalMoves = true;
 	bool testCastling = false;
 
+	// The scenario can also be picked on the command line: legal, illegal or castling, optionally followed by a file to
+	// record its trace to (- for none) and a file to save the game to
+	if (argc > 1)
+	{
+		testLegalMoves = strcmp(argv[1], "legal") == 0;
+		testIllegalMoves = strcmp(argv[1], "illegal") == 0;
+		testCastling = strcmp(argv[1], "castling") == 0;
+		if (!testLegalMoves && !testIllegalMoves && !testCastling)
+		{
+			printf("usage: %s [legal|illegal|castling] [trace file|-] [checkpoint file]\n       %s resume <checkpoint file>\n", argv[0], argv[0]);
+			return 1;
+		}
+	}
+
 	if (testLegalMoves)
 	{
 		TestLegalMoves();
@@ -466,6 +667,30 @@ int main()
 		TestCastling();
 	}
 	
+#ifdef _WIN32
 	Running = false;
 	WaitForSingleObject(trackingThread, INFINITE);
+#ifdef TRACKER_ASYNC_SCAN
+	WaitForSingleObject(scanningThread, INFINITE);
+#endif
+#endif
+
+	if (traceFile)
+	{
+		SetTraceWriter(NULL);
+		fclose(traceFile);
+		printf("trace: %" PRIu32 " frame changes in %" PRIu32 " bytes\n", traceWriter.records, traceWriter.bytes);
+	}
+	if (checkpointFile)
+	{
+		SetCheckpointStore(NULL);
+		fclose(checkpointFile);
+		printf("checkpoint: %" PRIu32 " saves, %u moves\n", checkpointStore.saves, checkpointStore.checkpoint.numMoves);
+	}
+
+#ifdef INSTRUMENT
+	DumpTrackerTransitions(PrintLatencyLine);
+	DumpLatencyHistograms(PrintLatencyLine);
+#endif
+	return 0;
 }
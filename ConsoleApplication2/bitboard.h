@@ -0,0 +1,105 @@
+#ifndef BITBOARD_H_
+#define BITBOARD_H_
+
+#include "types.h"
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+/**
+ * @brief Returns the number of set bits (pieces) in the given bitboard
+ */
+static inline uint8_t PopCount(Bitboard bitboard)
+{
+#if defined(__GNUC__)
+	return (uint8_t)__builtin_popcountll(bitboard);
+#elif defined(_MSC_VER) && defined(_M_X64)
+	return (uint8_t)__popcnt64(bitboard);
+#else
+	uint8_t count = 0;
+	for (; bitboard; bitboard &= bitboard - 1)
+	{
+		count++;
+	}
+	return count;
+#endif
+}
+
+/**
+ * @brief Returns the square of the lowest set bit. Bitboard must not be empty.
+ */
+static inline uint8_t LowestSquare(Bitboard bitboard)
+{
+#if defined(__GNUC__)
+	return (uint8_t)__builtin_ctzll(bitboard);
+#elif defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanForward64(&index, bitboard);
+	return (uint8_t)index;
+#else
+	uint8_t square = 0;
+	while (!(bitboard & 1))
+	{
+		bitboard >>= 1;
+		square++;
+	}
+	return square;
+#endif
+}
+
+/**
+ * @brief Returns the square of the lowest set bit and clears it from the bitboard. Bitboard must not be empty.
+ */
+static inline uint8_t PopLowestSquare(Bitboard* bitboard)
+{
+	uint8_t square = LowestSquare(*bitboard);
+	*bitboard &= *bitboard - 1;
+	return square;
+}
+
+/**
+ * @brief Returns the squares strictly between square1 and square2 if they share a row, column or diagonal. Empty otherwise.
+ */
+static inline Bitboard BetweenMask(uint8_t square1, uint8_t square2)
+{
+	const Bitboard all = ~(Bitboard)0;
+	const Bitboard a2a7 = 0x0001010101010100ULL;
+	const Bitboard b2g7 = 0x0040201008040200ULL;
+	const Bitboard h1b7 = 0x0002040810204080ULL;
+
+	Bitboard between = (all << square1) ^ (all << square2);
+	int column = (square2 & 7) - (square1 & 7);
+	int row = ((square2 | 7) - square1) >> 3;
+
+	// Pick the line template the two squares share (if any), then shift it onto the lower square
+	Bitboard line = (Bitboard)((column & 7) - 1) & a2a7;
+	line += 2 * ((Bitboard)((row & 7) - 1) >> 58);
+	line += (Bitboard)(((row - column) & 15) - 1) & b2g7;
+	line += (Bitboard)(((row + column) & 15) - 1) & h1b7;
+	line *= between & (0 - between);
+
+	return line & between;
+}
+
+/**
+ * @brief Returns the bitboard mirrored about the a1-h8 diagonal, which turns row-major square numbering (SQUARE) into
+ * column-major numbering (SENSOR_BIT) and back
+ */
+static inline Bitboard FlipDiagonal(Bitboard bitboard)
+{
+	const Bitboard k1 = 0x5500550055005500ULL;
+	const Bitboard k2 = 0x3333000033330000ULL;
+	const Bitboard k4 = 0x0F0F0F0F00000000ULL;
+
+	// Swap the off-diagonal 4x4 blocks, then the 2x2 blocks inside them, then single bits
+	Bitboard t = k4 & (bitboard ^ (bitboard << 28));
+	bitboard ^= t ^ (t >> 28);
+	t = k2 & (bitboard ^ (bitboard << 14));
+	bitboard ^= t ^ (t >> 14);
+	t = k1 & (bitboard ^ (bitboard << 7));
+	bitboard ^= t ^ (t >> 7);
+	return bitboard;
+}
+
+#endif /* BITBOARD_H_ */
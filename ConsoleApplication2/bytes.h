@@ -0,0 +1,35 @@
+#ifndef BYTES_H_
+#define BYTES_H_
+
+#include "types.h"
+
+/*
+ * Byte order helpers for the formats written to storage (traces and checkpoints). Both are little-endian no matter
+ * the host, so a file recorded on the board reads back the same in the simulator.
+ */
+
+/**
+ * @brief Stores the low size bytes of value into bytes, least significant first
+ */
+static inline void PutLittleEndian(uint8_t* bytes, uint64_t value, uint8_t size)
+{
+	for (uint8_t i = 0; i < size; i++)
+	{
+		bytes[i] = (uint8_t)(value >> (i * 8));
+	}
+}
+
+/**
+ * @brief Returns the size bytes at bytes read least significant first
+ */
+static inline uint64_t GetLittleEndian(const uint8_t* bytes, uint8_t size)
+{
+	uint64_t value = 0;
+	for (uint8_t i = 0; i < size; i++)
+	{
+		value |= (uint64_t)bytes[i] << (i * 8);
+	}
+	return value;
+}
+
+#endif /* BYTES_H_ */
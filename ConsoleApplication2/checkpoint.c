@@ -0,0 +1,253 @@
+#include "checkpoint.h"
+#include "tables.h"
+#include "bytes.h"
+
+#ifndef SIM
+#include "stm32l1xx_hal.h"
+#endif
+
+static void ClearCheckpoint(struct Checkpoint* checkpoint);
+static uint16_t ReadSlot(struct CheckpointStore* store, uint8_t slot, uint8_t* bytes, uint32_t* sequence);
+static uint16_t PutCheckpoint(const struct Checkpoint* checkpoint, uint8_t* bytes);
+static void GetCheckpoint(struct Checkpoint* checkpoint, const uint8_t* bytes, uint16_t length);
+static uint32_t Crc32(const uint8_t* bytes, uint16_t length);
+
+uint8_t OpenCheckpointStore(struct CheckpointStore* store, CheckpointReadFunction read, CheckpointWriteFunction write, void* user)
+{
+	uint8_t bytes[CHECKPOINT_SLOT_SIZE];
+	uint8_t newest = CHECKPOINT_SLOTS;
+
+	store->read = read;
+	store->write = write;
+	store->user = user;
+	store->sequence = 0;
+	store->nextSlot = 0;
+	store->saves = 0;
+	ClearCheckpoint(&store->checkpoint);
+
+	// The newest intact slot wins. Sequence numbers are compared by difference so they can wrap.
+	for (uint8_t slot = 0; slot < CHECKPOINT_SLOTS; slot++)
+	{
+		uint32_t sequence;
+		if (ReadSlot(store, slot, bytes, &sequence) && (newest == CHECKPOINT_SLOTS || (int32_t)(sequence - store->sequence) > 0))
+		{
+			newest = slot;
+			store->sequence = sequence;
+		}
+	}
+
+	if (newest == CHECKPOINT_SLOTS)
+	{
+		return 0;
+	}
+
+	uint32_t sequence;
+	uint16_t length = ReadSlot(store, newest, bytes, &sequence);
+	GetCheckpoint(&store->checkpoint, bytes + CHECKPOINT_HEADER_SIZE, length);
+	store->nextSlot = (newest + 1) % CHECKPOINT_SLOTS;
+	return 1;
+}
+
+void SaveCheckpoint(struct CheckpointStore* store)
+{
+	uint8_t bytes[CHECKPOINT_SLOT_SIZE] = { CHECKPOINT_MAGIC[0], CHECKPOINT_MAGIC[1], CHECKPOINT_MAGIC[2], CHECKPOINT_MAGIC[3] };
+
+	store->sequence++;
+	uint16_t length = PutCheckpoint(&store->checkpoint, bytes + CHECKPOINT_HEADER_SIZE);
+	PutLittleEndian(bytes + 4, store->sequence, 4);
+	PutLittleEndian(bytes + 8, length, 2);
+	length += CHECKPOINT_HEADER_SIZE;
+	PutLittleEndian(bytes + length, Crc32(bytes, length), 4);
+	length += 4;
+
+	store->write(store->user, (uint32_t)store->nextSlot * CHECKPOINT_SLOT_SIZE, bytes, length);
+	store->nextSlot = (store->nextSlot + 1) % CHECKPOINT_SLOTS;
+	store->saves++;
+}
+
+void AppendCheckpointMove(struct Checkpoint* checkpoint, uint16_t move)
+{
+	if (checkpoint->numMoves < CHECKPOINT_MAX_MOVES)
+	{
+		checkpoint->moves[checkpoint->numMoves++] = move;
+	}
+}
+
+uint64_t CalculateCheckpointKey(const struct Checkpoint* checkpoint)
+{
+	uint64_t key = 0;
+	for (uint8_t square = 0; square < NUM_SQUARES; square++)
+	{
+		key ^= PieceZobristKey(GetCheckpointPiece(checkpoint, square), square);
+	}
+	return key;
+}
+
+void SetCheckpointPiece(struct Checkpoint* checkpoint, uint8_t square, Piece piece)
+{
+	uint8_t shift = (square & 1) << 2;
+	checkpoint->board[square >> 1] = (uint8_t)((checkpoint->board[square >> 1] & ~(0x0F << shift)) | (piece << shift));
+}
+
+Piece GetCheckpointPiece(const struct Checkpoint* checkpoint, uint8_t square)
+{
+	return (checkpoint->board[square >> 1] >> ((square & 1) << 2)) & 0x0F;
+}
+
+#ifndef SIM
+void ReadDataEeprom(void* user, uint32_t offset, uint8_t* bytes, uint16_t length)
+{
+	const volatile uint8_t* eeprom = (const volatile uint8_t*)(DATA_EEPROM_BASE + offset);
+	for (uint16_t i = 0; i < length; i++)
+	{
+		bytes[i] = eeprom[i];
+	}
+}
+
+void WriteDataEeprom(void* user, uint32_t offset, const uint8_t* bytes, uint16_t length)
+{
+	// Each word takes milliseconds to program and wears the cells, so only the ones that differ are written. Slots
+	// start on a word, and consecutive checkpoints share most of their moves.
+	HAL_FLASHEx_DATAEEPROM_Unlock();
+	for (uint16_t i = 0; i < length; i += 4)
+	{
+		uint32_t address = DATA_EEPROM_BASE + offset + i;
+		uint32_t word = *(const volatile uint32_t*)address;
+		for (uint8_t j = 0; j < 4 && i + j < length; j++)
+		{
+			word = (word & ~((uint32_t)0xFF << (j * 8))) | ((uint32_t)bytes[i + j] << (j * 8));
+		}
+		if (word != *(const volatile uint32_t*)address)
+		{
+			HAL_FLASHEx_DATAEEPROM_Program(FLASH_TYPEPROGRAMDATA_WORD, address, word);
+		}
+	}
+	HAL_FLASHEx_DATAEEPROM_Lock();
+}
+#endif
+
+/**
+ * @brief Makes the checkpoint an empty board with white to move and no moves
+ */
+static void ClearCheckpoint(struct Checkpoint* checkpoint)
+{
+	for (uint8_t i = 0; i < NUM_SQUARES / 2; i++)
+	{
+		checkpoint->board[i] = 0;
+	}
+	checkpoint->currentTurn = WHITE;
+	checkpoint->castleFlags = 0;
+	checkpoint->killSquare = CHECKPOINT_NO_SQUARE;
+	checkpoint->killPiece = 0;
+	checkpoint->promotionSquare = CHECKPOINT_NO_SQUARE;
+	checkpoint->promotionPiece = 0;
+	checkpoint->key = 0;
+	checkpoint->numMoves = 0;
+}
+
+/**
+ * @brief Reads a slot into bytes. Returns the length of its payload, or 0 if the slot was never written or its CRC
+ * doesn't match.
+ */
+static uint16_t ReadSlot(struct CheckpointStore* store, uint8_t slot, uint8_t* bytes, uint32_t* sequence)
+{
+	uint32_t offset = (uint32_t)slot * CHECKPOINT_SLOT_SIZE;
+
+	store->read(store->user, offset, bytes, CHECKPOINT_HEADER_SIZE);
+	uint16_t length = (uint16_t)GetLittleEndian(bytes + 8, 2);
+	if (bytes[0] != CHECKPOINT_MAGIC[0] || bytes[1] != CHECKPOINT_MAGIC[1] || bytes[2] != CHECKPOINT_MAGIC[2]
+		|| bytes[3] != CHECKPOINT_MAGIC[3] || length < CHECKPOINT_STATE_SIZE || length > CHECKPOINT_SLOT_SIZE - CHECKPOINT_HEADER_SIZE - 4)
+	{
+		return 0;
+	}
+
+	store->read(store->user, offset + CHECKPOINT_HEADER_SIZE, bytes + CHECKPOINT_HEADER_SIZE, length + 4);
+	if (Crc32(bytes, CHECKPOINT_HEADER_SIZE + length) != (uint32_t)GetLittleEndian(bytes + CHECKPOINT_HEADER_SIZE + length, 4))
+	{
+		return 0;
+	}
+
+	*sequence = (uint32_t)GetLittleEndian(bytes + 4, 4);
+	return length;
+}
+
+/**
+ * @brief Writes the checkpoint's payload and returns its length
+ */
+static uint16_t PutCheckpoint(const struct Checkpoint* checkpoint, uint8_t* bytes)
+{
+	uint16_t length = 0;
+
+	for (uint8_t i = 0; i < NUM_SQUARES / 2; i++)
+	{
+		bytes[length++] = checkpoint->board[i];
+	}
+	bytes[length++] = checkpoint->currentTurn;
+	bytes[length++] = checkpoint->castleFlags;
+	bytes[length++] = checkpoint->killSquare;
+	bytes[length++] = checkpoint->killPiece;
+	bytes[length++] = checkpoint->promotionSquare;
+	bytes[length++] = checkpoint->promotionPiece;
+	PutLittleEndian(bytes + length, checkpoint->key, 8);
+	length += 8;
+	PutLittleEndian(bytes + length, checkpoint->numMoves, 2);
+	length += 2;
+
+	for (uint16_t i = 0; i < checkpoint->numMoves; i++)
+	{
+		PutLittleEndian(bytes + length, checkpoint->moves[i], 2);
+		length += 2;
+	}
+	return length;
+}
+
+/**
+ * @brief Reads a payload of length bytes, already known to be intact, into the checkpoint
+ */
+static void GetCheckpoint(struct Checkpoint* checkpoint, const uint8_t* bytes, uint16_t length)
+{
+	uint16_t offset = 0;
+
+	for (uint8_t i = 0; i < NUM_SQUARES / 2; i++)
+	{
+		checkpoint->board[i] = bytes[offset++];
+	}
+	checkpoint->currentTurn = bytes[offset++];
+	checkpoint->castleFlags = bytes[offset++];
+	checkpoint->killSquare = bytes[offset++];
+	checkpoint->killPiece = bytes[offset++];
+	checkpoint->promotionSquare = bytes[offset++];
+	checkpoint->promotionPiece = bytes[offset++];
+	checkpoint->key = GetLittleEndian(bytes + offset, 8);
+	offset += 8;
+	checkpoint->numMoves = (uint16_t)GetLittleEndian(bytes + offset, 2);
+	offset += 2;
+
+	// Only take the moves the payload really holds
+	if (checkpoint->numMoves > (length - offset) / 2)
+	{
+		checkpoint->numMoves = (length - offset) / 2;
+	}
+	for (uint16_t i = 0; i < checkpoint->numMoves; i++)
+	{
+		checkpoint->moves[i] = (uint16_t)GetLittleEndian(bytes + offset, 2);
+		offset += 2;
+	}
+}
+
+/**
+ * @brief CRC-32 (IEEE 802.3, reflected), bit at a time since a checkpoint is only written once a turn
+ */
+static uint32_t Crc32(const uint8_t* bytes, uint16_t length)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	for (uint16_t i = 0; i < length; i++)
+	{
+		crc ^= bytes[i];
+		for (uint8_t bit = 0; bit < 8; bit++)
+		{
+			crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+		}
+	}
+	return ~crc;
+}
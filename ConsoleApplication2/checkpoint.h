@@ -0,0 +1,123 @@
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include "types.h"
+
+/*
+ * Power loss recovery. After every turn the tracker saves a compact checkpoint of its state and the game's moves (see
+ * SetCheckpointStore), and on boot ResumeTracker puts the game back the way it was instead of starting over. The
+ * checkpoints go round a region of CHECKPOINT_SLOTS slots in turn so the writes wear it evenly: the data EEPROM on the
+ * target, a file in the simulator. A write cut short by the power going leaves the slot's CRC wrong, and the slot
+ * before it is used instead.
+ *
+ * Slot:     "CKP1", sequence number (4 bytes little endian), payload length (2 bytes little endian), payload, CRC-32
+ *           of everything before it (4 bytes little endian)
+ * Payload:  piece codes of the 64 squares two to a byte (low nibble first), team to move (1 byte), castle flags
+ *           (1 byte), square and piece code of the piece to kill (2 bytes), square and piece code of the pawn to
+ *           promote (2 bytes), Zobrist key of the pieces (8 bytes little endian), number of moves (2 bytes little
+ *           endian), the moves (2 bytes little endian each, see CHECKPOINT_MOVE)
+ *
+ * Piece codes are packed pieces (see Piece) and squares are indexed by SQUARE, with CHECKPOINT_NO_SQUARE for a kill or
+ * promotion that isn't pending.
+ *
+ * Build options:
+ * CHECKPOINT_SLOTS     - slots in the region (default 4)
+ * CHECKPOINT_MAX_MOVES - moves of the game a checkpoint keeps (default 160). The position is still saved after that,
+ *                        only the move list stops growing.
+ */
+
+#ifndef CHECKPOINT_SLOTS
+#define CHECKPOINT_SLOTS 4
+#endif
+
+#ifndef CHECKPOINT_MAX_MOVES
+#define CHECKPOINT_MAX_MOVES 160
+#endif
+
+#define CHECKPOINT_MAGIC "CKP1"
+#define CHECKPOINT_HEADER_SIZE 10
+#define CHECKPOINT_STATE_SIZE (NUM_SQUARES / 2 + 16)
+#define CHECKPOINT_SLOT_SIZE ((CHECKPOINT_HEADER_SIZE + CHECKPOINT_STATE_SIZE + 2 * CHECKPOINT_MAX_MOVES + 4 + 3) & ~3)	// Whole words
+#define CHECKPOINT_REGION_SIZE ((uint32_t)CHECKPOINT_SLOTS * CHECKPOINT_SLOT_SIZE)
+
+#define CHECKPOINT_NO_SQUARE 0xFF
+
+// Castle flags, one per flag of the tracker //
+#define CHECKPOINT_CASTLE_A1 0x01
+#define CHECKPOINT_CASTLE_H1 0x02
+#define CHECKPOINT_CASTLE_A8 0x04
+#define CHECKPOINT_CASTLE_H8 0x08
+#define CHECKPOINT_CASTLE_WHITE_KING 0x10
+#define CHECKPOINT_CASTLE_BLACK_KING 0x20
+
+// A move of the game: from and to squares, and the type a pawn was promoted to (NONE otherwise)
+#define CHECKPOINT_MOVE(from, to, promotion) ((uint16_t)((from) | ((to) << 6) | ((promotion) << 12)))
+#define CHECKPOINT_MOVE_FROM(move) ((uint8_t)((move) & 63))
+#define CHECKPOINT_MOVE_TO(move) ((uint8_t)(((move) >> 6) & 63))
+#define CHECKPOINT_MOVE_PROMOTION(move) ((enum PieceType)((move) >> 12))
+
+/**
+ * @brief Reads and writes the region, offsets counted from its start
+ */
+typedef void (*CheckpointReadFunction)(void* user, uint32_t offset, uint8_t* bytes, uint16_t length);
+typedef void (*CheckpointWriteFunction)(void* user, uint32_t offset, const uint8_t* bytes, uint16_t length);
+
+/**
+ * @brief Everything needed to pick the game up again, as of the end of a turn
+ */
+struct Checkpoint {
+	uint8_t board[NUM_SQUARES / 2];		// Piece codes, see GetCheckpointPiece
+	uint8_t currentTurn;
+	uint8_t castleFlags;
+	uint8_t killSquare;
+	Piece killPiece;
+	uint8_t promotionSquare;
+	Piece promotionPiece;
+	uint64_t key;				// Zobrist key of the pieces, as the pathfinder had it
+	uint16_t numMoves;
+	uint16_t moves[CHECKPOINT_MAX_MOVES];
+};
+
+struct CheckpointStore {
+	CheckpointReadFunction read;
+	CheckpointWriteFunction write;
+	void* user;
+	uint32_t sequence;		// Of the newest checkpoint in the region, 0 if there is none
+	uint8_t nextSlot;		// Where the next checkpoint goes, the slot after the newest
+	uint32_t saves;
+	struct Checkpoint checkpoint;	// The newest checkpoint, which the tracker brings up to date after every turn
+};
+
+/**
+ * @brief Opens the region read and written through read and write, and loads its newest intact checkpoint. Returns 1
+ * if there was one, 0 if the region holds no game (the checkpoint is then the empty board with no moves).
+ */
+uint8_t OpenCheckpointStore(struct CheckpointStore* store, CheckpointReadFunction read, CheckpointWriteFunction write, void* user);
+
+/**
+ * @brief Writes the store's checkpoint to the slot after the newest one
+ */
+void SaveCheckpoint(struct CheckpointStore* store);
+
+/**
+ * @brief Adds a move to the checkpoint's game, unless it already holds CHECKPOINT_MAX_MOVES
+ */
+void AppendCheckpointMove(struct Checkpoint* checkpoint, uint16_t move);
+
+/**
+ * @brief Returns the Zobrist key of the checkpoint's pieces, worked out from its board
+ */
+uint64_t CalculateCheckpointKey(const struct Checkpoint* checkpoint);
+
+void SetCheckpointPiece(struct Checkpoint* checkpoint, uint8_t square, Piece piece);
+Piece GetCheckpointPiece(const struct Checkpoint* checkpoint, uint8_t square);
+
+#ifndef SIM
+/**
+ * @brief Read and write functions for a region at the start of the data EEPROM. User is unused.
+ */
+void ReadDataEeprom(void* user, uint32_t offset, uint8_t* bytes, uint16_t length);
+void WriteDataEeprom(void* user, uint32_t offset, const uint8_t* bytes, uint16_t length);
+#endif
+
+#endif /* CHECKPOINT_H_ */
@@ -0,0 +1,83 @@
+#include "debounce.h"
+#include "bitboard.h"
+
+// The count of a full window must fit in the bit slices, and a change must win a strict majority of it
+typedef char DebounceWindowCheck[DEBOUNCE_WINDOW >= 1 && DEBOUNCE_WINDOW < (1 << DEBOUNCE_COUNT_BITS) ? 1 : -1];
+typedef char DebounceSettleCheck[2 * DEBOUNCE_SETTLE > DEBOUNCE_WINDOW && DEBOUNCE_SETTLE <= DEBOUNCE_WINDOW ? 1 : -1];
+
+static Bitboard CountAtLeast(const Bitboard counts[DEBOUNCE_COUNT_BITS], uint8_t threshold);
+
+void InitDebouncer(struct Debouncer* debouncer, Bitboard occupancy)
+{
+	for (uint8_t i = 0; i < DEBOUNCE_WINDOW; i++)
+	{
+		debouncer->samples[i] = occupancy;
+	}
+
+	// Every occupied square has been occupied for the whole window
+	for (uint8_t bit = 0; bit < DEBOUNCE_COUNT_BITS; bit++)
+	{
+		debouncer->counts[bit] = (DEBOUNCE_WINDOW >> bit) & 1 ? occupancy : 0;
+	}
+
+	debouncer->stable = occupancy;
+	debouncer->lastSample = occupancy;
+	debouncer->next = 0;
+	debouncer->stats.glitches = 0;
+}
+
+Bitboard DebounceSample(struct Debouncer* debouncer, Bitboard sample)
+{
+	Bitboard oldest = debouncer->samples[debouncer->next];
+	Bitboard carry = sample & ~oldest;
+	Bitboard borrow = oldest & ~sample;
+
+	debouncer->samples[debouncer->next] = sample;
+	debouncer->next = debouncer->next + 1 == DEBOUNCE_WINDOW ? 0 : debouncer->next + 1;
+
+	// Count the new sample in and the oldest one out, rippling through the bit slices. A square can't carry and borrow.
+	for (uint8_t bit = 0; bit < DEBOUNCE_COUNT_BITS; bit++)
+	{
+		Bitboard count = debouncer->counts[bit];
+		debouncer->counts[bit] = count ^ carry ^ borrow;
+		carry &= count;
+		borrow &= ~count;
+	}
+
+	// Squares that filled or emptied in enough of the window take the new value, the rest keep theirs
+	Bitboard filled = CountAtLeast(debouncer->counts, DEBOUNCE_SETTLE);
+	Bitboard emptied = ~CountAtLeast(debouncer->counts, DEBOUNCE_WINDOW - DEBOUNCE_SETTLE + 1);
+	Bitboard stable = (debouncer->stable | filled) & ~emptied;
+
+	// A square that read differently last scan but is back to its settled value without having changed was a glitch
+	Bitboard glitches = (debouncer->lastSample ^ debouncer->stable) & ~(sample ^ stable) & ~(debouncer->stable ^ stable);
+	debouncer->stats.glitches += PopCount(glitches);
+
+	debouncer->lastSample = sample;
+	debouncer->stable = stable;
+	return stable;
+}
+
+/**
+ * @brief Returns the squares whose bit-sliced count is at least threshold, comparing from the top bit down
+ */
+static Bitboard CountAtLeast(const Bitboard counts[DEBOUNCE_COUNT_BITS], uint8_t threshold)
+{
+	Bitboard greater = 0;
+	Bitboard equal = ~(Bitboard)0;
+
+	for (int8_t bit = DEBOUNCE_COUNT_BITS - 1; bit >= 0; bit--)
+	{
+		if ((threshold >> bit) & 1)
+		{
+			equal &= counts[bit];
+		}
+		else
+		{
+			greater |= equal & counts[bit];
+			equal &= ~counts[bit];
+		}
+	}
+
+	return greater | equal;
+}
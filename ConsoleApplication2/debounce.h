@@ -0,0 +1,54 @@
+#ifndef DEBOUNCE_H_
+#define DEBOUNCE_H_
+
+#include "types.h"
+
+/*
+ * Filters sensor chatter out of the occupancy samples before the scanner turns them into events. The last few samples
+ * are kept as 64 bit words and every square's count of occupied readings among them is kept bit-sliced, one word per
+ * binary digit, so a scan costs the same handful of word operations however many squares are chattering. A square only
+ * changes once a new reading has won enough of the window:
+ *
+ * DEBOUNCE_WINDOW - samples each square is judged on, 1 to 15 (default 4). 1 turns the filter off.
+ * DEBOUNCE_SETTLE - readings of the window a change needs, more than half the window up to all of it (default all of
+ *                   it, so a change is accepted after DEBOUNCE_SETTLE identical scans in a row). Anything between
+ *                   keeps the current value.
+ */
+
+#ifndef DEBOUNCE_WINDOW
+#define DEBOUNCE_WINDOW 4
+#endif
+
+#ifndef DEBOUNCE_SETTLE
+#define DEBOUNCE_SETTLE DEBOUNCE_WINDOW
+#endif
+
+#define DEBOUNCE_COUNT_BITS 4
+
+/**
+ * @brief How much chatter the filter has kept from the tracker
+ */
+struct DebounceStats {
+	uint32_t glitches;	// Readings that flipped back before they settled
+};
+
+struct Debouncer {
+	Bitboard samples[DEBOUNCE_WINDOW];		// Last samples, oldest at next
+	Bitboard counts[DEBOUNCE_COUNT_BITS];	// Bit i of each square's count of occupied samples
+	Bitboard stable;						// Filtered occupancy
+	Bitboard lastSample;
+	uint8_t next;
+	struct DebounceStats stats;
+};
+
+/**
+ * @brief Starts the filter off settled on occupancy
+ */
+void InitDebouncer(struct Debouncer* debouncer, Bitboard occupancy);
+
+/**
+ * @brief Adds a sample and returns the filtered occupancy
+ */
+Bitboard DebounceSample(struct Debouncer* debouncer, Bitboard sample);
+
+#endif /* DEBOUNCE_H_ */
@@ -0,0 +1,47 @@
+#include "eventqueue.h"
+
+// The free running indices wrap at 65536, so the ring must divide it
+typedef char SensorEventQueueSizeCheck[(SENSOR_EVENT_QUEUE_SIZE & (SENSOR_EVENT_QUEUE_SIZE - 1)) == 0 && SENSOR_EVENT_QUEUE_SIZE <= 32768 ? 1 : -1];
+
+void InitSensorEventQueue(struct SensorEventQueue* queue)
+{
+	queue->head = 0;
+	queue->tail = 0;
+	queue->stats.overflows = 0;
+	queue->stats.highWater = 0;
+}
+
+uint8_t PushSensorEvent(struct SensorEventQueue* queue, struct SensorEvent event)
+{
+	uint16_t head = queue->head;
+	uint16_t waiting = (uint16_t)(head - LOAD_ACQUIRE(queue->tail));
+
+	if (waiting == SENSOR_EVENT_QUEUE_SIZE)
+	{
+		queue->stats.overflows++;
+		return 0;
+	}
+
+	queue->events[head & (SENSOR_EVENT_QUEUE_SIZE - 1)] = event;
+	STORE_RELEASE(queue->head, (uint16_t)(head + 1));
+
+	if (waiting + 1 > queue->stats.highWater)
+	{
+		queue->stats.highWater = waiting + 1;
+	}
+	return 1;
+}
+
+uint8_t PopSensorEvent(struct SensorEventQueue* queue, struct SensorEvent* event)
+{
+	uint16_t tail = queue->tail;
+
+	if (tail == LOAD_ACQUIRE(queue->head))
+	{
+		return 0;
+	}
+
+	*event = queue->events[tail & (SENSOR_EVENT_QUEUE_SIZE - 1)];
+	STORE_RELEASE(queue->tail, (uint16_t)(tail + 1));
+	return 1;
+}
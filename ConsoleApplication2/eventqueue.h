@@ -0,0 +1,73 @@
+#ifndef EVENTQUEUE_H_
+#define EVENTQUEUE_H_
+
+#include "types.h"
+
+/*
+ * Single-producer/single-consumer ring of sensor transitions. The scanner (a timer interrupt on the target, a thread in
+ * the simulator) pushes an event for every square whose sensor changed, and the tracker pops them and runs the rules.
+ * Each side only writes its own index, so neither needs a lock or to disable interrupts.
+ *
+ * Build options:
+ * SENSOR_EVENT_QUEUE_SIZE - number of events the ring holds, a power of 2 (default 64, 8 bytes each)
+ */
+
+#ifndef SENSOR_EVENT_QUEUE_SIZE
+#define SENSOR_EVENT_QUEUE_SIZE 64
+#endif
+
+// The other side's index is read with acquire and our own published with release, so an event's contents are visible
+// before the index that hands it over. THREAD_FENCE keeps plain accesses from moving across it either way. MSVC already
+// gives volatile accesses acquire and release semantics, and x86 keeps loads and stores in order, so there it only has
+// to hold the compiler back.
+#if defined(__GNUC__)
+#define LOAD_ACQUIRE(index) __atomic_load_n(&(index), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(index, value) __atomic_store_n(&(index), (value), __ATOMIC_RELEASE)
+#define THREAD_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
+#include <intrin.h>
+#define LOAD_ACQUIRE(index) (index)
+#define STORE_RELEASE(index, value) ((index) = (value))
+#define THREAD_FENCE() _ReadWriteBarrier()
+#endif
+
+/**
+ * @brief A piece was picked up from or placed on a square
+ */
+struct SensorEvent {
+	uint32_t timestamp;	// Milliseconds, on the virtual clock in the simulator
+	uint8_t square;		// See SQUARE
+	uint8_t type;		// enum TransitionType
+};
+
+/**
+ * @brief How close the ring has come to losing a transition
+ */
+struct SensorEventStats {
+	uint32_t overflows;	// Pushes refused because the ring was full
+	uint16_t highWater;	// Most events ever waiting at once
+};
+
+struct SensorEventQueue {
+	struct SensorEvent events[SENSOR_EVENT_QUEUE_SIZE];
+	volatile uint16_t head;	// Free running count of pushed events, only written by the producer
+	volatile uint16_t tail;	// Free running count of popped events, only written by the consumer
+	struct SensorEventStats stats;	// Only written by the producer
+};
+
+/**
+ * @brief Empties the queue and its stats. Neither side may be using it.
+ */
+void InitSensorEventQueue(struct SensorEventQueue* queue);
+
+/**
+ * @brief Producer side. Returns 0 and counts an overflow if the queue is full, 1 otherwise.
+ */
+uint8_t PushSensorEvent(struct SensorEventQueue* queue, struct SensorEvent event);
+
+/**
+ * @brief Consumer side. Returns 0 if the queue is empty, 1 if the oldest event was copied into event.
+ */
+uint8_t PopSensorEvent(struct SensorEventQueue* queue, struct SensorEvent* event);
+
+#endif /* EVENTQUEUE_H_ */
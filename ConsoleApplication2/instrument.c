@@ -0,0 +1,151 @@
+#include "instrument.h"
+
+#ifdef INSTRUMENT
+
+#include <stdio.h>
+
+#ifndef SIM
+#include "stm32l1xx_hal.h"
+#define LATENCY_UNIT "cycles"
+#elif defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#define LATENCY_UNIT "qpc ticks"
+#elif defined(INSTRUMENT_RDTSC)
+#include <x86intrin.h>
+#define LATENCY_UNIT "tsc ticks"
+#else
+#include <time.h>
+#define LATENCY_UNIT "ns"
+#endif
+
+#define LATENCY_PROBE_NAME(name) #name,
+
+static const char* const LATENCY_PROBE_NAMES[NUM_LATENCY_PROBES] = { LATENCY_PROBES(LATENCY_PROBE_NAME) };
+
+static struct LatencyHistogram Histograms[NUM_LATENCY_PROBES];
+
+static uint8_t BucketOf(uint32_t ticks);
+
+void InitLatencyCounter(void)
+{
+#ifndef SIM
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+inline uint32_t LatencyNow(void)
+{
+#ifndef SIM
+	return DWT->CYCCNT;
+#elif defined(_WIN32)
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return (uint32_t)counter.QuadPart;
+#elif defined(INSTRUMENT_RDTSC)
+	return (uint32_t)__rdtsc();
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint32_t)((uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec);
+#endif
+}
+
+void RecordLatency(enum LatencyProbe probe, uint32_t ticks)
+{
+	struct LatencyHistogram* histogram = &Histograms[probe];
+
+	if (histogram->count == 0 || ticks < histogram->min)
+	{
+		histogram->min = ticks;
+	}
+	if (ticks > histogram->max)
+	{
+		histogram->max = ticks;
+	}
+	histogram->count++;
+	histogram->total += ticks;
+	histogram->buckets[BucketOf(ticks)]++;
+}
+
+const struct LatencyHistogram* GetLatencyHistogram(enum LatencyProbe probe)
+{
+	return &Histograms[probe];
+}
+
+void ResetLatencyHistograms(void)
+{
+	for (uint8_t probe = 0; probe < NUM_LATENCY_PROBES; probe++)
+	{
+		Histograms[probe].count = 0;
+		Histograms[probe].min = 0;
+		Histograms[probe].max = 0;
+		Histograms[probe].total = 0;
+		for (uint8_t bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+		{
+			Histograms[probe].buckets[bucket] = 0;
+		}
+	}
+}
+
+void DumpLatencyHistograms(LatencyPrintFunction print)
+{
+	char line[96];
+
+	snprintf(line, sizeof(line), "%-28s %10s %10s %10s %10s  (%s)", "probe", "count", "min", "max", "mean", LATENCY_UNIT);
+	print(line);
+
+	for (uint8_t probe = 0; probe < NUM_LATENCY_PROBES; probe++)
+	{
+		const struct LatencyHistogram* histogram = &Histograms[probe];
+		if (!histogram->count)
+		{
+			continue;
+		}
+
+		snprintf(line, sizeof(line), "%-28s %10lu %10lu %10lu %10lu", LATENCY_PROBE_NAMES[probe], (unsigned long)histogram->count,
+			(unsigned long)histogram->min, (unsigned long)histogram->max, (unsigned long)(histogram->total / histogram->count));
+		print(line);
+
+		for (uint8_t bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+		{
+			if (!histogram->buckets[bucket])
+			{
+				continue;
+			}
+
+			// Bucket 0 is [0, 2) and the last one is open ended
+			unsigned long low = bucket ? 1ul << bucket : 0;
+			if (bucket == LATENCY_BUCKETS - 1)
+			{
+				snprintf(line, sizeof(line), "    [%10lu,        ...) %10lu", low, (unsigned long)histogram->buckets[bucket]);
+			}
+			else
+			{
+				snprintf(line, sizeof(line), "    [%10lu, %10lu) %10lu", low, 2ul << bucket, (unsigned long)histogram->buckets[bucket]);
+			}
+			print(line);
+		}
+	}
+}
+
+/**
+ * @brief Returns floor(log2(ticks)), clamped to the buckets there are
+ */
+static uint8_t BucketOf(uint32_t ticks)
+{
+	uint8_t bucket = 0;
+#if defined(__GNUC__)
+	bucket = ticks ? (uint8_t)(31 - __builtin_clz(ticks)) : 0;
+#else
+	while (ticks >>= 1)
+	{
+		bucket++;
+	}
+#endif
+	return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+#endif // INSTRUMENT
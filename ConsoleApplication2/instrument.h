@@ -0,0 +1,110 @@
+#ifndef INSTRUMENT_H_
+#define INSTRUMENT_H_
+
+#include "types.h"
+
+/*
+ * Latency histograms for the hot paths of the tracker and pathfinder. Each probe keeps its count, min, max and total
+ * along with a log2 histogram: bucket i counts the calls that took [2^i, 2^(i+1)) ticks, bucket 0 also takes 0 and the
+ * last bucket everything above it. Ticks are CPU cycles from the DWT cycle counter on the target, nanoseconds from
+ * clock_gettime (or TSC ticks with INSTRUMENT_RDTSC) in the POSIX simulator and performance counter ticks on Windows.
+ *
+ * The probes are shared by every context and aren't locked, so only time calls made from one thread.
+ *
+ * Build options:
+ * INSTRUMENT         - compile the probes in, along with the tracker's per-transition counts (see
+ *                      DumpTrackerTransitions). Without it LATENCY_BEGIN and LATENCY_END expand to nothing.
+ * INSTRUMENT_RDTSC   - time the x86 simulator with the time stamp counter instead of clock_gettime
+ * LATENCY_BUCKETS    - histogram buckets per probe (default 24, enough for 16M cycles or 16 ms)
+ */
+
+#ifndef LATENCY_BUCKETS
+#define LATENCY_BUCKETS 24
+#endif
+
+// Every probe, named after the function it times
+#define LATENCY_PROBES(PROBE) \
+	PROBE(Track) \
+	PROBE(HandlePlace) \
+	PROBE(HandlePlaceIllegalState) \
+	PROBE(HandlePlaceKill) \
+	PROBE(HandlePlaceCastling) \
+	PROBE(HandlePlaceMove) \
+	PROBE(HandlePlaceNoMove) \
+	PROBE(HandlePlacePreemptPromotion) \
+	PROBE(HandlePlacePromotion) \
+	PROBE(HandlePickup) \
+	PROBE(HandlePickupIllegalState) \
+	PROBE(HandlePickupPreemptKill) \
+	PROBE(HandlePickupKill) \
+	PROBE(HandlePickupCastling) \
+	PROBE(HandlePickupMove) \
+	PROBE(HandlePickupPromotion) \
+	PROBE(EndTurn) \
+	PROBE(CalculateTeamsLegalMoves) \
+	PROBE(WillResultInSelfCheck) \
+	PROBE(IsLegalMove)
+
+#define LATENCY_PROBE_ENUM(name) PROBE_##name,
+
+enum LatencyProbe {
+	LATENCY_PROBES(LATENCY_PROBE_ENUM)
+	NUM_LATENCY_PROBES
+};
+
+struct LatencyHistogram {
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t total;
+	uint32_t buckets[LATENCY_BUCKETS];
+};
+
+/**
+ * @brief Prints one line of a dump, without the newline: puts in the simulator, the debug UART on the target
+ */
+typedef void (*LatencyPrintFunction)(const char* line);
+
+#ifdef INSTRUMENT
+
+/**
+ * @brief Starts the tick counter where it has to be turned on (the DWT cycle counter on the target)
+ */
+void InitLatencyCounter(void);
+
+/**
+ * @brief Returns the free running tick counter. Differences stay right across a wrap.
+ */
+uint32_t LatencyNow(void);
+
+/**
+ * @brief Adds a call that took ticks to the probe's histogram
+ */
+void RecordLatency(enum LatencyProbe probe, uint32_t ticks);
+
+/**
+ * @brief Returns the probe's histogram
+ */
+const struct LatencyHistogram* GetLatencyHistogram(enum LatencyProbe probe);
+
+/**
+ * @brief Clears every histogram
+ */
+void ResetLatencyHistograms(void);
+
+/**
+ * @brief Prints the count, min, max and mean of every probe that was hit, followed by its non-empty buckets
+ */
+void DumpLatencyHistograms(LatencyPrintFunction print);
+
+#define LATENCY_BEGIN(name) uint32_t latencyStart##name = LatencyNow()
+#define LATENCY_END(name) RecordLatency(PROBE_##name, LatencyNow() - latencyStart##name)
+
+#else
+
+#define LATENCY_BEGIN(name)
+#define LATENCY_END(name)
+
+#endif // INSTRUMENT
+
+#endif /* INSTRUMENT_H_ */
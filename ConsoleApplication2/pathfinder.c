@@ -1,518 +1,1097 @@
 #include "pathfinder.h"
 #include "tracker.h"
-#include <stdlib.h>
+#include "bitboard.h"
+#include "tables.h"
+#include "instrument.h"
+#include <assert.h>
+
+// Pathfinding (all paths are bitboards of destination squares, blocked by the pieces on the context's position) //
+static Bitboard CalculateAllPaths(struct PathfinderContext* context, PieceCoordinate pieceCoordinate);
+static Bitboard CalculateAllPathsPawn(struct PathfinderContext* context, PieceCoordinate pieceCoordinate);
+static Bitboard CalculateAllPathsRook(struct PathfinderContext* context, PieceCoordinate pieceCoordinate);
+static Bitboard CalculateAllPathsBishop(struct PathfinderContext* context, PieceCoordinate pieceCoordinate);
+static Bitboard CalculateAllPathsKnight(struct PathfinderContext* context, PieceCoordinate pieceCoordinate);
+static Bitboard CalculateAllPathsQueen(struct PathfinderContext* context, PieceCoordinate pieceCoordinate);
+static Bitboard CalculateAllPathsKing(struct PathfinderContext* context, PieceCoordinate pieceCoordinate);
+static Bitboard CalculateAllLegalPaths(struct PathfinderContext* context, PieceCoordinate from);
+
+// Attacks //
+static Bitboard CalculateAttackers(struct PathfinderContext* context, uint8_t square, enum PieceOwner owner, Bitboard occupied);
+static uint8_t IsSquareAttacked(struct PathfinderContext* context, uint8_t square, enum PieceOwner owner, Bitboard occupied);
+
+// Legality //
+static void CalculateLegality(struct PathfinderContext* context, enum PieceOwner owner);
+static Bitboard LineThrough(uint8_t square1, uint8_t square2);
+
+// Incremental Maintenance //
+#ifndef PATHFINDER_FULL_REGENERATION
+static Bitboard CalculateAffectedPieces(struct PathfinderContext* context, enum PieceOwner owner);
+#endif
+static void BeginPositionLegalMoves(struct PathfinderContext* context, enum PieceOwner owner);
+static void PrepareTeamMoves(struct PathfinderContext* context);
+static void GeneratePendingMoves(struct PathfinderContext* context, Bitboard pieces);
+static void FinishTeamMoves(struct PathfinderContext* context, uint8_t generated);
+static void SnapshotTeamMoves(struct PathfinderContext* context, enum PieceOwner owner, uint8_t kingSquare, Bitboard pinned, Bitboard checkMask);
+
+// Legal Move Cache //
+#if PATHFINDER_CACHE_SIZE > 0
+static uint8_t LoadCachedMoves(struct PathfinderContext* context, enum PieceOwner owner);
+static void StoreCachedMoves(struct PathfinderContext* context, enum PieceOwner owner);
+#endif
+static void LoadMovesEntry(struct PathfinderContext* context, enum PieceOwner owner, const struct CachedMoves* entry);
+static uint8_t StoreMovesEntry(struct PathfinderContext* context, enum PieceOwner owner, struct CachedMoves* entry);
+static uint64_t CacheKey(struct PathfinderContext* context, enum PieceOwner owner);
+
+// Speculation //
+static uint8_t PopSpeculationCandidate(struct Speculation* speculation);
 
-// State Invariant Pathfinding //
-static void CalculateAllPaths(struct PieceCoordinate pieceCoordinate, uint8_t* numPaths, struct Coordinate* paths);
-static void CalculateAllPathsPawn(struct PieceCoordinate pieceCoordinate, uint8_t* numPaths, struct Coordinate* paths);
-static void CalculateAllPathsRook(struct PieceCoordinate pieceCoordinate, uint8_t* numPaths, struct Coordinate* paths);
-static void CalculateAllPathsBishop(struct PieceCoordinate pieceCoordinate, uint8_t* numPaths, struct Coordinate* paths);
-static void CalculateAllPathsKnight(struct PieceCoordinate pieceCoordinate, uint8_t* numPaths, struct Coordinate* paths);
-static void CalculateAllPathsQueen(struct PieceCoordinate pieceCoordinate, uint8_t* numPaths, struct Coordinate* paths);
-static void CalculateAllPathsKing(struct PieceCoordinate pieceCoordinate, uint8_t* numPaths, struct Coordinate* paths);
+// Utilities //
+static enum PieceOwner EnemyOf(enum PieceOwner owner);
 
-// State Varying Pathfinding //
-static void CalculateAllLegalPathsNoChecks(struct PieceCoordinate from, struct Coordinate* allLegalPaths, uint8_t* numLegalPaths);
-static void CalculateAllLegalPaths(struct PieceCoordinate from, struct Coordinate* allLegalPaths, uint8_t* numLegalPaths, uint8_t calculateCheck);
+// Position //
+static void SetPositionPiece(struct PathfinderContext* context, uint8_t square, Piece piece);
+static uint8_t IsCastlingMove(const struct UndoRecord* undo);
+static void CalculateCastlingRookSquares(uint8_t kingFrom, uint8_t kingTo, uint8_t* rookFrom, uint8_t* rookTo);
+static uint8_t CastleRightsLost(uint8_t square);
 
-// Utilities //
-static void GetPiecesForTeam(enum PieceOwner owner, struct PieceCoordinate* pieces, uint8_t* numPieces);
-static uint8_t IsValidCoordinate(struct Coordinate path);
-static uint8_t IsPieceMovingStraight(struct PieceCoordinate from, struct PieceCoordinate to);
-static uint8_t IsPieceBlockingStraight(struct PieceCoordinate from, struct PieceCoordinate to);
-static uint8_t IsPieceMovingDiagonal(struct PieceCoordinate from, struct PieceCoordinate to);
-static uint8_t IsPieceBlockingDiagonal(struct PieceCoordinate from, struct PieceCoordinate to);
-static uint8_t IsPieceCoordinateSameTeam(struct PieceCoordinate pieceCoordinate1, struct PieceCoordinate pieceCoordinate2);
+void CalculateTeamsLegalMovesContext(struct PathfinderContext* context, const Piece chessboard[NUM_SQUARES], enum PieceOwner owner)
+{
+	LATENCY_BEGIN(CalculateTeamsLegalMoves);
+	LoadPositionContext(context, chessboard);
+	CalculatePositionLegalMovesContext(context, owner);
+	LATENCY_END(CalculateTeamsLegalMoves);
+}
 
-// Allows us to draft moves and their consequences without effecting the real chessboard
-static struct Piece MockChessboard[NUM_ROWS][NUM_COLS];
+void BeginTeamsLegalMovesContext(struct PathfinderContext* context, const Piece chessboard[NUM_SQUARES], enum PieceOwner owner)
+{
+	LoadPositionContext(context, chessboard);
+	BeginPositionLegalMoves(context, owner);
+}
 
-// All legal moves for the current team - calculated at the beginning of each turn
-static struct Moves LegalMoveSet[PIECES_PER_TEAM];
+void CalculatePositionLegalMovesContext(struct PathfinderContext* context, enum PieceOwner owner)
+{
+	BeginPositionLegalMoves(context, owner);
+	FillLegalMovesContext(context, NUM_SQUARES);
+}
 
-void CalculateTeamsLegalMoves(enum PieceOwner owner)
+void GeneratePieceLegalMovesContext(struct PathfinderContext* context, uint8_t square)
 {
-	// Initialize MockChessboard with current chessboard
-	for (uint8_t row = 0; row < NUM_ROWS; row++)
+	if (context->legalMoveSetOwner == NEUTRAL)
 	{
-		for (uint8_t column = 0; column < NUM_COLS; column++)
-		{
-			MockChessboard[row][column] = GetPiece(row, column);
-		}
+		return;
 	}
 
-	// Get all pieces for this team
-	uint8_t numTeamPieces;
-	struct PieceCoordinate teamsPieces[PIECES_PER_TEAM];
-	GetPiecesForTeam(owner, teamsPieces, &numTeamPieces);
-
-	for (uint8_t i = 0; i < numTeamPieces; i++)
+	if (!context->legalMoveSetPrepared)
 	{
-		struct PieceCoordinate teamPiece = teamsPieces[i];
-
-		// Get all legal paths for teamPiece
-		uint8_t numLegalPaths;
-		struct Coordinate allLegalPaths[MAX_LEGAL_MOVES];
-		CalculateAllLegalPathsAndChecks(teamPiece, allLegalPaths, &numLegalPaths);
-
-		// Add possible moves for this piece
-		LegalMoveSet[i].from = teamPiece;
-		LegalMoveSet[i].numMoves = numLegalPaths;
-		for (uint8_t j = 0; j < numLegalPaths; j++)
-		{
-			LegalMoveSet[i].moves[j] = allLegalPaths[j];
-		}
+		PrepareTeamMoves(context);
 	}
+	GeneratePendingMoves(context, SQUARE_BIT(square));
 }
 
-uint8_t IsLegalMove(struct PieceCoordinate from, struct PieceCoordinate to)
+uint8_t FillLegalMovesContext(struct PathfinderContext* context, uint8_t maxPieces)
 {
-	// Find the legal moves for "from"
-	struct Moves legalMoves;
-	for (uint8_t i = 0; i < PIECES_PER_TEAM; i++)
+	if (context->legalMoveSetOwner == NEUTRAL)
 	{
-		if (IsPieceCoordinateEqual(from, LegalMoveSet[i].from))
-		{
-			legalMoves = LegalMoveSet[i];
-			break;
-		}
+		return 0;
 	}
 
-	// Go through all legal moves and make sure "to" is in there
-	for (uint8_t i = 0; i < legalMoves.numMoves; i++)
+	if (!context->legalMoveSetPrepared)
 	{
-		if ((to.row == legalMoves.moves[i].row) && (to.column == legalMoves.moves[i].column))
-		{
-			return 1;
-		}
+		PrepareTeamMoves(context);
 	}
-	return 0;
-}
 
+	struct TeamMoves* teamMoves = &context->teamMoveSets[TEAM_INDEX(context->legalMoveSetOwner)];
+	Bitboard pending = teamMoves->pending;
+	Bitboard pieces = 0;
 
-void CalculateAllLegalPathsAndChecks(struct PieceCoordinate from, struct Coordinate* allLegalPaths, uint8_t* numLegalPaths)
-{
+	for (uint8_t i = 0; i < maxPieces && pending; i++)
+	{
+		pieces |= SQUARE_BIT(PopLowestSquare(&pending));
+	}
+	GeneratePendingMoves(context, pieces);
 
-	CalculateAllLegalPaths(from, allLegalPaths, numLegalPaths, 1);
+	return PopCount(teamMoves->pending);
 }
 
 /**
- * @brief Calculates all legal paths but without regard for putting their own king in check. Used by WillResultInSelfCheck for each enemy piece.
+ * @brief Makes owner the current team, leaving the work of bringing its moves up to date for when they are first needed
  */
-static void CalculateAllLegalPathsNoChecks(struct PieceCoordinate from, struct Coordinate* allLegalPaths, uint8_t* numLegalPaths)
+static void BeginPositionLegalMoves(struct PathfinderContext* context, enum PieceOwner owner)
 {
-	CalculateAllLegalPaths(from, allLegalPaths, numLegalPaths, 0);
+	context->legalMoveSet = context->teamMoveSets[TEAM_INDEX(owner)].moves;
+	context->legalMoveSetOwner = owner;
+	context->legalMoveSetPrepared = 0;
 }
 
 /**
- * @brief Calculates all legal paths with trimming off moves that would put their king in check controlled by calculateCheck
+ * @brief Brings the current team's TeamMoves up to date with the context's position, except for the moves of the pieces
+ * that need regenerating, which are left pending
  */
-static void CalculateAllLegalPaths(struct PieceCoordinate from, struct Coordinate* allLegalPaths, uint8_t* numLegalPaths, uint8_t calculateCheck)
+static void PrepareTeamMoves(struct PathfinderContext* context)
 {
-	*numLegalPaths = 0;
+	enum PieceOwner owner = context->legalMoveSetOwner;
+	struct TeamMoves* teamMoves = &context->teamMoveSets[TEAM_INDEX(owner)];
 
-	// Get all paths
-	uint8_t numPaths;
-	struct Coordinate allPaths[MAX_LEGAL_MOVES] = { 0 };
-	CalculateAllPaths(from, &numPaths, allPaths);
+	context->legalMoveSetPrepared = 1;
 
-	// Populate legal paths from all paths
-	for (uint8_t i = 0; i < numPaths; i++)
+#if PATHFINDER_CACHE_SIZE > 0
+	// Revisited positions skip generation entirely
+	if (LoadCachedMoves(context, owner))
 	{
-		struct Coordinate path = allPaths[i];
-		struct PieceCoordinate to = { MockChessboard[path.row][path.column], path.row, path.column };
+		FinishTeamMoves(context, 0);
+		return;
+	}
+#endif
 
-		if (IsPieceCoordinateSameTeam(from, to))
-		{
-			continue;
-		}
-		else if (IsPieceMovingStraight(from, to) && IsPieceBlockingStraight(from, to))
-		{
-			continue;
-		}
-		else if (IsPieceMovingDiagonal(from, to))
+	CalculateLegality(context, owner);
+
+	// Only regenerate the pieces whose moves could have changed since this team's last turn, along with any it never got to
+	Bitboard teamPieces = context->position.owners[owner];
+#ifdef PATHFINDER_FULL_REGENERATION
+	Bitboard affected = teamPieces;
+#else
+	Bitboard affected = teamMoves->valid ? (CalculateAffectedPieces(context, owner) | teamMoves->pending) & teamPieces : teamPieces;
+#endif
+
+	// Forget the moves of pieces that have left their square (moved or been killed)
+	if (teamMoves->valid)
+	{
+		Bitboard vacated = teamMoves->owners[owner] & ~teamPieces;
+		while (vacated)
 		{
-			// For pawn to move in diagonal line, it must have an enemy piece on the diagonal
-			if ((from.piece.type == PAWN) && (to.piece.owner == NEUTRAL))
-			{
-				continue;
-			}
-			else if (IsPieceBlockingDiagonal(from, to))
-			{
-				continue;
-			}
-			else if (calculateCheck && WillResultInSelfCheck(from, to))
-			{
-				continue;
-			}
+			teamMoves->moves[PopLowestSquare(&vacated)] = 0;
 		}
-		else if (calculateCheck && WillResultInSelfCheck(from, to))
+	}
+	else
+	{
+		for (uint8_t square = 0; square < NUM_SQUARES; square++)
 		{
-			continue;
+			teamMoves->moves[square] = 0;
 		}
-		allLegalPaths[(*numLegalPaths)++] = path;
+	}
+
+	teamMoves->pending = affected;
+	SnapshotTeamMoves(context, owner, context->legality.kingSquare, context->legality.pinned, context->legality.checkMask);
+
+	if (!affected)
+	{
+		FinishTeamMoves(context, 1);
 	}
 }
 
-static void CalculateAllPaths(struct PieceCoordinate pieceCoordinate, uint8_t* numPaths, struct Coordinate* paths)
+/**
+ * @brief Generates the moves of the given pieces of the current team that are still pending
+ */
+static void GeneratePendingMoves(struct PathfinderContext* context, Bitboard pieces)
 {
-	*numPaths = 0;
+	struct TeamMoves* teamMoves = &context->teamMoveSets[TEAM_INDEX(context->legalMoveSetOwner)];
 
-	switch (pieceCoordinate.piece.type)
+	pieces &= teamMoves->pending;
+	if (!pieces)
 	{
-	case PAWN:
-		CalculateAllPathsPawn(pieceCoordinate, numPaths, paths);
-		break;
-	case ROOK:
-		CalculateAllPathsRook(pieceCoordinate, numPaths, paths);
-		break;
-	case BISHOP:
-		CalculateAllPathsBishop(pieceCoordinate, numPaths, paths);
-		break;
-	case KNIGHT:
-		CalculateAllPathsKnight(pieceCoordinate, numPaths, paths);
-		break;
-	case QUEEN:
-		CalculateAllPathsQueen(pieceCoordinate, numPaths, paths);
-		break;
-	case KING:
-		CalculateAllPathsKing(pieceCoordinate, numPaths, paths);
-		break;
+		return;
+	}
+
+	teamMoves->pending &= ~pieces;
+	while (pieces)
+	{
+		uint8_t square = PopLowestSquare(&pieces);
+		teamMoves->moves[square] = CalculateAllLegalPaths(context, PIECE_COORDINATE(context->position.board[square], square));
+	}
+
+	if (!teamMoves->pending)
+	{
+		FinishTeamMoves(context, 1);
+	}
+}
+
+/**
+ * @brief Called once none of the current team's pieces are pending. Remembers freshly generated moves in the cache.
+ */
+static void FinishTeamMoves(struct PathfinderContext* context, uint8_t generated)
+{
+#if PATHFINDER_CACHE_SIZE > 0
+	if (generated)
+	{
+		StoreCachedMoves(context, context->legalMoveSetOwner);
+	}
+#endif
+
+#ifdef PATHFINDER_CROSSCHECK
+	// Debug cross-check: the incremental or cached result must match a full regeneration
+	enum PieceOwner owner = context->legalMoveSetOwner;
+	const struct TeamMoves* teamMoves = &context->teamMoveSets[TEAM_INDEX(owner)];
+	Bitboard teamPieces = context->position.owners[owner];
+	for (uint8_t square = 0; square < NUM_SQUARES; square++)
+	{
+		Bitboard expected = (teamPieces & SQUARE_BIT(square)) ? CalculateAllLegalPaths(context, PIECE_COORDINATE(context->position.board[square], square)) : 0;
+		assert(teamMoves->moves[square] == expected);
 	}
+#endif
 }
 
-static void CalculateAllPathsPawn(struct PieceCoordinate pieceCoordinate, uint8_t* numPaths, struct Coordinate* paths)
+Bitboard GetAttackersContext(struct PathfinderContext* context, uint8_t square)
 {
-	uint8_t row = pieceCoordinate.piece.owner == WHITE ? pieceCoordinate.row + 1 : pieceCoordinate.row - 1;
-	uint8_t column = pieceCoordinate.column;
+	enum PieceOwner owner = context->legalMoveSetOwner;
+	if (owner == NEUTRAL)
+	{
+		return 0;
+	}
 
-	for (int8_t i = -1; i <= 1; i++)
+	if (!context->legalMoveSetPrepared)
 	{
+		PrepareTeamMoves(context);
+	}
 
-		struct Coordinate path = { row, column + i };
-		if (IsValidCoordinate(path))
+	// Only the pieces that attack the square at all can have it among their legal moves, so look backwards from it
+	Bitboard candidates = CalculateAttackers(context, square, owner, ~context->position.owners[NEUTRAL]);
+	Bitboard attackers = 0;
+
+	GeneratePendingMoves(context, candidates);
+	while (candidates)
+	{
+		uint8_t from = PopLowestSquare(&candidates);
+		if (context->legalMoveSet[from] & SQUARE_BIT(square))
 		{
-			paths[(*numPaths)++] = path;
+			attackers |= SQUARE_BIT(from);
 		}
 	}
+	return attackers;
+}
+
+uint8_t IsSquareAttackedByContext(struct PathfinderContext* context, uint8_t square, enum PieceOwner owner)
+{
+	return IsSquareAttacked(context, square, owner, ~context->position.owners[NEUTRAL]);
+}
 
-	if (pieceCoordinate.piece.owner == WHITE && pieceCoordinate.row == 1)
+uint8_t InferMoveFromOccupancyContext(struct PathfinderContext* context, Bitboard occupied, Bitboard landed, uint8_t* from, uint8_t* to)
+{
+	enum PieceOwner owner = context->legalMoveSetOwner;
+	if (owner == NEUTRAL)
+	{
+		return 0;
+	}
+
+	if (!context->legalMoveSetPrepared)
 	{
-		struct Coordinate path = { row + 1, column };
-		paths[(*numPaths)++] = path;
+		PrepareTeamMoves(context);
 	}
-	else if (pieceCoordinate.piece.owner == BLACK && pieceCoordinate.row == 6)
+
+	Bitboard before = ~context->position.owners[NEUTRAL];
+	Bitboard vacated = before & ~occupied;
+	Bitboard filled = occupied & ~before;
+
+	// A move empties the square of the piece moving and nothing else
+	if (PopCount(vacated) != 1 || !(vacated & context->position.owners[owner]) || PopCount(filled) > 1)
 	{
-		struct Coordinate path = { row - 1, column };
-		paths[(*numPaths)++] = path;
+		return 0;
 	}
+
+	// The square emptied indexes its piece's legal moves directly. A quiet move lands on the square filled, a capture
+	// fills nothing and lands on an occupied square.
+	uint8_t square = LowestSquare(vacated);
+	GeneratePendingMoves(context, vacated);
+	Bitboard destinations = context->legalMoveSet[square] & landed & (filled ? filled : before);
+	if (destinations)
+	{
+		*from = square;
+		*to = LowestSquare(destinations);
+	}
+	return PopCount(destinations);
+}
+
+void InitSpeculation(struct Speculation* speculation)
+{
+	InitPathfinderContext(&speculation->search);
+	speculation->owner = NEUTRAL;
+	speculation->candidates = 0;
+	speculation->captures = 0;
+	speculation->numSlots = 0;
+	speculation->stats.hits = 0;
+	speculation->stats.misses = 0;
+	speculation->stats.positions = 0;
 }
 
-static void CalculateAllPathsRook(struct PieceCoordinate pieceCoordinate, uint8_t* numPaths, struct Coordinate* paths)
+void BeginSpeculationContext(struct Speculation* speculation, struct PathfinderContext* live, uint8_t from)
 {
-	uint8_t row = pieceCoordinate.row;
-	uint8_t column = pieceCoordinate.column;
+	Piece piece = live->position.board[from];
+
+	speculation->owner = NEUTRAL;
+	speculation->candidates = 0;
+	speculation->captures = 0;
+	speculation->numSlots = 0;
+
+	if (piece == EMPTY_PIECE || PIECE_OWNER(piece) != live->legalMoveSetOwner)
+	{
+		return;
+	}
+
+	// The search starts from the live position, which only costs the squares that changed since the last speculation
+	GeneratePieceLegalMovesContext(live, from);
+	LoadPositionContext(&speculation->search, live->position.board);
+	speculation->search.position.castleRights = live->position.castleRights;
 
-	for (uint8_t move = 0; move < 8; move++)
+	speculation->from = from;
+	speculation->owner = EnemyOf(PIECE_OWNER(piece));
+	speculation->candidates = live->legalMoveSet[from];
+	speculation->captures = speculation->candidates & live->position.owners[speculation->owner];
+}
+
+uint8_t SpeculateContext(struct Speculation* speculation, uint8_t maxPositions)
+{
+	for (uint8_t i = 0; i < maxPositions && speculation->candidates && speculation->numSlots < PATHFINDER_SPECULATION_SLOTS; i++)
 	{
-		if (move != row)
+		// Play the move, generate the reply moves and take the move back, leaving the search ready for the next one
+		uint8_t to = PopSpeculationCandidate(speculation);
+		if (!MakeMoveContext(&speculation->search, speculation->from, to, QUEEN))
 		{
-			struct Coordinate path = { move, column };
-			paths[(*numPaths)++] = path;
+			break;
 		}
+		CalculatePositionLegalMovesContext(&speculation->search, speculation->owner);
+		speculation->numSlots += StoreMovesEntry(&speculation->search, speculation->owner, &speculation->slots[speculation->numSlots]);
+		speculation->stats.positions++;
+		UnmakeMoveContext(&speculation->search);
+	}
 
-		if (move != column)
+	return speculation->numSlots < PATHFINDER_SPECULATION_SLOTS ? PopCount(speculation->candidates) : 0;
+}
+
+uint8_t AdoptSpeculationContext(struct PathfinderContext* context, struct Speculation* speculation, const Piece chessboard[NUM_SQUARES], enum PieceOwner owner)
+{
+	uint8_t numSlots = speculation->owner == owner ? speculation->numSlots : 0;
+
+	LoadPositionContext(context, chessboard);
+	speculation->owner = NEUTRAL;
+	speculation->candidates = 0;
+	speculation->captures = 0;
+	speculation->numSlots = 0;
+
+	uint64_t key = CacheKey(context, owner);
+	for (uint8_t slot = 0; slot < numSlots; slot++)
+	{
+		if (speculation->slots[slot].key == key)
 		{
-			struct Coordinate path = { row, move };
-			paths[(*numPaths)++] = path;
+			speculation->stats.hits++;
+			BeginPositionLegalMoves(context, owner);
+			LoadMovesEntry(context, owner, &speculation->slots[slot]);
+			context->legalMoveSetPrepared = 1;
+			FinishTeamMoves(context, 0);
+			return 1;
 		}
 	}
+
+	speculation->stats.misses++;
+	return 0;
 }
 
-static void CalculateAllPathsBishop(struct PieceCoordinate pieceCoordinate, uint8_t* numPaths, struct Coordinate* paths)
+uint8_t IsLegalMoveContext(struct PathfinderContext* context, PieceCoordinate from, PieceCoordinate to)
 {
-	uint8_t row = pieceCoordinate.row;
-	uint8_t column = pieceCoordinate.column;
+	LATENCY_BEGIN(IsLegalMove);
+	uint8_t isLegal = 0;
 
-	for (uint8_t move = 1; move < 8; move++)
+	// Only the current team has legal moves, and only for the pieces they were calculated for
+	uint8_t square = COORDINATE_SQUARE(from);
+	Piece piece = COORDINATE_PIECE(from);
+	if (PIECE_OWNER(piece) == context->legalMoveSetOwner && context->position.board[square] == piece)
 	{
-		if (row + move < 8)
-		{
-			if (column + move < 8)
-			{
-				struct Coordinate path = { row + move, column + move };
-				paths[(*numPaths)++] = path;
-			}
-			if (column >= move)
-			{
-				struct Coordinate path = { row + move, column - move };
-				paths[(*numPaths)++] = path;
-			}
+		GeneratePieceLegalMovesContext(context, square);
+		isLegal = (context->legalMoveSet[square] >> COORDINATE_SQUARE(to)) & 1;
+	}
 
-		}
+	LATENCY_END(IsLegalMove);
+	return isLegal;
+}
+
+
+void CalculateAllLegalPathsAndChecksContext(struct PathfinderContext* context, PieceCoordinate from, uint8_t* allLegalPaths, uint8_t* numLegalPaths)
+{
+	*numLegalPaths = 0;
+
+	// Populate legal paths from the legal destination squares
+	Bitboard paths = CalculateAllLegalPaths(context, from);
+	while (paths)
+	{
+		allLegalPaths[(*numLegalPaths)++] = PopLowestSquare(&paths);
+	}
+}
+
+void InitPathfinderContext(struct PathfinderContext* context)
+{
+	// Start from an empty board, which LoadPositionContext then only has to fill in
+	for (uint8_t square = 0; square < NUM_SQUARES; square++)
+	{
+		context->position.board[square] = EMPTY_PIECE;
+	}
+	for (uint8_t owner = 0; owner < NUM_PIECE_OWNERS; owner++)
+	{
+		context->position.owners[owner] = 0;
+	}
+	for (uint8_t type = 0; type < NUM_PIECE_TYPES; type++)
+	{
+		context->position.types[type] = 0;
+	}
+	context->position.owners[NEUTRAL] = ~(Bitboard)0;
+	context->position.types[NONE] = ~(Bitboard)0;
+	context->position.castleRights = CASTLE_ALL;
+	context->position.key = 0;
+	context->undoDepth = 0;
+
+#if PATHFINDER_CACHE_SIZE > 0
+	for (uint32_t i = 0; i < PATHFINDER_CACHE_SIZE; i++)
+	{
+		context->cache[i].key = 0;
+	}
+#endif
+	context->cacheStats.hits = 0;
+	context->cacheStats.misses = 0;
+	context->cacheStats.evictions = 0;
 
-		if (row >= move)
+	context->legality.owner = NEUTRAL;
+	for (uint8_t team = 0; team < NUM_TEAMS; team++)
+	{
+		context->teamMoveSets[team].valid = 0;
+		context->teamMoveSets[team].pending = 0;
+	}
+	context->legalMoveSet = 0;
+	context->legalMoveSetOwner = NEUTRAL;
+	context->legalMoveSetPrepared = 0;
+}
+
+// Default Context //
+void CalculateTeamsLegalMoves(enum PieceOwner owner)
+{
+	struct TrackerContext* tracker = GetTrackerContext();
+	CalculateTeamsLegalMovesContext(&tracker->pathfinder, tracker->chessboard, owner);
+}
+
+uint8_t IsLegalMove(PieceCoordinate from, PieceCoordinate to)
+{
+	return IsLegalMoveContext(&GetTrackerContext()->pathfinder, from, to);
+}
+
+void CalculateAllLegalPathsAndChecks(PieceCoordinate from, uint8_t* allLegalPaths, uint8_t* numLegalPaths)
+{
+	CalculateAllLegalPathsAndChecksContext(&GetTrackerContext()->pathfinder, from, allLegalPaths, numLegalPaths);
+}
+
+uint8_t WillResultInSelfCheck(PieceCoordinate from, PieceCoordinate to)
+{
+	return WillResultInSelfCheckContext(&GetTrackerContext()->pathfinder, from, to);
+}
+
+Bitboard GetAttackers(uint8_t square)
+{
+	return GetAttackersContext(&GetTrackerContext()->pathfinder, square);
+}
+
+uint8_t IsSquareAttackedBy(uint8_t square, enum PieceOwner owner)
+{
+	return IsSquareAttackedByContext(&GetTrackerContext()->pathfinder, square, owner);
+}
+
+uint8_t InferMoveFromOccupancy(Bitboard occupied, Bitboard landed, uint8_t* from, uint8_t* to)
+{
+	return InferMoveFromOccupancyContext(&GetTrackerContext()->pathfinder, occupied, landed, from, to);
+}
+
+uint8_t MakeMove(uint8_t from, uint8_t to, enum PieceType promotion)
+{
+	return MakeMoveContext(&GetTrackerContext()->pathfinder, from, to, promotion);
+}
+
+uint8_t UnmakeMove(void)
+{
+	return UnmakeMoveContext(&GetTrackerContext()->pathfinder);
+}
+
+struct LegalMoveCacheStats GetLegalMoveCacheStats(void)
+{
+	return GetTrackerContext()->pathfinder.cacheStats;
+}
+
+/**
+ * @brief Returns the destination squares of "from" that don't land on its own team or leave its king in check
+ */
+static Bitboard CalculateAllLegalPaths(struct PathfinderContext* context, PieceCoordinate from)
+{
+	uint8_t square = COORDINATE_SQUARE(from);
+	enum PieceOwner owner = PIECE_OWNER(COORDINATE_PIECE(from));
+
+	if (context->legality.owner != owner)
+	{
+		CalculateLegality(context, owner);
+	}
+
+	Bitboard paths = CalculateAllPaths(context, from) & ~context->position.owners[owner];
+
+	// The king may go anywhere the enemy doesn't attack, seen through the king so it cannot step back along a ray
+	if (PIECE_TYPE(COORDINATE_PIECE(from)) == KING)
+	{
+		Bitboard occupied = ~context->position.owners[NEUTRAL] & ~SQUARE_BIT(square);
+		Bitboard safe = 0;
+		while (paths)
 		{
-			if (column + move < 8)
-			{
-				struct Coordinate path = { row - move, column + move };
-				paths[(*numPaths)++] = path;
-			}
-			if (column >= move)
+			uint8_t to = PopLowestSquare(&paths);
+			if (!IsSquareAttacked(context, to, EnemyOf(owner), occupied))
 			{
-				struct Coordinate path = { row - move, column - move };
-				paths[(*numPaths)++] = path;
+				safe |= SQUARE_BIT(to);
 			}
 		}
+		return safe;
 	}
+
+	// Everything else must resolve a check, and a pinned piece must stay on its pin line
+	paths &= context->legality.checkMask;
+	if (context->legality.pinned & SQUARE_BIT(square))
+	{
+		paths &= LineThrough(context->legality.kingSquare, square);
+	}
+	return paths;
 }
 
-static void CalculateAllPathsKnight(struct PieceCoordinate pieceCoordinate, uint8_t* numPaths, struct Coordinate* paths)
+static Bitboard CalculateAllPaths(struct PathfinderContext* context, PieceCoordinate pieceCoordinate)
 {
-	uint8_t row = pieceCoordinate.row;
-	uint8_t column = pieceCoordinate.column;
-
-	const struct Coordinate adders[] = {
-		{1, 2}, {-1, 2}, {1, -2}, {-1, -2},
-		{2, 1}, {-2, 1}, {2, -1}, {-2, -1}
-	};
+	switch (PIECE_TYPE(COORDINATE_PIECE(pieceCoordinate)))
+	{
+	case PAWN:
+		return CalculateAllPathsPawn(context, pieceCoordinate);
+	case ROOK:
+		return CalculateAllPathsRook(context, pieceCoordinate);
+	case BISHOP:
+		return CalculateAllPathsBishop(context, pieceCoordinate);
+	case KNIGHT:
+		return CalculateAllPathsKnight(context, pieceCoordinate);
+	case QUEEN:
+		return CalculateAllPathsQueen(context, pieceCoordinate);
+	case KING:
+		return CalculateAllPathsKing(context, pieceCoordinate);
+	default:
+		return 0;
+	}
+}
 
-	for (uint8_t move = 0; move < sizeof(adders) / sizeof(*adders); move++)
+static Bitboard CalculateAllPathsPawn(struct PathfinderContext* context, PieceCoordinate pieceCoordinate)
+{
+	uint8_t square = COORDINATE_SQUARE(pieceCoordinate);
+	enum PieceOwner owner = PIECE_OWNER(COORDINATE_PIECE(pieceCoordinate));
+	uint8_t startRow = owner == WHITE ? 1 : 6;
+	Bitboard empty = context->position.owners[NEUTRAL];
+
+	// Pawns can only move forward onto an empty square, and two squares from their starting row if both are empty
+	Bitboard paths = PawnPushes(owner, square) & empty;
+	if (paths && SQUARE_ROW(square) == startRow)
 	{
-		int8_t newRow = row + adders[move].row;
-		int8_t newColumn = column + adders[move].column;
-		struct Coordinate path = { newRow, newColumn };
-		if (IsValidCoordinate(path))
-		{
-			paths[(*numPaths)++] = path;
-		}
+		paths |= PawnPushes(owner, LowestSquare(paths)) & empty;
 	}
+
+	// For pawn to move in diagonal line, it must have an enemy piece on the diagonal
+	paths |= PawnAttacksFrom(owner, square) & context->position.owners[EnemyOf(owner)];
+
+	return paths;
+}
+
+static Bitboard CalculateAllPathsRook(struct PathfinderContext* context, PieceCoordinate pieceCoordinate)
+{
+	return RookAttacks(COORDINATE_SQUARE(pieceCoordinate), ~context->position.owners[NEUTRAL]);
+}
+
+static Bitboard CalculateAllPathsBishop(struct PathfinderContext* context, PieceCoordinate pieceCoordinate)
+{
+	return BishopAttacks(COORDINATE_SQUARE(pieceCoordinate), ~context->position.owners[NEUTRAL]);
+}
+
+static Bitboard CalculateAllPathsKnight(struct PathfinderContext* context, PieceCoordinate pieceCoordinate)
+{
+	return KnightAttacks(COORDINATE_SQUARE(pieceCoordinate));
 }
 
-static void CalculateAllPathsQueen(struct PieceCoordinate pieceCoordinate, uint8_t* numPaths, struct Coordinate* paths)
+static Bitboard CalculateAllPathsQueen(struct PathfinderContext* context, PieceCoordinate pieceCoordinate)
 {
-	uint8_t numRookPaths = 0;
-	struct Coordinate rookPaths[MAX_ROOK_MOVES] = { 0 };
-	CalculateAllPathsRook(pieceCoordinate, &numRookPaths, rookPaths);
+	return CalculateAllPathsRook(context, pieceCoordinate) | CalculateAllPathsBishop(context, pieceCoordinate);
+}
 
-	uint8_t numBishopPaths = 0;
-	struct Coordinate bishopPaths[MAX_BISHOP_MOVES] = { 0 };
-	CalculateAllPathsBishop(pieceCoordinate, &numBishopPaths, bishopPaths);
+static Bitboard CalculateAllPathsKing(struct PathfinderContext* context, PieceCoordinate pieceCoordinate)
+{
+	return KingAttacks(COORDINATE_SQUARE(pieceCoordinate));
+}
 
-	*numPaths = numRookPaths + numBishopPaths;
+/**
+ * @brief Returns the owner's pieces attacking square, with sliders blocked by occupied. Looks outwards from the square
+ * as each piece type, so the cost doesn't depend on the size of the owner's army.
+ */
+static Bitboard CalculateAttackers(struct PathfinderContext* context, uint8_t square, enum PieceOwner owner, Bitboard occupied)
+{
+	Bitboard team = context->position.owners[owner];
+	Bitboard straightSliders = context->position.types[ROOK] | context->position.types[QUEEN];
+	Bitboard diagonalSliders = context->position.types[BISHOP] | context->position.types[QUEEN];
+
+	return team & ((PawnAttacksFrom(EnemyOf(owner), square) & context->position.types[PAWN])
+		| (KnightAttacks(square) & context->position.types[KNIGHT])
+		| (KingAttacks(square) & context->position.types[KING])
+		| (RookAttacks(square, occupied) & straightSliders)
+		| (BishopAttacks(square, occupied) & diagonalSliders));
+}
 
-	// Add in Rook paths
-	for (uint8_t i = 0; i < numRookPaths; i++)
+/**
+ * @brief Returns 1 if any of the owner's pieces attacks square, with sliders blocked by occupied. Like
+ * CalculateAttackers it looks outwards from the square, but stops at the first attacker: the leapers are a table load
+ * each, and a ray is only walked if the owner still has a slider that moves along it.
+ */
+static uint8_t IsSquareAttacked(struct PathfinderContext* context, uint8_t square, enum PieceOwner owner, Bitboard occupied)
+{
+	Bitboard team = context->position.owners[owner];
+
+	if ((PawnAttacksFrom(EnemyOf(owner), square) & team & context->position.types[PAWN])
+		|| (KnightAttacks(square) & team & context->position.types[KNIGHT])
+		|| (KingAttacks(square) & team & context->position.types[KING]))
 	{
-		paths[i] = rookPaths[i];
+		return 1;
 	}
 
-	// Append Bishop paths
-	for (uint8_t i = 0; i < numBishopPaths; i++)
+	Bitboard straightSliders = team & (context->position.types[ROOK] | context->position.types[QUEEN]);
+	if (straightSliders && (RookAttacks(square, occupied) & straightSliders))
 	{
-		paths[i + numRookPaths] = bishopPaths[i];
+		return 1;
 	}
+
+	Bitboard diagonalSliders = team & (context->position.types[BISHOP] | context->position.types[QUEEN]);
+	return diagonalSliders && (BishopAttacks(square, occupied) & diagonalSliders);
 }
 
-static void CalculateAllPathsKing(struct PieceCoordinate pieceCoordinate, uint8_t* numPaths, struct Coordinate* paths)
+/**
+ * @brief Calculates the checkers, pins and check evasion mask for owner's king on the context's position
+ */
+static void CalculateLegality(struct PathfinderContext* context, enum PieceOwner owner)
 {
-	uint8_t row = pieceCoordinate.row;
-	uint8_t column = pieceCoordinate.column;
+	enum PieceOwner enemyTeam = EnemyOf(owner);
+	Bitboard occupied = ~context->position.owners[NEUTRAL];
+	Bitboard enemies = context->position.owners[enemyTeam];
+	Bitboard king = context->position.owners[owner] & context->position.types[KING];
+
+	context->legality.owner = owner;
+	context->legality.checkers = 0;
+	context->legality.pinned = 0;
+	context->legality.checkMask = ~(Bitboard)0;
+
+	// Without a king there is nothing to keep out of check
+	if (!king)
+	{
+		return;
+	}
+
+	uint8_t kingSquare = LowestSquare(king);
+	Bitboard straightSliders = enemies & (context->position.types[ROOK] | context->position.types[QUEEN]);
+	Bitboard diagonalSliders = enemies & (context->position.types[BISHOP] | context->position.types[QUEEN]);
+	context->legality.kingSquare = kingSquare;
 
-	for (int8_t i = -1; i <= 1; i++)
+	context->legality.checkers = CalculateAttackers(context, kingSquare, enemyTeam, occupied);
+
+	// Sliders that would attack the king if our pieces were transparent pin the single piece between them and the king
+	Bitboard pinners = (RookAttacks(kingSquare, enemies) & straightSliders) | (BishopAttacks(kingSquare, enemies) & diagonalSliders);
+	while (pinners)
 	{
-		for (int8_t j = -1; j <= 1; j++)
+		Bitboard between = BetweenMask(kingSquare, PopLowestSquare(&pinners)) & occupied;
+		if (PopCount(between) == 1)
 		{
-			if (i == 0 && j == 0)
-			{
-				continue;
-			}
-
-			struct Coordinate path = { row + i, column + j };
-			if (IsValidCoordinate(path))
-			{
-				paths[(*numPaths)++] = path;
-			}
+			context->legality.pinned |= between & context->position.owners[owner];
 		}
 	}
+
+	// One checker must be captured or blocked, two checkers leave only king moves
+	if (PopCount(context->legality.checkers) == 1)
+	{
+		context->legality.checkMask = context->legality.checkers | BetweenMask(kingSquare, LowestSquare(context->legality.checkers));
+	}
+	else if (context->legality.checkers)
+	{
+		context->legality.checkMask = 0;
+	}
 }
 
-static uint8_t IsPieceBlockingStraight(struct PieceCoordinate from, struct PieceCoordinate to)
+#ifndef PATHFINDER_FULL_REGENERATION
+/**
+ * @brief Returns the owner's pieces whose legal moves may differ from the ones in its TeamMoves. A piece is affected if
+ * a square changed on one of its rays (before or after the change), within its knight/pawn reach, or if the pins and
+ * check evasion squares around its king changed. The king itself is always regenerated since any move can change the
+ * squares the enemy attacks.
+ */
+static Bitboard CalculateAffectedPieces(struct PathfinderContext* context, enum PieceOwner owner)
 {
-	// If move is in same column
-	if (from.column == to.column)
+	struct TeamMoves* teamMoves = &context->teamMoveSets[TEAM_INDEX(owner)];
+	Bitboard team = context->position.owners[owner];
+	Bitboard changed = 0;
+
+	for (uint8_t i = 0; i < NUM_PIECE_OWNERS; i++)
 	{
-		uint8_t startRow = from.row > to.row ? to.row : from.row;
-		uint8_t endRow = from.row > to.row ? from.row : to.row;
+		changed |= teamMoves->owners[i] ^ context->position.owners[i];
+	}
+	for (uint8_t i = 0; i < NUM_PIECE_TYPES; i++)
+	{
+		changed |= teamMoves->types[i] ^ context->position.types[i];
+	}
 
-		for (uint8_t row = startRow + 1; row < endRow; row++)
-		{
-			if (MockChessboard[row][from.column].type != NONE) // If piece in row between "from" and "to" then it is blocking it.
-			{
-				return 1;
-			}
-		}
+	if (!changed)
+	{
+		return 0;
 	}
-	// If move is in same row
-	else if (from.row == to.row)
+
+	// A new king square or check changes what every piece may do
+	if (teamMoves->kingSquare != context->legality.kingSquare || teamMoves->checkMask != context->legality.checkMask)
 	{
-		uint8_t startColumn = from.column > to.column ? to.column : from.column;
-		uint8_t endColumn = from.column > to.column ? from.column : to.column;
-		for (uint8_t column = startColumn + 1; column < endColumn; column++)
-		{
-			// If piece in column between "from" and "to" then it is blocking it.
-			if (MockChessboard[from.row][column].type != NONE)
-			{
-				return 1;
-			}
-		}
+		return team;
 	}
-	return 0;
+
+	Bitboard affected = (changed | context->position.types[KING] | teamMoves->pinned | context->legality.pinned) & team;
+	Bitboard occupied = ~context->position.owners[NEUTRAL];
+	Bitboard oldOccupied = ~teamMoves->owners[NEUTRAL];
+	Bitboard straightSliders = team & (context->position.types[ROOK] | context->position.types[QUEEN]);
+	Bitboard diagonalSliders = team & (context->position.types[BISHOP] | context->position.types[QUEEN]);
+	Bitboard knights = team & context->position.types[KNIGHT];
+	Bitboard pawns = team & context->position.types[PAWN];
+
+	while (changed)
+	{
+		uint8_t square = PopLowestSquare(&changed);
+		Bitboard squareBit = SQUARE_BIT(square);
+
+		// Sliders see the square if it is on their ray, either before or after the change
+		affected |= (RookAttacks(square, occupied) | RookAttacks(square, oldOccupied)) & straightSliders;
+		affected |= (BishopAttacks(square, occupied) | BishopAttacks(square, oldOccupied)) & diagonalSliders;
+		affected |= KnightAttacks(square) & knights;
+
+		// Pawns that could capture onto the square, or push onto or through it
+		affected |= PawnAttacksFrom(EnemyOf(owner), square) & pawns;
+		affected |= (owner == WHITE ? (squareBit >> 8) | (squareBit >> 16) : (squareBit << 8) | (squareBit << 16)) & pawns;
+	}
+
+	return affected;
 }
+#endif
 
-uint8_t WillResultInSelfCheck(struct PieceCoordinate from, struct PieceCoordinate to)
+/**
+ * @brief Records the position and legality the owner's moves were just generated on
+ */
+static void SnapshotTeamMoves(struct PathfinderContext* context, enum PieceOwner owner, uint8_t kingSquare, Bitboard pinned, Bitboard checkMask)
 {
-	// Temporarily populate the chessboard with this move to see if it causes a self check
-	MockChessboard[from.row][from.column] = EMPTY_PIECE;
-	MockChessboard[to.row][to.column] = from.piece;
+	struct TeamMoves* teamMoves = &context->teamMoveSets[TEAM_INDEX(owner)];
 
-	enum PieceOwner enemyTeam = from.piece.owner == WHITE ? BLACK : WHITE;
-	uint8_t numEnemyPieces;
-	struct PieceCoordinate enemyPieces[PIECES_PER_TEAM] = { 0 };
+	for (uint8_t i = 0; i < NUM_PIECE_OWNERS; i++)
+	{
+		teamMoves->owners[i] = context->position.owners[i];
+	}
+	for (uint8_t i = 0; i < NUM_PIECE_TYPES; i++)
+	{
+		teamMoves->types[i] = context->position.types[i];
+	}
+	teamMoves->kingSquare = kingSquare;
+	teamMoves->pinned = pinned;
+	teamMoves->checkMask = checkMask;
+	teamMoves->valid = 1;
+}
 
-	// For each enemy piece
-	GetPiecesForTeam(enemyTeam, enemyPieces, &numEnemyPieces);
-	for (uint8_t i = 0; i < numEnemyPieces; i++)
+#if PATHFINDER_CACHE_SIZE > 0
+/**
+ * @brief Fills the owner's TeamMoves from the cache if this position was seen with the owner to move. Returns 1 on a
+ * hit, 0 on a miss.
+ */
+static uint8_t LoadCachedMoves(struct PathfinderContext* context, enum PieceOwner owner)
+{
+	uint64_t key = CacheKey(context, owner);
+	const struct CachedMoves* entry = &context->cache[key & (PATHFINDER_CACHE_SIZE - 1)];
+
+	if (entry->key != key)
 	{
-		uint8_t numEnemyPieceLegalPaths;
-		struct Coordinate enemyPieceLegalPaths[MAX_LEGAL_MOVES] = { 0 };
+		context->cacheStats.misses++;
+		return 0;
+	}
+	context->cacheStats.hits++;
 
-		// For each legal path this enemy piece can take
-		CalculateAllLegalPathsNoChecks(enemyPieces[i], enemyPieceLegalPaths, &numEnemyPieceLegalPaths);
-		for (uint8_t j = 0; j < numEnemyPieceLegalPaths; j++)
-		{
-			struct Coordinate enemyFinalLocation = enemyPieceLegalPaths[j];
-			struct Piece killedPiece = MockChessboard[enemyFinalLocation.row][enemyFinalLocation.column];
+	LoadMovesEntry(context, owner, entry);
+	return 1;
+}
 
-			// If the enemy piece can take our king, this move (from -> to) will result in a check so it cannot be legal
-			if ((killedPiece.type == KING) && (killedPiece.owner == from.piece.owner))
-			{
-				// Undo temporary move
-				MockChessboard[from.row][from.column] = from.piece;
-				MockChessboard[to.row][to.column] = to.piece;
-				return 1;
-			}
-		}
+/**
+ * @brief Stores the owner's freshly generated moves under the position's key, replacing whatever shared its slot
+ */
+static void StoreCachedMoves(struct PathfinderContext* context, enum PieceOwner owner)
+{
+	uint64_t key = CacheKey(context, owner);
+	struct CachedMoves* entry = &context->cache[key & (PATHFINDER_CACHE_SIZE - 1)];
+	uint64_t oldKey = entry->key;
+
+	if (StoreMovesEntry(context, owner, entry) && oldKey != 0 && oldKey != key)
+	{
+		context->cacheStats.evictions++;
 	}
+}
+#endif
 
-	// Undo temporary move
-	MockChessboard[from.row][from.column] = from.piece;
-	MockChessboard[to.row][to.column] = to.piece;
-	return 0;
+/**
+ * @brief Fills the owner's TeamMoves from an entry stored on the same position
+ */
+static void LoadMovesEntry(struct PathfinderContext* context, enum PieceOwner owner, const struct CachedMoves* entry)
+{
+	struct TeamMoves* teamMoves = &context->teamMoveSets[TEAM_INDEX(owner)];
+	Bitboard team = context->position.owners[owner];
+
+	for (uint8_t square = 0; square < NUM_SQUARES; square++)
+	{
+		teamMoves->moves[square] = 0;
+	}
+	for (uint8_t i = 0; team; i++)
+	{
+		teamMoves->moves[PopLowestSquare(&team)] = entry->moves[i];
+	}
+
+	teamMoves->pending = 0;
+	SnapshotTeamMoves(context, owner, entry->kingSquare, entry->pinned, entry->checkMask);
 }
 
-void GetPiecesForTeam(enum PieceOwner owner, struct PieceCoordinate* pieces, uint8_t* numPieces)
+/**
+ * @brief Copies the owner's generated moves into entry under the position's key. Returns 0 without storing if the
+ * team has more pieces than an entry holds, 1 otherwise.
+ */
+static uint8_t StoreMovesEntry(struct PathfinderContext* context, enum PieceOwner owner, struct CachedMoves* entry)
 {
-	*numPieces = 0;
+	Bitboard team = context->position.owners[owner];
+	const struct TeamMoves* teamMoves = &context->teamMoveSets[TEAM_INDEX(owner)];
 
-	for (uint8_t row = 0; row < NUM_ROWS; row++)
+	// Only a real team fits in an entry
+	if (PopCount(team) > PIECES_PER_TEAM)
 	{
-		for (uint8_t column = 0; column < NUM_COLS; column++)
-		{
-			struct PieceCoordinate piece = { MockChessboard[row][column], row, column };
-			if (piece.piece.owner == owner)
-			{
-				pieces[(*numPieces)++] = piece;
-			}
-		}
+		return 0;
+	}
+
+	entry->key = CacheKey(context, owner);
+	entry->kingSquare = teamMoves->kingSquare;
+	entry->pinned = teamMoves->pinned;
+	entry->checkMask = teamMoves->checkMask;
+	for (uint8_t i = 0; team; i++)
+	{
+		entry->moves[i] = teamMoves->moves[PopLowestSquare(&team)];
 	}
+	return 1;
 }
 
-static uint8_t IsPieceBlockingDiagonal(struct PieceCoordinate from, struct PieceCoordinate to)
+/**
+ * @brief Returns the key identifying the context's position with owner to move
+ */
+static uint64_t CacheKey(struct PathfinderContext* context, enum PieceOwner owner)
 {
-	uint8_t startRow;
-	uint8_t startColumn;
-	uint8_t endRow;
-	uint8_t endColumn;
+	return context->position.key ^ (owner == BLACK ? ZobristBlackToMove : 0);
+}
 
-	if (from.row > to.row)
+/**
+ * @brief Returns the row, column or diagonal through both squares (excluding square1). Squares must be aligned.
+ */
+static Bitboard LineThrough(uint8_t square1, uint8_t square2)
+{
+	Bitboard square2Bit = SQUARE_BIT(square2);
+	Bitboard rowMask = (Bitboard)0xFF << (square1 & 0x38);
+	Bitboard columnMask = A_FILE << SQUARE_COLUMN(square1);
+
+	if (rowMask & square2Bit)
 	{
-		startRow = to.row;
-		startColumn = to.column;
-		endRow = from.row;
-		endColumn = from.column;
+		return rowMask & ~SQUARE_BIT(square1);
 	}
-	else
+	if (columnMask & square2Bit)
+	{
+		return columnMask & ~SQUARE_BIT(square1);
+	}
+	if (DiagonalMasks[square1] & square2Bit)
 	{
-		startRow = from.row;
-		startColumn = from.column;
-		endRow = to.row;
-		endColumn = to.column;
+		return DiagonalMasks[square1];
+	}
+	return AntiDiagonalMasks[square1];
+}
+
+uint8_t WillResultInSelfCheckContext(struct PathfinderContext* context, PieceCoordinate from, PieceCoordinate to)
+{
+	LATENCY_BEGIN(WillResultInSelfCheck);
+	uint8_t selfCheck = 1;
+
+	// Temporarily play this move to see if it causes a self check. Without room to undo it, refuse the move.
+	if (MakeMoveContext(context, COORDINATE_SQUARE(from), COORDINATE_SQUARE(to), QUEEN))
+	{
+		enum PieceOwner owner = PIECE_OWNER(COORDINATE_PIECE(from));
+		Bitboard king = context->position.owners[owner] & context->position.types[KING];
+		selfCheck = king && IsSquareAttackedByContext(context, LowestSquare(king), EnemyOf(owner));
+
+		UnmakeMoveContext(context);
 	}
 
-	int8_t columnIncrement = startColumn > endColumn ? -1 : 1;
-	int8_t column = startColumn + columnIncrement;
-	for (uint8_t row = startRow + 1; row < endRow; row++, column += columnIncrement)
+	LATENCY_END(WillResultInSelfCheck);
+	return selfCheck;
+}
+
+void LoadPositionContext(struct PathfinderContext* context, const Piece chessboard[NUM_SQUARES])
+{
+	context->legality.owner = NEUTRAL;
+	context->undoDepth = 0;
+
+	// Only the squares that changed since the last load need their bitboards updated
+	for (uint8_t square = 0; square < NUM_SQUARES; square++)
 	{
-		// If piece is between "from" and "to" on the diagonal, it is blocking it
-		if (MockChessboard[row][column].type != NONE)
+		if (chessboard[square] != context->position.board[square])
 		{
-			return 1;
+			SetPositionPiece(context, square, chessboard[square]);
 		}
 	}
-	return 0;
 }
 
-
-void CalculateCastlingPositions(
-	struct PieceCoordinate rookPieceCoordinate,
-	struct PieceCoordinate* expectedKingPieceCoordinate, struct PieceCoordinate* expectedRookPieceCoordinate)
+uint8_t MakeMoveContext(struct PathfinderContext* context, uint8_t from, uint8_t to, enum PieceType promotion)
 {
-	// Fill in the piece attributes
-	expectedKingPieceCoordinate->piece.owner = rookPieceCoordinate.piece.owner;
-	expectedRookPieceCoordinate->piece.owner = rookPieceCoordinate.piece.owner;
-	expectedKingPieceCoordinate->piece.type = KING;
-	expectedRookPieceCoordinate->piece.type = ROOK;
+	if (context->undoDepth == MAX_UNDO_DEPTH)
+	{
+		return 0;
+	}
+
+	struct Position* position = &context->position;
+	struct UndoRecord* undo = &context->undoStack[context->undoDepth++];
+	Piece piece = position->board[from];
+
+	undo->from = from;
+	undo->to = to;
+	undo->moved = piece;
+	undo->captured = position->board[to];
+	undo->castleRights = position->castleRights;
 
-	// Calculate expected ROOK and KING columns
-	if (rookPieceCoordinate.column == 0)
+	// A pawn reaching the last row is replaced by the promotion piece
+	if (PIECE_TYPE(piece) == PAWN && (SQUARE_ROW(to) == 0 || SQUARE_ROW(to) == NUM_ROWS - 1))
 	{
-		expectedKingPieceCoordinate->column = 2;
-		expectedRookPieceCoordinate->column = 3;
+		piece = (piece & PIECE_BLACK) | promotion;
 	}
-	else if (rookPieceCoordinate.column == 7)
+
+	SetPositionPiece(context, from, EMPTY_PIECE);
+	SetPositionPiece(context, to, piece);
+
+	// When castling the rook jumps over the king
+	if (IsCastlingMove(undo))
 	{
-		expectedKingPieceCoordinate->column = 6;
-		expectedRookPieceCoordinate->column = 5;
+		uint8_t rookFrom, rookTo;
+		CalculateCastlingRookSquares(from, to, &rookFrom, &rookTo);
+		SetPositionPiece(context, rookTo, position->board[rookFrom]);
+		SetPositionPiece(context, rookFrom, EMPTY_PIECE);
 	}
 
-	// Calculate expected ROOK and KING rows
-	if (rookPieceCoordinate.piece.owner == WHITE)
+	position->castleRights &= ~(CastleRightsLost(from) | CastleRightsLost(to));
+	context->legality.owner = NEUTRAL;
+	return 1;
+}
+
+uint8_t UnmakeMoveContext(struct PathfinderContext* context)
+{
+	if (context->undoDepth == 0)
 	{
-		expectedKingPieceCoordinate->row = expectedRookPieceCoordinate->row = 0;
+		return 0;
 	}
-	else if (rookPieceCoordinate.piece.owner == BLACK)
+
+	const struct UndoRecord* undo = &context->undoStack[--context->undoDepth];
+
+	if (IsCastlingMove(undo))
 	{
-		expectedKingPieceCoordinate->row = expectedRookPieceCoordinate->row = 7;
+		uint8_t rookFrom, rookTo;
+		CalculateCastlingRookSquares(undo->from, undo->to, &rookFrom, &rookTo);
+		SetPositionPiece(context, rookFrom, context->position.board[rookTo]);
+		SetPositionPiece(context, rookTo, EMPTY_PIECE);
 	}
+
+	SetPositionPiece(context, undo->to, undo->captured);
+	SetPositionPiece(context, undo->from, undo->moved);
+
+	context->position.castleRights = undo->castleRights;
+	context->legality.owner = NEUTRAL;
+	return 1;
+}
+
+/**
+ * @brief Puts piece on the given square of the context's position, keeping the square array and bitboards in sync
+ */
+static void SetPositionPiece(struct PathfinderContext* context, uint8_t square, Piece piece)
+{
+	Piece oldPiece = context->position.board[square];
+	Bitboard squareBit = SQUARE_BIT(square);
+
+	context->position.key ^= PieceZobristKey(oldPiece, square) ^ PieceZobristKey(piece, square);
+	context->position.owners[PIECE_OWNER(oldPiece)] &= ~squareBit;
+	context->position.types[PIECE_TYPE(oldPiece)] &= ~squareBit;
+	context->position.owners[PIECE_OWNER(piece)] |= squareBit;
+	context->position.types[PIECE_TYPE(piece)] |= squareBit;
+	context->position.board[square] = piece;
 }
 
-static inline uint8_t IsValidCoordinate(struct Coordinate path)
+/**
+ * @brief Returns 1 if the recorded move is a king moving two columns, which takes its rook along
+ */
+static uint8_t IsCastlingMove(const struct UndoRecord* undo)
 {
-	return path.row >= 0 && path.row < 8 && path.column >= 0 && path.column < 8;
+	int8_t columns = SQUARE_COLUMN(undo->to) - SQUARE_COLUMN(undo->from);
+	return PIECE_TYPE(undo->moved) == KING && (columns == 2 || columns == -2);
 }
 
-static inline uint8_t IsPieceMovingStraight(struct PieceCoordinate from, struct PieceCoordinate to)
+/**
+ * @brief Finds where the rook comes from and goes to when the king castles from kingFrom to kingTo
+ */
+static void CalculateCastlingRookSquares(uint8_t kingFrom, uint8_t kingTo, uint8_t* rookFrom, uint8_t* rookTo)
 {
-	return (from.column == to.column || from.row == to.row);
+	uint8_t row = SQUARE_ROW(kingFrom);
+	uint8_t kingSide = SQUARE_COLUMN(kingTo) > SQUARE_COLUMN(kingFrom);
+
+	*rookFrom = SQUARE(row, kingSide ? 7 : 0);
+	*rookTo = SQUARE(row, kingSide ? 5 : 3);
 }
 
-static inline uint8_t IsPieceMovingDiagonal(struct PieceCoordinate from, struct PieceCoordinate to)
+/**
+ * @brief Returns the castle rights lost once a piece leaves or is captured on the given square
+ */
+static uint8_t CastleRightsLost(uint8_t square)
 {
-	return abs((int8_t)from.column - (int8_t)to.column) == abs((int8_t)from.row - (int8_t)to.row);
+	switch (square)
+	{
+	case SQUARE(0, 0):
+		return CASTLE_A1;
+	case SQUARE(0, 7):
+		return CASTLE_H1;
+	case SQUARE(7, 0):
+		return CASTLE_A8;
+	case SQUARE(7, 7):
+		return CASTLE_H8;
+	case SQUARE(0, 4):
+		return CASTLE_A1 | CASTLE_H1;
+	case SQUARE(7, 4):
+		return CASTLE_A8 | CASTLE_H8;
+	default:
+		return 0;
+	}
+}
+
+void CalculateCastlingPositions(
+	PieceCoordinate rookPieceCoordinate,
+	PieceCoordinate* expectedKingPieceCoordinate, PieceCoordinate* expectedRookPieceCoordinate)
+{
+	// The king and rook end up on the rook's row, on the columns next to each other on the rook's side of the board
+	Piece rook = COORDINATE_PIECE(rookPieceCoordinate);
+	uint8_t row = PIECE_OWNER(rook) == WHITE ? 0 : 7;
+	uint8_t kingSide = SQUARE_COLUMN(COORDINATE_SQUARE(rookPieceCoordinate)) == 7;
+
+	*expectedKingPieceCoordinate = PIECE_COORDINATE((rook & PIECE_BLACK) | KING, SQUARE(row, kingSide ? 6 : 2));
+	*expectedRookPieceCoordinate = PIECE_COORDINATE(rook, SQUARE(row, kingSide ? 5 : 3));
+}
+
+/**
+ * @brief Takes the next destination to speculate on off the candidates, captures first
+ */
+static uint8_t PopSpeculationCandidate(struct Speculation* speculation)
+{
+	Bitboard pool = speculation->captures ? speculation->captures : speculation->candidates;
+	uint8_t to = LowestSquare(pool);
+
+	speculation->captures &= ~SQUARE_BIT(to);
+	speculation->candidates &= ~SQUARE_BIT(to);
+	return to;
 }
 
-static inline uint8_t IsPieceCoordinateSameTeam(struct PieceCoordinate pieceCoordinate1, struct PieceCoordinate pieceCoordinate2)
+static inline enum PieceOwner EnemyOf(enum PieceOwner owner)
 {
-	return pieceCoordinate1.piece.owner == pieceCoordinate2.piece.owner;
+	return owner == WHITE ? BLACK : WHITE;
 }
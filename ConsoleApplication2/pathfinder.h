@@ -2,7 +2,233 @@
 #define PATHFINDER_H_
 
 #include "types.h"
+
+/*
+ * Build options:
+ * PATHFINDER_FULL_REGENERATION - regenerate every piece's moves each turn instead of only the pieces the moves since
+ *                                that team's last turn could have affected
+ * PATHFINDER_CROSSCHECK        - after every incremental update, regenerate fully and assert both agree (debug builds)
+ * PATHFINDER_CACHE_SIZE        - number of positions whose legal moves are remembered per context, a power of 2
+ *                                (default 8, about 160 bytes each). 0 disables the cache.
+ * PATHFINDER_SPECULATION_SLOTS - number of positions a Speculation precomputes the next team's moves for (default 8,
+ *                                about 160 bytes each)
+ */
+
+#ifndef PATHFINDER_CACHE_SIZE
+#define PATHFINDER_CACHE_SIZE 8
+#endif
+
+#ifndef PATHFINDER_SPECULATION_SLOTS
+#define PATHFINDER_SPECULATION_SLOTS 8
+#endif
+
 #define LEGAL_MOVE_SET_SIZE (NUM_PIECE_TYPES << 6) | ((NUM_ROWS - 1) << 3) | ((NUM_COLS - 1) << 0)
+#define MAX_UNDO_DEPTH 16
+
+// Castle rights, one per rook that may still castle with its king //
+#define CASTLE_A1 (1 << 0)
+#define CASTLE_H1 (1 << 1)
+#define CASTLE_A8 (1 << 2)
+#define CASTLE_H8 (1 << 3)
+#define CASTLE_ALL (CASTLE_A1 | CASTLE_H1 | CASTLE_A8 | CASTLE_H8)
+
+/**
+ * @brief Board position used by the pathfinder. The square array answers "what is on this square" while the
+ * bitboards answer "where are all pieces of this kind". Both views are kept in sync by SetPositionPiece.
+ * owners[NEUTRAL] and types[NONE] hold the empty squares.
+ */
+struct Position {
+	Piece board[NUM_SQUARES];
+	Bitboard owners[NUM_PIECE_OWNERS];
+	Bitboard types[NUM_PIECE_TYPES];
+	uint8_t castleRights;
+	uint64_t key;	// Zobrist key of the pieces (see tables.h), kept up to date by SetPositionPiece
+};
+
+/**
+ * @brief What MakeMove needs to put the position back the way it was. The move itself says where the pieces went, so
+ * only what it overwrote is kept.
+ */
+struct UndoRecord {
+	uint8_t from;
+	uint8_t to;
+	Piece moved;		// As it stood on from, so a promoted pawn comes back as a pawn
+	Piece captured;		// EMPTY_PIECE if the move didn't capture
+	uint8_t castleRights;	// Rights before the move
+};
+
+/**
+ * @brief Everything needed to filter one team's moves down to legal ones, computed once per position by CalculateLegality
+ */
+struct Legality {
+	enum PieceOwner owner;	// Team this was calculated for, NEUTRAL if stale
+	uint8_t kingSquare;
+	Bitboard checkers;		// Enemy pieces attacking our king
+	Bitboard pinned;		// Our pieces that can only move along the line through them and our king
+	Bitboard checkMask;		// Squares a non-king move must land on: anywhere, block/capture a single checker, or nothing
+};
+
+/**
+ * @brief A team's legal moves along with the position and legality they were generated on. Kept across turns so the
+ * next generation for this team only has to redo the pieces the moves since then could have affected.
+ */
+struct TeamMoves {
+	uint8_t valid;
+	Bitboard owners[NUM_PIECE_OWNERS];
+	Bitboard types[NUM_PIECE_TYPES];
+	uint8_t kingSquare;
+	Bitboard pinned;
+	Bitboard checkMask;
+	Bitboard pending;				// Pieces whose moves haven't been generated yet (see BeginTeamsLegalMovesContext)
+	Bitboard moves[NUM_SQUARES];	// Legal destinations of the team's piece on each square, 0 for other squares
+};
+
+#define TEAM_INDEX(owner) ((owner) - WHITE)
+#define NUM_TEAMS 2
+
+/**
+ * @brief A team's legal moves in a position it has been asked about before, along with the legality the incremental
+ * update needs. Moves are listed in square order of the team's pieces.
+ */
+struct CachedMoves {
+	uint64_t key;	// Position key with the side to move mixed in, 0 if unused
+	uint8_t kingSquare;
+	Bitboard pinned;
+	Bitboard checkMask;
+	Bitboard moves[PIECES_PER_TEAM];
+};
+
+/**
+ * @brief How well the legal move cache is doing, for sizing PATHFINDER_CACHE_SIZE
+ */
+struct LegalMoveCacheStats {
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t evictions;	// Stores that replaced a different position
+};
+
+/**
+ * @brief All of the pathfinder's working state. Each context is independent, so several boards (or a board and a
+ * search) can be pathfound side by side. The functions without a context argument use the default tracker's one.
+ */
+struct PathfinderContext {
+	struct Position position;					// Allows us to draft moves and their consequences without effecting the real chessboard
+	struct Legality legality;
+	struct TeamMoves teamMoveSets[NUM_TEAMS];	// Legal moves of both teams as of their last turn
+	const Bitboard* legalMoveSet;				// Legal destinations of the current team's pieces indexed by origin square
+	enum PieceOwner legalMoveSetOwner;
+	uint8_t legalMoveSetPrepared;				// Whether the legality and pending pieces of legalMoveSetOwner are known
+	struct UndoRecord undoStack[MAX_UNDO_DEPTH];	// Moves played on the position since it was last loaded
+	uint8_t undoDepth;
+#if PATHFINDER_CACHE_SIZE > 0
+	struct CachedMoves cache[PATHFINDER_CACHE_SIZE];	// Direct mapped by key
+#endif
+	struct LegalMoveCacheStats cacheStats;
+};
+
+/**
+ * @brief How often a turn switch found its moves already speculated
+ */
+struct SpeculationStats {
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t positions;	// Positions speculated
+};
+
+/**
+ * @brief Second set of legal move buffers, filled in idle time while a piece is held: for each square the piece may
+ * legally land on, the next team's moves in the resulting position. The moves are played on a search context of its
+ * own, so the live context keeps answering IsLegalMoveContext for the held piece meanwhile. When the turn ends on one
+ * of the speculated positions, AdoptSpeculationContext hands its moves to the live context instead of generating them.
+ */
+struct Speculation {
+	struct PathfinderContext search;
+	uint8_t from;								// Square of the held piece
+	enum PieceOwner owner;						// Team to move after the held piece lands, NEUTRAL if idle
+	Bitboard candidates;						// Destinations not speculated yet
+	Bitboard captures;							// Destinations that take a piece, speculated first
+	struct CachedMoves slots[PATHFINDER_SPECULATION_SLOTS];
+	uint8_t numSlots;
+	struct SpeculationStats stats;
+};
+
+/**
+ * @brief Resets the context so no team has any legal moves until CalculateTeamsLegalMovesContext is called
+ */
+void InitPathfinderContext(struct PathfinderContext* context);
+
+/**
+ * @brief Brings the context's position up to date with chessboard, only touching the squares that changed, and forgets
+ * the moves played on it
+ */
+void LoadPositionContext(struct PathfinderContext* context, const Piece chessboard[NUM_SQUARES]);
+
+/**
+ * @brief Plays from -> to on the context's position and records how to undo it. A pawn reaching the last row becomes
+ * promotion, and a king moving two columns castles. Returns 0 without moving if the undo stack is full, 1 otherwise.
+ */
+uint8_t MakeMoveContext(struct PathfinderContext* context, uint8_t from, uint8_t to, enum PieceType promotion);
+
+/**
+ * @brief Takes back the last move played by MakeMoveContext. Returns 0 if there is no move to take back, 1 otherwise.
+ */
+uint8_t UnmakeMoveContext(struct PathfinderContext* context);
+
+/**
+ * @brief Same as CalculateTeamsLegalMovesContext, but for the position as it stands (after MakeMoveContext) instead of
+ * a chessboard
+ */
+void CalculatePositionLegalMovesContext(struct PathfinderContext* context, enum PieceOwner owner);
+
+/**
+ * @brief Loads chessboard and makes owner the current team without generating any moves. Each piece's moves are then
+ * generated the first time they are needed (IsLegalMoveContext, GeneratePieceLegalMovesContext) or by
+ * FillLegalMovesContext. The position must stay as loaded until every piece has been generated or the next begin.
+ */
+void BeginTeamsLegalMovesContext(struct PathfinderContext* context, const Piece chessboard[NUM_SQUARES], enum PieceOwner owner);
+
+/**
+ * @brief Generates the legal moves of the current team's piece on square, unless they already are
+ */
+void GeneratePieceLegalMovesContext(struct PathfinderContext* context, uint8_t square);
+
+/**
+ * @brief Generates the legal moves of up to maxPieces of the current team's pieces that are still pending. Returns the
+ * number of pieces left pending.
+ */
+uint8_t FillLegalMovesContext(struct PathfinderContext* context, uint8_t maxPieces);
+
+/**
+ * @brief Stops any speculation and clears its stats
+ */
+void InitSpeculation(struct Speculation* speculation);
+
+/**
+ * @brief Starts speculating on the positions the current team's piece on from can move to in live's position,
+ * dropping whatever was speculated before
+ */
+void BeginSpeculationContext(struct Speculation* speculation, struct PathfinderContext* live, uint8_t from);
+
+/**
+ * @brief Speculates up to maxPositions more positions, most likely first (captures, then the rest). Returns the number
+ * of positions that are left to speculate and still have a free slot.
+ */
+uint8_t SpeculateContext(struct Speculation* speculation, uint8_t maxPositions);
+
+/**
+ * @brief Loads chessboard and, if it is a speculated position, makes owner the current team with the speculated moves.
+ * Returns 1 if it was, 0 if the moves still have to be calculated (or begun). Either way the speculation is over.
+ */
+uint8_t AdoptSpeculationContext(struct PathfinderContext* context, struct Speculation* speculation, const Piece chessboard[NUM_SQUARES], enum PieceOwner owner);
+
+// Context API //
+void CalculateTeamsLegalMovesContext(struct PathfinderContext* context, const Piece chessboard[NUM_SQUARES], enum PieceOwner owner);
+uint8_t IsLegalMoveContext(struct PathfinderContext* context, PieceCoordinate from, PieceCoordinate to);
+void CalculateAllLegalPathsAndChecksContext(struct PathfinderContext* context, PieceCoordinate from, uint8_t* allLegalPaths, uint8_t* numLegalPaths);
+uint8_t WillResultInSelfCheckContext(struct PathfinderContext* context, PieceCoordinate from, PieceCoordinate to);
+Bitboard GetAttackersContext(struct PathfinderContext* context, uint8_t square);
+uint8_t IsSquareAttackedByContext(struct PathfinderContext* context, uint8_t square, enum PieceOwner owner);
+uint8_t InferMoveFromOccupancyContext(struct PathfinderContext* context, Bitboard occupied, Bitboard landed, uint8_t* from, uint8_t* to);
 
 /**
  * @brief Fills LegalMove data structure with all the legal moves for the given team
@@ -12,21 +238,54 @@ void CalculateTeamsLegalMoves(enum PieceOwner owner);
 /**
  * @brief Determines if the given move is legal by invoking the LegalMove data structure
  */
-uint8_t IsLegalMove(struct PieceCoordinate from, struct PieceCoordinate to);
+uint8_t IsLegalMove(PieceCoordinate from, PieceCoordinate to);
 
 /**
  * @brief Calculates all possible paths for a given piece given the current state of the chessboard. Also trims off moves that would put their king in check.
+ * The paths are the squares (see SQUARE) the piece may move to.
  */
-void CalculateAllLegalPathsAndChecks(struct PieceCoordinate from, struct Coordinate* allLegalPaths, uint8_t* numLegalPaths);
+void CalculateAllLegalPathsAndChecks(PieceCoordinate from, uint8_t* allLegalPaths, uint8_t* numLegalPaths);
 
 /**
  * @brief Returns 1 if a move (from -> to) will result in their king being in check. 0 otherwise.
  */
-uint8_t WillResultInSelfCheck(struct PieceCoordinate from, struct PieceCoordinate to);
+uint8_t WillResultInSelfCheck(PieceCoordinate from, PieceCoordinate to);
+
+/**
+ * @brief Returns the squares of the current team's pieces that may legally capture on square, generating (in lazy
+ * builds) only the pieces that attack it at all
+ */
+Bitboard GetAttackers(uint8_t square);
+
+/**
+ * @brief Returns 1 if any of the owner's pieces attacks square on the position the current team's moves were
+ * calculated on, 0 otherwise. Works backwards from the square and returns at the first attacker, so it only looks at a
+ * handful of squares instead of every enemy piece's paths.
+ */
+uint8_t IsSquareAttackedBy(uint8_t square, enum PieceOwner owner);
+
+/**
+ * @brief Finds the current team's legal moves that turn the position's occupancy into occupied (both indexed by
+ * SQUARE), however the pieces got there. Only moves that land on a square in landed count, which is what tells a
+ * capture apart from its piece just being held. Returns the number of moves that fit, with the first in from and to.
+ * Castling isn't among the legal moves, so the tracker infers it itself.
+ */
+uint8_t InferMoveFromOccupancy(Bitboard occupied, Bitboard landed, uint8_t* from, uint8_t* to);
+
+/**
+ * @brief Play and take back moves on the pathfinder's position (see MakeMoveContext and UnmakeMoveContext)
+ */
+uint8_t MakeMove(uint8_t from, uint8_t to, enum PieceType promotion);
+uint8_t UnmakeMove(void);
+
+/**
+ * @brief Returns the hit, miss and eviction counts of the legal move cache
+ */
+struct LegalMoveCacheStats GetLegalMoveCacheStats(void);
 
 /**
  * @brief Calculates the expected castling position relative to the given rook
  */
-void CalculateCastlingPositions(struct PieceCoordinate rookPieceCoordinate, struct PieceCoordinate* expectedKingPieceCoordinate, struct PieceCoordinate* expectedRookPieceCoordinate);
+void CalculateCastlingPositions(PieceCoordinate rookPieceCoordinate, PieceCoordinate* expectedKingPieceCoordinate, PieceCoordinate* expectedRookPieceCoordinate);
 
 #endif /* PATHFINDER_H_ */
@@ -5,9 +5,17 @@
 
 #include <stdio.h>
 
+// SIM_QUIET keeps the tracker's commentary out of tools that print their own report (tools/replay.c)
+#ifdef SIM_QUIET
+#define PRINT_SIM_FUNC()
+#define PRINT_SIM(msg)
+#define PRINT_SIM_PIECE(msg, piece_)
+#else
 #define PRINT_SIM_FUNC() printf("%s\n", __func__)
 #define PRINT_SIM(msg) printf("%s: %s\n", __func__, msg)
-#define PRINT_SIM_PIECE(msg, piece_) printf("%s: %s {%d, %d} (%d, %d)\n", __func__, msg, piece_.piece.owner, piece_.piece.type, piece_.row, piece_.column)
+#define PRINT_SIM_PIECE(msg, piece_) printf("%s: %s {%d, %d} (%d, %d)\n", __func__, msg, PIECE_OWNER(COORDINATE_PIECE(piece_)), \
+	PIECE_TYPE(COORDINATE_PIECE(piece_)), COORDINATE_ON_BOARD(piece_) ? SQUARE_ROW(COORDINATE_SQUARE(piece_)) : 0xFF, COORDINATE_ON_BOARD(piece_) ? SQUARE_COLUMN(COORDINATE_SQUARE(piece_)) : 0xFF)
+#endif
 
 #endif // SIM
 
@@ -0,0 +1,691 @@
+/* Generated by tools/tablegen.c - do not edit. Regenerate with: make tables */
+
+#include "tables.h"
+
+const Bitboard FillUpAttacks[NUM_COLS][LINE_OCCUPANCY_SIZE] = {
+	{
+		0xFEFEFEFEFEFEFEFEULL, 0x0202020202020202ULL, 0x0606060606060606ULL, 0x0202020202020202ULL,
+		0x0E0E0E0E0E0E0E0EULL, 0x0202020202020202ULL, 0x0606060606060606ULL, 0x0202020202020202ULL,
+		0x1E1E1E1E1E1E1E1EULL, 0x0202020202020202ULL, 0x0606060606060606ULL, 0x0202020202020202ULL,
+		0x0E0E0E0E0E0E0E0EULL, 0x0202020202020202ULL, 0x0606060606060606ULL, 0x0202020202020202ULL,
+		0x3E3E3E3E3E3E3E3EULL, 0x0202020202020202ULL, 0x0606060606060606ULL, 0x0202020202020202ULL,
+		0x0E0E0E0E0E0E0E0EULL, 0x0202020202020202ULL, 0x0606060606060606ULL, 0x0202020202020202ULL,
+		0x1E1E1E1E1E1E1E1EULL, 0x0202020202020202ULL, 0x0606060606060606ULL, 0x0202020202020202ULL,
+		0x0E0E0E0E0E0E0E0EULL, 0x0202020202020202ULL, 0x0606060606060606ULL, 0x0202020202020202ULL,
+		0x7E7E7E7E7E7E7E7EULL, 0x0202020202020202ULL, 0x0606060606060606ULL, 0x0202020202020202ULL,
+		0x0E0E0E0E0E0E0E0EULL, 0x0202020202020202ULL, 0x0606060606060606ULL, 0x0202020202020202ULL,
+		0x1E1E1E1E1E1E1E1EULL, 0x0202020202020202ULL, 0x0606060606060606ULL, 0x0202020202020202ULL,
+		0x0E0E0E0E0E0E0E0EULL, 0x0202020202020202ULL, 0x0606060606060606ULL, 0x0202020202020202ULL,
+		0x3E3E3E3E3E3E3E3EULL, 0x0202020202020202ULL, 0x0606060606060606ULL, 0x0202020202020202ULL,
+		0x0E0E0E0E0E0E0E0EULL, 0x0202020202020202ULL, 0x0606060606060606ULL, 0x0202020202020202ULL,
+		0x1E1E1E1E1E1E1E1EULL, 0x0202020202020202ULL, 0x0606060606060606ULL, 0x0202020202020202ULL,
+		0x0E0E0E0E0E0E0E0EULL, 0x0202020202020202ULL, 0x0606060606060606ULL, 0x0202020202020202ULL,
+	},
+	{
+		0xFDFDFDFDFDFDFDFDULL, 0xFDFDFDFDFDFDFDFDULL, 0x0505050505050505ULL, 0x0505050505050505ULL,
+		0x0D0D0D0D0D0D0D0DULL, 0x0D0D0D0D0D0D0D0DULL, 0x0505050505050505ULL, 0x0505050505050505ULL,
+		0x1D1D1D1D1D1D1D1DULL, 0x1D1D1D1D1D1D1D1DULL, 0x0505050505050505ULL, 0x0505050505050505ULL,
+		0x0D0D0D0D0D0D0D0DULL, 0x0D0D0D0D0D0D0D0DULL, 0x0505050505050505ULL, 0x0505050505050505ULL,
+		0x3D3D3D3D3D3D3D3DULL, 0x3D3D3D3D3D3D3D3DULL, 0x0505050505050505ULL, 0x0505050505050505ULL,
+		0x0D0D0D0D0D0D0D0DULL, 0x0D0D0D0D0D0D0D0DULL, 0x0505050505050505ULL, 0x0505050505050505ULL,
+		0x1D1D1D1D1D1D1D1DULL, 0x1D1D1D1D1D1D1D1DULL, 0x0505050505050505ULL, 0x0505050505050505ULL,
+		0x0D0D0D0D0D0D0D0DULL, 0x0D0D0D0D0D0D0D0DULL, 0x0505050505050505ULL, 0x0505050505050505ULL,
+		0x7D7D7D7D7D7D7D7DULL, 0x7D7D7D7D7D7D7D7DULL, 0x0505050505050505ULL, 0x0505050505050505ULL,
+		0x0D0D0D0D0D0D0D0DULL, 0x0D0D0D0D0D0D0D0DULL, 0x0505050505050505ULL, 0x0505050505050505ULL,
+		0x1D1D1D1D1D1D1D1DULL, 0x1D1D1D1D1D1D1D1DULL, 0x0505050505050505ULL, 0x0505050505050505ULL,
+		0x0D0D0D0D0D0D0D0DULL, 0x0D0D0D0D0D0D0D0DULL, 0x0505050505050505ULL, 0x0505050505050505ULL,
+		0x3D3D3D3D3D3D3D3DULL, 0x3D3D3D3D3D3D3D3DULL, 0x0505050505050505ULL, 0x0505050505050505ULL,
+		0x0D0D0D0D0D0D0D0DULL, 0x0D0D0D0D0D0D0D0DULL, 0x0505050505050505ULL, 0x0505050505050505ULL,
+		0x1D1D1D1D1D1D1D1DULL, 0x1D1D1D1D1D1D1D1DULL, 0x0505050505050505ULL, 0x0505050505050505ULL,
+		0x0D0D0D0D0D0D0D0DULL, 0x0D0D0D0D0D0D0D0DULL, 0x0505050505050505ULL, 0x0505050505050505ULL,
+	},
+	{
+		0xFBFBFBFBFBFBFBFBULL, 0xFAFAFAFAFAFAFAFAULL, 0xFBFBFBFBFBFBFBFBULL, 0xFAFAFAFAFAFAFAFAULL,
+		0x0B0B0B0B0B0B0B0BULL, 0x0A0A0A0A0A0A0A0AULL, 0x0B0B0B0B0B0B0B0BULL, 0x0A0A0A0A0A0A0A0AULL,
+		0x1B1B1B1B1B1B1B1BULL, 0x1A1A1A1A1A1A1A1AULL, 0x1B1B1B1B1B1B1B1BULL, 0x1A1A1A1A1A1A1A1AULL,
+		0x0B0B0B0B0B0B0B0BULL, 0x0A0A0A0A0A0A0A0AULL, 0x0B0B0B0B0B0B0B0BULL, 0x0A0A0A0A0A0A0A0AULL,
+		0x3B3B3B3B3B3B3B3BULL, 0x3A3A3A3A3A3A3A3AULL, 0x3B3B3B3B3B3B3B3BULL, 0x3A3A3A3A3A3A3A3AULL,
+		0x0B0B0B0B0B0B0B0BULL, 0x0A0A0A0A0A0A0A0AULL, 0x0B0B0B0B0B0B0B0BULL, 0x0A0A0A0A0A0A0A0AULL,
+		0x1B1B1B1B1B1B1B1BULL, 0x1A1A1A1A1A1A1A1AULL, 0x1B1B1B1B1B1B1B1BULL, 0x1A1A1A1A1A1A1A1AULL,
+		0x0B0B0B0B0B0B0B0BULL, 0x0A0A0A0A0A0A0A0AULL, 0x0B0B0B0B0B0B0B0BULL, 0x0A0A0A0A0A0A0A0AULL,
+		0x7B7B7B7B7B7B7B7BULL, 0x7A7A7A7A7A7A7A7AULL, 0x7B7B7B7B7B7B7B7BULL, 0x7A7A7A7A7A7A7A7AULL,
+		0x0B0B0B0B0B0B0B0BULL, 0x0A0A0A0A0A0A0A0AULL, 0x0B0B0B0B0B0B0B0BULL, 0x0A0A0A0A0A0A0A0AULL,
+		0x1B1B1B1B1B1B1B1BULL, 0x1A1A1A1A1A1A1A1AULL, 0x1B1B1B1B1B1B1B1BULL, 0x1A1A1A1A1A1A1A1AULL,
+		0x0B0B0B0B0B0B0B0BULL, 0x0A0A0A0A0A0A0A0AULL, 0x0B0B0B0B0B0B0B0BULL, 0x0A0A0A0A0A0A0A0AULL,
+		0x3B3B3B3B3B3B3B3BULL, 0x3A3A3A3A3A3A3A3AULL, 0x3B3B3B3B3B3B3B3BULL, 0x3A3A3A3A3A3A3A3AULL,
+		0x0B0B0B0B0B0B0B0BULL, 0x0A0A0A0A0A0A0A0AULL, 0x0B0B0B0B0B0B0B0BULL, 0x0A0A0A0A0A0A0A0AULL,
+		0x1B1B1B1B1B1B1B1BULL, 0x1A1A1A1A1A1A1A1AULL, 0x1B1B1B1B1B1B1B1BULL, 0x1A1A1A1A1A1A1A1AULL,
+		0x0B0B0B0B0B0B0B0BULL, 0x0A0A0A0A0A0A0A0AULL, 0x0B0B0B0B0B0B0B0BULL, 0x0A0A0A0A0A0A0A0AULL,
+	},
+	{
+		0xF7F7F7F7F7F7F7F7ULL, 0xF6F6F6F6F6F6F6F6ULL, 0xF4F4F4F4F4F4F4F4ULL, 0xF4F4F4F4F4F4F4F4ULL,
+		0xF7F7F7F7F7F7F7F7ULL, 0xF6F6F6F6F6F6F6F6ULL, 0xF4F4F4F4F4F4F4F4ULL, 0xF4F4F4F4F4F4F4F4ULL,
+		0x1717171717171717ULL, 0x1616161616161616ULL, 0x1414141414141414ULL, 0x1414141414141414ULL,
+		0x1717171717171717ULL, 0x1616161616161616ULL, 0x1414141414141414ULL, 0x1414141414141414ULL,
+		0x3737373737373737ULL, 0x3636363636363636ULL, 0x3434343434343434ULL, 0x3434343434343434ULL,
+		0x3737373737373737ULL, 0x3636363636363636ULL, 0x3434343434343434ULL, 0x3434343434343434ULL,
+		0x1717171717171717ULL, 0x1616161616161616ULL, 0x1414141414141414ULL, 0x1414141414141414ULL,
+		0x1717171717171717ULL, 0x1616161616161616ULL, 0x1414141414141414ULL, 0x1414141414141414ULL,
+		0x7777777777777777ULL, 0x7676767676767676ULL, 0x7474747474747474ULL, 0x7474747474747474ULL,
+		0x7777777777777777ULL, 0x7676767676767676ULL, 0x7474747474747474ULL, 0x7474747474747474ULL,
+		0x1717171717171717ULL, 0x1616161616161616ULL, 0x1414141414141414ULL, 0x1414141414141414ULL,
+		0x1717171717171717ULL, 0x1616161616161616ULL, 0x1414141414141414ULL, 0x1414141414141414ULL,
+		0x3737373737373737ULL, 0x3636363636363636ULL, 0x3434343434343434ULL, 0x3434343434343434ULL,
+		0x3737373737373737ULL, 0x3636363636363636ULL, 0x3434343434343434ULL, 0x3434343434343434ULL,
+		0x1717171717171717ULL, 0x1616161616161616ULL, 0x1414141414141414ULL, 0x1414141414141414ULL,
+		0x1717171717171717ULL, 0x1616161616161616ULL, 0x1414141414141414ULL, 0x1414141414141414ULL,
+	},
+	{
+		0xEFEFEFEFEFEFEFEFULL, 0xEEEEEEEEEEEEEEEEULL, 0xECECECECECECECECULL, 0xECECECECECECECECULL,
+		0xE8E8E8E8E8E8E8E8ULL, 0xE8E8E8E8E8E8E8E8ULL, 0xE8E8E8E8E8E8E8E8ULL, 0xE8E8E8E8E8E8E8E8ULL,
+		0xEFEFEFEFEFEFEFEFULL, 0xEEEEEEEEEEEEEEEEULL, 0xECECECECECECECECULL, 0xECECECECECECECECULL,
+		0xE8E8E8E8E8E8E8E8ULL, 0xE8E8E8E8E8E8E8E8ULL, 0xE8E8E8E8E8E8E8E8ULL, 0xE8E8E8E8E8E8E8E8ULL,
+		0x2F2F2F2F2F2F2F2FULL, 0x2E2E2E2E2E2E2E2EULL, 0x2C2C2C2C2C2C2C2CULL, 0x2C2C2C2C2C2C2C2CULL,
+		0x2828282828282828ULL, 0x2828282828282828ULL, 0x2828282828282828ULL, 0x2828282828282828ULL,
+		0x2F2F2F2F2F2F2F2FULL, 0x2E2E2E2E2E2E2E2EULL, 0x2C2C2C2C2C2C2C2CULL, 0x2C2C2C2C2C2C2C2CULL,
+		0x2828282828282828ULL, 0x2828282828282828ULL, 0x2828282828282828ULL, 0x2828282828282828ULL,
+		0x6F6F6F6F6F6F6F6FULL, 0x6E6E6E6E6E6E6E6EULL, 0x6C6C6C6C6C6C6C6CULL, 0x6C6C6C6C6C6C6C6CULL,
+		0x6868686868686868ULL, 0x6868686868686868ULL, 0x6868686868686868ULL, 0x6868686868686868ULL,
+		0x6F6F6F6F6F6F6F6FULL, 0x6E6E6E6E6E6E6E6EULL, 0x6C6C6C6C6C6C6C6CULL, 0x6C6C6C6C6C6C6C6CULL,
+		0x6868686868686868ULL, 0x6868686868686868ULL, 0x6868686868686868ULL, 0x6868686868686868ULL,
+		0x2F2F2F2F2F2F2F2FULL, 0x2E2E2E2E2E2E2E2EULL, 0x2C2C2C2C2C2C2C2CULL, 0x2C2C2C2C2C2C2C2CULL,
+		0x2828282828282828ULL, 0x2828282828282828ULL, 0x2828282828282828ULL, 0x2828282828282828ULL,
+		0x2F2F2F2F2F2F2F2FULL, 0x2E2E2E2E2E2E2E2EULL, 0x2C2C2C2C2C2C2C2CULL, 0x2C2C2C2C2C2C2C2CULL,
+		0x2828282828282828ULL, 0x2828282828282828ULL, 0x2828282828282828ULL, 0x2828282828282828ULL,
+	},
+	{
+		0xDFDFDFDFDFDFDFDFULL, 0xDEDEDEDEDEDEDEDEULL, 0xDCDCDCDCDCDCDCDCULL, 0xDCDCDCDCDCDCDCDCULL,
+		0xD8D8D8D8D8D8D8D8ULL, 0xD8D8D8D8D8D8D8D8ULL, 0xD8D8D8D8D8D8D8D8ULL, 0xD8D8D8D8D8D8D8D8ULL,
+		0xD0D0D0D0D0D0D0D0ULL, 0xD0D0D0D0D0D0D0D0ULL, 0xD0D0D0D0D0D0D0D0ULL, 0xD0D0D0D0D0D0D0D0ULL,
+		0xD0D0D0D0D0D0D0D0ULL, 0xD0D0D0D0D0D0D0D0ULL, 0xD0D0D0D0D0D0D0D0ULL, 0xD0D0D0D0D0D0D0D0ULL,
+		0xDFDFDFDFDFDFDFDFULL, 0xDEDEDEDEDEDEDEDEULL, 0xDCDCDCDCDCDCDCDCULL, 0xDCDCDCDCDCDCDCDCULL,
+		0xD8D8D8D8D8D8D8D8ULL, 0xD8D8D8D8D8D8D8D8ULL, 0xD8D8D8D8D8D8D8D8ULL, 0xD8D8D8D8D8D8D8D8ULL,
+		0xD0D0D0D0D0D0D0D0ULL, 0xD0D0D0D0D0D0D0D0ULL, 0xD0D0D0D0D0D0D0D0ULL, 0xD0D0D0D0D0D0D0D0ULL,
+		0xD0D0D0D0D0D0D0D0ULL, 0xD0D0D0D0D0D0D0D0ULL, 0xD0D0D0D0D0D0D0D0ULL, 0xD0D0D0D0D0D0D0D0ULL,
+		0x5F5F5F5F5F5F5F5FULL, 0x5E5E5E5E5E5E5E5EULL, 0x5C5C5C5C5C5C5C5CULL, 0x5C5C5C5C5C5C5C5CULL,
+		0x5858585858585858ULL, 0x5858585858585858ULL, 0x5858585858585858ULL, 0x5858585858585858ULL,
+		0x5050505050505050ULL, 0x5050505050505050ULL, 0x5050505050505050ULL, 0x5050505050505050ULL,
+		0x5050505050505050ULL, 0x5050505050505050ULL, 0x5050505050505050ULL, 0x5050505050505050ULL,
+		0x5F5F5F5F5F5F5F5FULL, 0x5E5E5E5E5E5E5E5EULL, 0x5C5C5C5C5C5C5C5CULL, 0x5C5C5C5C5C5C5C5CULL,
+		0x5858585858585858ULL, 0x5858585858585858ULL, 0x5858585858585858ULL, 0x5858585858585858ULL,
+		0x5050505050505050ULL, 0x5050505050505050ULL, 0x5050505050505050ULL, 0x5050505050505050ULL,
+		0x5050505050505050ULL, 0x5050505050505050ULL, 0x5050505050505050ULL, 0x5050505050505050ULL,
+	},
+	{
+		0xBFBFBFBFBFBFBFBFULL, 0xBEBEBEBEBEBEBEBEULL, 0xBCBCBCBCBCBCBCBCULL, 0xBCBCBCBCBCBCBCBCULL,
+		0xB8B8B8B8B8B8B8B8ULL, 0xB8B8B8B8B8B8B8B8ULL, 0xB8B8B8B8B8B8B8B8ULL, 0xB8B8B8B8B8B8B8B8ULL,
+		0xB0B0B0B0B0B0B0B0ULL, 0xB0B0B0B0B0B0B0B0ULL, 0xB0B0B0B0B0B0B0B0ULL, 0xB0B0B0B0B0B0B0B0ULL,
+		0xB0B0B0B0B0B0B0B0ULL, 0xB0B0B0B0B0B0B0B0ULL, 0xB0B0B0B0B0B0B0B0ULL, 0xB0B0B0B0B0B0B0B0ULL,
+		0xA0A0A0A0A0A0A0A0ULL, 0xA0A0A0A0A0A0A0A0ULL, 0xA0A0A0A0A0A0A0A0ULL, 0xA0A0A0A0A0A0A0A0ULL,
+		0xA0A0A0A0A0A0A0A0ULL, 0xA0A0A0A0A0A0A0A0ULL, 0xA0A0A0A0A0A0A0A0ULL, 0xA0A0A0A0A0A0A0A0ULL,
+		0xA0A0A0A0A0A0A0A0ULL, 0xA0A0A0A0A0A0A0A0ULL, 0xA0A0A0A0A0A0A0A0ULL, 0xA0A0A0A0A0A0A0A0ULL,
+		0xA0A0A0A0A0A0A0A0ULL, 0xA0A0A0A0A0A0A0A0ULL, 0xA0A0A0A0A0A0A0A0ULL, 0xA0A0A0A0A0A0A0A0ULL,
+		0xBFBFBFBFBFBFBFBFULL, 0xBEBEBEBEBEBEBEBEULL, 0xBCBCBCBCBCBCBCBCULL, 0xBCBCBCBCBCBCBCBCULL,
+		0xB8B8B8B8B8B8B8B8ULL, 0xB8B8B8B8B8B8B8B8ULL, 0xB8B8B8B8B8B8B8B8ULL, 0xB8B8B8B8B8B8B8B8ULL,
+		0xB0B0B0B0B0B0B0B0ULL, 0xB0B0B0B0B0B0B0B0ULL, 0xB0B0B0B0B0B0B0B0ULL, 0xB0B0B0B0B0B0B0B0ULL,
+		0xB0B0B0B0B0B0B0B0ULL, 0xB0B0B0B0B0B0B0B0ULL, 0xB0B0B0B0B0B0B0B0ULL, 0xB0B0B0B0B0B0B0B0ULL,
+		0xA0A0A0A0A0A0A0A0ULL, 0xA0A0A0A0A0A0A0A0ULL, 0xA0A0A0A0A0A0A0A0ULL, 0xA0A0A0A0A0A0A0A0ULL,
+		0xA0A0A0A0A0A0A0A0ULL, 0xA0A0A0A0A0A0A0A0ULL, 0xA0A0A0A0A0A0A0A0ULL, 0xA0A0A0A0A0A0A0A0ULL,
+		0xA0A0A0A0A0A0A0A0ULL, 0xA0A0A0A0A0A0A0A0ULL, 0xA0A0A0A0A0A0A0A0ULL, 0xA0A0A0A0A0A0A0A0ULL,
+		0xA0A0A0A0A0A0A0A0ULL, 0xA0A0A0A0A0A0A0A0ULL, 0xA0A0A0A0A0A0A0A0ULL, 0xA0A0A0A0A0A0A0A0ULL,
+	},
+	{
+		0x7F7F7F7F7F7F7F7FULL, 0x7E7E7E7E7E7E7E7EULL, 0x7C7C7C7C7C7C7C7CULL, 0x7C7C7C7C7C7C7C7CULL,
+		0x7878787878787878ULL, 0x7878787878787878ULL, 0x7878787878787878ULL, 0x7878787878787878ULL,
+		0x7070707070707070ULL, 0x7070707070707070ULL, 0x7070707070707070ULL, 0x7070707070707070ULL,
+		0x7070707070707070ULL, 0x7070707070707070ULL, 0x7070707070707070ULL, 0x7070707070707070ULL,
+		0x6060606060606060ULL, 0x6060606060606060ULL, 0x6060606060606060ULL, 0x6060606060606060ULL,
+		0x6060606060606060ULL, 0x6060606060606060ULL, 0x6060606060606060ULL, 0x6060606060606060ULL,
+		0x6060606060606060ULL, 0x6060606060606060ULL, 0x6060606060606060ULL, 0x6060606060606060ULL,
+		0x6060606060606060ULL, 0x6060606060606060ULL, 0x6060606060606060ULL, 0x6060606060606060ULL,
+		0x4040404040404040ULL, 0x4040404040404040ULL, 0x4040404040404040ULL, 0x4040404040404040ULL,
+		0x4040404040404040ULL, 0x4040404040404040ULL, 0x4040404040404040ULL, 0x4040404040404040ULL,
+		0x4040404040404040ULL, 0x4040404040404040ULL, 0x4040404040404040ULL, 0x4040404040404040ULL,
+		0x4040404040404040ULL, 0x4040404040404040ULL, 0x4040404040404040ULL, 0x4040404040404040ULL,
+		0x4040404040404040ULL, 0x4040404040404040ULL, 0x4040404040404040ULL, 0x4040404040404040ULL,
+		0x4040404040404040ULL, 0x4040404040404040ULL, 0x4040404040404040ULL, 0x4040404040404040ULL,
+		0x4040404040404040ULL, 0x4040404040404040ULL, 0x4040404040404040ULL, 0x4040404040404040ULL,
+		0x4040404040404040ULL, 0x4040404040404040ULL, 0x4040404040404040ULL, 0x4040404040404040ULL,
+	},
+};
+
+const Bitboard AFileAttacks[NUM_ROWS][LINE_OCCUPANCY_SIZE] = {
+	{
+		0x0101010101010100ULL, 0x0000000000000100ULL, 0x0000000000010100ULL, 0x0000000000000100ULL,
+		0x0000000001010100ULL, 0x0000000000000100ULL, 0x0000000000010100ULL, 0x0000000000000100ULL,
+		0x0000000101010100ULL, 0x0000000000000100ULL, 0x0000000000010100ULL, 0x0000000000000100ULL,
+		0x0000000001010100ULL, 0x0000000000000100ULL, 0x0000000000010100ULL, 0x0000000000000100ULL,
+		0x0000010101010100ULL, 0x0000000000000100ULL, 0x0000000000010100ULL, 0x0000000000000100ULL,
+		0x0000000001010100ULL, 0x0000000000000100ULL, 0x0000000000010100ULL, 0x0000000000000100ULL,
+		0x0000000101010100ULL, 0x0000000000000100ULL, 0x0000000000010100ULL, 0x0000000000000100ULL,
+		0x0000000001010100ULL, 0x0000000000000100ULL, 0x0000000000010100ULL, 0x0000000000000100ULL,
+		0x0001010101010100ULL, 0x0000000000000100ULL, 0x0000000000010100ULL, 0x0000000000000100ULL,
+		0x0000000001010100ULL, 0x0000000000000100ULL, 0x0000000000010100ULL, 0x0000000000000100ULL,
+		0x0000000101010100ULL, 0x0000000000000100ULL, 0x0000000000010100ULL, 0x0000000000000100ULL,
+		0x0000000001010100ULL, 0x0000000000000100ULL, 0x0000000000010100ULL, 0x0000000000000100ULL,
+		0x0000010101010100ULL, 0x0000000000000100ULL, 0x0000000000010100ULL, 0x0000000000000100ULL,
+		0x0000000001010100ULL, 0x0000000000000100ULL, 0x0000000000010100ULL, 0x0000000000000100ULL,
+		0x0000000101010100ULL, 0x0000000000000100ULL, 0x0000000000010100ULL, 0x0000000000000100ULL,
+		0x0000000001010100ULL, 0x0000000000000100ULL, 0x0000000000010100ULL, 0x0000000000000100ULL,
+	},
+	{
+		0x0101010101010001ULL, 0x0101010101010001ULL, 0x0000000000010001ULL, 0x0000000000010001ULL,
+		0x0000000001010001ULL, 0x0000000001010001ULL, 0x0000000000010001ULL, 0x0000000000010001ULL,
+		0x0000000101010001ULL, 0x0000000101010001ULL, 0x0000000000010001ULL, 0x0000000000010001ULL,
+		0x0000000001010001ULL, 0x0000000001010001ULL, 0x0000000000010001ULL, 0x0000000000010001ULL,
+		0x0000010101010001ULL, 0x0000010101010001ULL, 0x0000000000010001ULL, 0x0000000000010001ULL,
+		0x0000000001010001ULL, 0x0000000001010001ULL, 0x0000000000010001ULL, 0x0000000000010001ULL,
+		0x0000000101010001ULL, 0x0000000101010001ULL, 0x0000000000010001ULL, 0x0000000000010001ULL,
+		0x0000000001010001ULL, 0x0000000001010001ULL, 0x0000000000010001ULL, 0x0000000000010001ULL,
+		0x0001010101010001ULL, 0x0001010101010001ULL, 0x0000000000010001ULL, 0x0000000000010001ULL,
+		0x0000000001010001ULL, 0x0000000001010001ULL, 0x0000000000010001ULL, 0x0000000000010001ULL,
+		0x0000000101010001ULL, 0x0000000101010001ULL, 0x0000000000010001ULL, 0x0000000000010001ULL,
+		0x0000000001010001ULL, 0x0000000001010001ULL, 0x0000000000010001ULL, 0x0000000000010001ULL,
+		0x0000010101010001ULL, 0x0000010101010001ULL, 0x0000000000010001ULL, 0x0000000000010001ULL,
+		0x0000000001010001ULL, 0x0000000001010001ULL, 0x0000000000010001ULL, 0x0000000000010001ULL,
+		0x0000000101010001ULL, 0x0000000101010001ULL, 0x0000000000010001ULL, 0x0000000000010001ULL,
+		0x0000000001010001ULL, 0x0000000001010001ULL, 0x0000000000010001ULL, 0x0000000000010001ULL,
+	},
+	{
+		0x0101010101000101ULL, 0x0101010101000100ULL, 0x0101010101000101ULL, 0x0101010101000100ULL,
+		0x0000000001000101ULL, 0x0000000001000100ULL, 0x0000000001000101ULL, 0x0000000001000100ULL,
+		0x0000000101000101ULL, 0x0000000101000100ULL, 0x0000000101000101ULL, 0x0000000101000100ULL,
+		0x0000000001000101ULL, 0x0000000001000100ULL, 0x0000000001000101ULL, 0x0000000001000100ULL,
+		0x0000010101000101ULL, 0x0000010101000100ULL, 0x0000010101000101ULL, 0x0000010101000100ULL,
+		0x0000000001000101ULL, 0x0000000001000100ULL, 0x0000000001000101ULL, 0x0000000001000100ULL,
+		0x0000000101000101ULL, 0x0000000101000100ULL, 0x0000000101000101ULL, 0x0000000101000100ULL,
+		0x0000000001000101ULL, 0x0000000001000100ULL, 0x0000000001000101ULL, 0x0000000001000100ULL,
+		0x0001010101000101ULL, 0x0001010101000100ULL, 0x0001010101000101ULL, 0x0001010101000100ULL,
+		0x0000000001000101ULL, 0x0000000001000100ULL, 0x0000000001000101ULL, 0x0000000001000100ULL,
+		0x0000000101000101ULL, 0x0000000101000100ULL, 0x0000000101000101ULL, 0x0000000101000100ULL,
+		0x0000000001000101ULL, 0x0000000001000100ULL, 0x0000000001000101ULL, 0x0000000001000100ULL,
+		0x0000010101000101ULL, 0x0000010101000100ULL, 0x0000010101000101ULL, 0x0000010101000100ULL,
+		0x0000000001000101ULL, 0x0000000001000100ULL, 0x0000000001000101ULL, 0x0000000001000100ULL,
+		0x0000000101000101ULL, 0x0000000101000100ULL, 0x0000000101000101ULL, 0x0000000101000100ULL,
+		0x0000000001000101ULL, 0x0000000001000100ULL, 0x0000000001000101ULL, 0x0000000001000100ULL,
+	},
+	{
+		0x0101010100010101ULL, 0x0101010100010100ULL, 0x0101010100010000ULL, 0x0101010100010000ULL,
+		0x0101010100010101ULL, 0x0101010100010100ULL, 0x0101010100010000ULL, 0x0101010100010000ULL,
+		0x0000000100010101ULL, 0x0000000100010100ULL, 0x0000000100010000ULL, 0x0000000100010000ULL,
+		0x0000000100010101ULL, 0x0000000100010100ULL, 0x0000000100010000ULL, 0x0000000100010000ULL,
+		0x0000010100010101ULL, 0x0000010100010100ULL, 0x0000010100010000ULL, 0x0000010100010000ULL,
+		0x0000010100010101ULL, 0x0000010100010100ULL, 0x0000010100010000ULL, 0x0000010100010000ULL,
+		0x0000000100010101ULL, 0x0000000100010100ULL, 0x0000000100010000ULL, 0x0000000100010000ULL,
+		0x0000000100010101ULL, 0x0000000100010100ULL, 0x0000000100010000ULL, 0x0000000100010000ULL,
+		0x0001010100010101ULL, 0x0001010100010100ULL, 0x0001010100010000ULL, 0x0001010100010000ULL,
+		0x0001010100010101ULL, 0x0001010100010100ULL, 0x0001010100010000ULL, 0x0001010100010000ULL,
+		0x0000000100010101ULL, 0x0000000100010100ULL, 0x0000000100010000ULL, 0x0000000100010000ULL,
+		0x0000000100010101ULL, 0x0000000100010100ULL, 0x0000000100010000ULL, 0x0000000100010000ULL,
+		0x0000010100010101ULL, 0x0000010100010100ULL, 0x0000010100010000ULL, 0x0000010100010000ULL,
+		0x0000010100010101ULL, 0x0000010100010100ULL, 0x0000010100010000ULL, 0x0000010100010000ULL,
+		0x0000000100010101ULL, 0x0000000100010100ULL, 0x0000000100010000ULL, 0x0000000100010000ULL,
+		0x0000000100010101ULL, 0x0000000100010100ULL, 0x0000000100010000ULL, 0x0000000100010000ULL,
+	},
+	{
+		0x0101010001010101ULL, 0x0101010001010100ULL, 0x0101010001010000ULL, 0x0101010001010000ULL,
+		0x0101010001000000ULL, 0x0101010001000000ULL, 0x0101010001000000ULL, 0x0101010001000000ULL,
+		0x0101010001010101ULL, 0x0101010001010100ULL, 0x0101010001010000ULL, 0x0101010001010000ULL,
+		0x0101010001000000ULL, 0x0101010001000000ULL, 0x0101010001000000ULL, 0x0101010001000000ULL,
+		0x0000010001010101ULL, 0x0000010001010100ULL, 0x0000010001010000ULL, 0x0000010001010000ULL,
+		0x0000010001000000ULL, 0x0000010001000000ULL, 0x0000010001000000ULL, 0x0000010001000000ULL,
+		0x0000010001010101ULL, 0x0000010001010100ULL, 0x0000010001010000ULL, 0x0000010001010000ULL,
+		0x0000010001000000ULL, 0x0000010001000000ULL, 0x0000010001000000ULL, 0x0000010001000000ULL,
+		0x0001010001010101ULL, 0x0001010001010100ULL, 0x0001010001010000ULL, 0x0001010001010000ULL,
+		0x0001010001000000ULL, 0x0001010001000000ULL, 0x0001010001000000ULL, 0x0001010001000000ULL,
+		0x0001010001010101ULL, 0x0001010001010100ULL, 0x0001010001010000ULL, 0x0001010001010000ULL,
+		0x0001010001000000ULL, 0x0001010001000000ULL, 0x0001010001000000ULL, 0x0001010001000000ULL,
+		0x0000010001010101ULL, 0x0000010001010100ULL, 0x0000010001010000ULL, 0x0000010001010000ULL,
+		0x0000010001000000ULL, 0x0000010001000000ULL, 0x0000010001000000ULL, 0x0000010001000000ULL,
+		0x0000010001010101ULL, 0x0000010001010100ULL, 0x0000010001010000ULL, 0x0000010001010000ULL,
+		0x0000010001000000ULL, 0x0000010001000000ULL, 0x0000010001000000ULL, 0x0000010001000000ULL,
+	},
+	{
+		0x0101000101010101ULL, 0x0101000101010100ULL, 0x0101000101010000ULL, 0x0101000101010000ULL,
+		0x0101000101000000ULL, 0x0101000101000000ULL, 0x0101000101000000ULL, 0x0101000101000000ULL,
+		0x0101000100000000ULL, 0x0101000100000000ULL, 0x0101000100000000ULL, 0x0101000100000000ULL,
+		0x0101000100000000ULL, 0x0101000100000000ULL, 0x0101000100000000ULL, 0x0101000100000000ULL,
+		0x0101000101010101ULL, 0x0101000101010100ULL, 0x0101000101010000ULL, 0x0101000101010000ULL,
+		0x0101000101000000ULL, 0x0101000101000000ULL, 0x0101000101000000ULL, 0x0101000101000000ULL,
+		0x0101000100000000ULL, 0x0101000100000000ULL, 0x0101000100000000ULL, 0x0101000100000000ULL,
+		0x0101000100000000ULL, 0x0101000100000000ULL, 0x0101000100000000ULL, 0x0101000100000000ULL,
+		0x0001000101010101ULL, 0x0001000101010100ULL, 0x0001000101010000ULL, 0x0001000101010000ULL,
+		0x0001000101000000ULL, 0x0001000101000000ULL, 0x0001000101000000ULL, 0x0001000101000000ULL,
+		0x0001000100000000ULL, 0x0001000100000000ULL, 0x0001000100000000ULL, 0x0001000100000000ULL,
+		0x0001000100000000ULL, 0x0001000100000000ULL, 0x0001000100000000ULL, 0x0001000100000000ULL,
+		0x0001000101010101ULL, 0x0001000101010100ULL, 0x0001000101010000ULL, 0x0001000101010000ULL,
+		0x0001000101000000ULL, 0x0001000101000000ULL, 0x0001000101000000ULL, 0x0001000101000000ULL,
+		0x0001000100000000ULL, 0x0001000100000000ULL, 0x0001000100000000ULL, 0x0001000100000000ULL,
+		0x0001000100000000ULL, 0x0001000100000000ULL, 0x0001000100000000ULL, 0x0001000100000000ULL,
+	},
+	{
+		0x0100010101010101ULL, 0x0100010101010100ULL, 0x0100010101010000ULL, 0x0100010101010000ULL,
+		0x0100010101000000ULL, 0x0100010101000000ULL, 0x0100010101000000ULL, 0x0100010101000000ULL,
+		0x0100010100000000ULL, 0x0100010100000000ULL, 0x0100010100000000ULL, 0x0100010100000000ULL,
+		0x0100010100000000ULL, 0x0100010100000000ULL, 0x0100010100000000ULL, 0x0100010100000000ULL,
+		0x0100010000000000ULL, 0x0100010000000000ULL, 0x0100010000000000ULL, 0x0100010000000000ULL,
+		0x0100010000000000ULL, 0x0100010000000000ULL, 0x0100010000000000ULL, 0x0100010000000000ULL,
+		0x0100010000000000ULL, 0x0100010000000000ULL, 0x0100010000000000ULL, 0x0100010000000000ULL,
+		0x0100010000000000ULL, 0x0100010000000000ULL, 0x0100010000000000ULL, 0x0100010000000000ULL,
+		0x0100010101010101ULL, 0x0100010101010100ULL, 0x0100010101010000ULL, 0x0100010101010000ULL,
+		0x0100010101000000ULL, 0x0100010101000000ULL, 0x0100010101000000ULL, 0x0100010101000000ULL,
+		0x0100010100000000ULL, 0x0100010100000000ULL, 0x0100010100000000ULL, 0x0100010100000000ULL,
+		0x0100010100000000ULL, 0x0100010100000000ULL, 0x0100010100000000ULL, 0x0100010100000000ULL,
+		0x0100010000000000ULL, 0x0100010000000000ULL, 0x0100010000000000ULL, 0x0100010000000000ULL,
+		0x0100010000000000ULL, 0x0100010000000000ULL, 0x0100010000000000ULL, 0x0100010000000000ULL,
+		0x0100010000000000ULL, 0x0100010000000000ULL, 0x0100010000000000ULL, 0x0100010000000000ULL,
+		0x0100010000000000ULL, 0x0100010000000000ULL, 0x0100010000000000ULL, 0x0100010000000000ULL,
+	},
+	{
+		0x0001010101010101ULL, 0x0001010101010100ULL, 0x0001010101010000ULL, 0x0001010101010000ULL,
+		0x0001010101000000ULL, 0x0001010101000000ULL, 0x0001010101000000ULL, 0x0001010101000000ULL,
+		0x0001010100000000ULL, 0x0001010100000000ULL, 0x0001010100000000ULL, 0x0001010100000000ULL,
+		0x0001010100000000ULL, 0x0001010100000000ULL, 0x0001010100000000ULL, 0x0001010100000000ULL,
+		0x0001010000000000ULL, 0x0001010000000000ULL, 0x0001010000000000ULL, 0x0001010000000000ULL,
+		0x0001010000000000ULL, 0x0001010000000000ULL, 0x0001010000000000ULL, 0x0001010000000000ULL,
+		0x0001010000000000ULL, 0x0001010000000000ULL, 0x0001010000000000ULL, 0x0001010000000000ULL,
+		0x0001010000000000ULL, 0x0001010000000000ULL, 0x0001010000000000ULL, 0x0001010000000000ULL,
+		0x0001000000000000ULL, 0x0001000000000000ULL, 0x0001000000000000ULL, 0x0001000000000000ULL,
+		0x0001000000000000ULL, 0x0001000000000000ULL, 0x0001000000000000ULL, 0x0001000000000000ULL,
+		0x0001000000000000ULL, 0x0001000000000000ULL, 0x0001000000000000ULL, 0x0001000000000000ULL,
+		0x0001000000000000ULL, 0x0001000000000000ULL, 0x0001000000000000ULL, 0x0001000000000000ULL,
+		0x0001000000000000ULL, 0x0001000000000000ULL, 0x0001000000000000ULL, 0x0001000000000000ULL,
+		0x0001000000000000ULL, 0x0001000000000000ULL, 0x0001000000000000ULL, 0x0001000000000000ULL,
+		0x0001000000000000ULL, 0x0001000000000000ULL, 0x0001000000000000ULL, 0x0001000000000000ULL,
+		0x0001000000000000ULL, 0x0001000000000000ULL, 0x0001000000000000ULL, 0x0001000000000000ULL,
+	},
+};
+
+const Bitboard DiagonalMasks[NUM_SQUARES] = {
+	0x8040201008040200ULL, 0x0080402010080400ULL, 0x0000804020100800ULL, 0x0000008040201000ULL,
+	0x0000000080402000ULL, 0x0000000000804000ULL, 0x0000000000008000ULL, 0x0000000000000000ULL,
+	0x4020100804020000ULL, 0x8040201008040001ULL, 0x0080402010080002ULL, 0x0000804020100004ULL,
+	0x0000008040200008ULL, 0x0000000080400010ULL, 0x0000000000800020ULL, 0x0000000000000040ULL,
+	0x2010080402000000ULL, 0x4020100804000100ULL, 0x8040201008000201ULL, 0x0080402010000402ULL,
+	0x0000804020000804ULL, 0x0000008040001008ULL, 0x0000000080002010ULL, 0x0000000000004020ULL,
+	0x1008040200000000ULL, 0x2010080400010000ULL, 0x4020100800020100ULL, 0x8040201000040201ULL,
+	0x0080402000080402ULL, 0x0000804000100804ULL, 0x0000008000201008ULL, 0x0000000000402010ULL,
+	0x0804020000000000ULL, 0x1008040001000000ULL, 0x2010080002010000ULL, 0x4020100004020100ULL,
+	0x8040200008040201ULL, 0x0080400010080402ULL, 0x0000800020100804ULL, 0x0000000040201008ULL,
+	0x0402000000000000ULL, 0x0804000100000000ULL, 0x1008000201000000ULL, 0x2010000402010000ULL,
+	0x4020000804020100ULL, 0x8040001008040201ULL, 0x0080002010080402ULL, 0x0000004020100804ULL,
+	0x0200000000000000ULL, 0x0400010000000000ULL, 0x0800020100000000ULL, 0x1000040201000000ULL,
+	0x2000080402010000ULL, 0x4000100804020100ULL, 0x8000201008040201ULL, 0x0000402010080402ULL,
+	0x0000000000000000ULL, 0x0001000000000000ULL, 0x0002010000000000ULL, 0x0004020100000000ULL,
+	0x0008040201000000ULL, 0x0010080402010000ULL, 0x0020100804020100ULL, 0x0040201008040201ULL,
+};
+
+const Bitboard AntiDiagonalMasks[NUM_SQUARES] = {
+	0x0000000000000000ULL, 0x0000000000000100ULL, 0x0000000000010200ULL, 0x0000000001020400ULL,
+	0x0000000102040800ULL, 0x0000010204081000ULL, 0x0001020408102000ULL, 0x0102040810204000ULL,
+	0x0000000000000002ULL, 0x0000000000010004ULL, 0x0000000001020008ULL, 0x0000000102040010ULL,
+	0x0000010204080020ULL, 0x0001020408100040ULL, 0x0102040810200080ULL, 0x0204081020400000ULL,
+	0x0000000000000204ULL, 0x0000000001000408ULL, 0x0000000102000810ULL, 0x0000010204001020ULL,
+	0x0001020408002040ULL, 0x0102040810004080ULL, 0x0204081020008000ULL, 0x0408102040000000ULL,
+	0x0000000000020408ULL, 0x0000000100040810ULL, 0x0000010200081020ULL, 0x0001020400102040ULL,
+	0x0102040800204080ULL, 0x0204081000408000ULL, 0x0408102000800000ULL, 0x0810204000000000ULL,
+	0x0000000002040810ULL, 0x0000010004081020ULL, 0x0001020008102040ULL, 0x0102040010204080ULL,
+	0x0204080020408000ULL, 0x0408100040800000ULL, 0x0810200080000000ULL, 0x1020400000000000ULL,
+	0x0000000204081020ULL, 0x0001000408102040ULL, 0x0102000810204080ULL, 0x0204001020408000ULL,
+	0x0408002040800000ULL, 0x0810004080000000ULL, 0x1020008000000000ULL, 0x2040000000000000ULL,
+	0x0000020408102040ULL, 0x0100040810204080ULL, 0x0200081020408000ULL, 0x0400102040800000ULL,
+	0x0800204080000000ULL, 0x1000408000000000ULL, 0x2000800000000000ULL, 0x4000000000000000ULL,
+	0x0002040810204080ULL, 0x0004081020408000ULL, 0x0008102040800000ULL, 0x0010204080000000ULL,
+	0x0020408000000000ULL, 0x0040800000000000ULL, 0x0080000000000000ULL, 0x0000000000000000ULL,
+};
+
+const Bitboard KnightAttackTable[NUM_SQUARES] = {
+	0x0000000000020400ULL, 0x0000000000050800ULL, 0x00000000000A1100ULL, 0x0000000000142200ULL,
+	0x0000000000284400ULL, 0x0000000000508800ULL, 0x0000000000A01000ULL, 0x0000000000402000ULL,
+	0x0000000002040004ULL, 0x0000000005080008ULL, 0x000000000A110011ULL, 0x0000000014220022ULL,
+	0x0000000028440044ULL, 0x0000000050880088ULL, 0x00000000A0100010ULL, 0x0000000040200020ULL,
+	0x0000000204000402ULL, 0x0000000508000805ULL, 0x0000000A1100110AULL, 0x0000001422002214ULL,
+	0x0000002844004428ULL, 0x0000005088008850ULL, 0x000000A0100010A0ULL, 0x0000004020002040ULL,
+	0x0000020400040200ULL, 0x0000050800080500ULL, 0x00000A1100110A00ULL, 0x0000142200221400ULL,
+	0x0000284400442800ULL, 0x0000508800885000ULL, 0x0000A0100010A000ULL, 0x0000402000204000ULL,
+	0x0002040004020000ULL, 0x0005080008050000ULL, 0x000A1100110A0000ULL, 0x0014220022140000ULL,
+	0x0028440044280000ULL, 0x0050880088500000ULL, 0x00A0100010A00000ULL, 0x0040200020400000ULL,
+	0x0204000402000000ULL, 0x0508000805000000ULL, 0x0A1100110A000000ULL, 0x1422002214000000ULL,
+	0x2844004428000000ULL, 0x5088008850000000ULL, 0xA0100010A0000000ULL, 0x4020002040000000ULL,
+	0x0400040200000000ULL, 0x0800080500000000ULL, 0x1100110A00000000ULL, 0x2200221400000000ULL,
+	0x4400442800000000ULL, 0x8800885000000000ULL, 0x100010A000000000ULL, 0x2000204000000000ULL,
+	0x0004020000000000ULL, 0x0008050000000000ULL, 0x00110A0000000000ULL, 0x0022140000000000ULL,
+	0x0044280000000000ULL, 0x0088500000000000ULL, 0x0010A00000000000ULL, 0x0020400000000000ULL,
+};
+
+const Bitboard KingAttackTable[NUM_SQUARES] = {
+	0x0000000000000302ULL, 0x0000000000000705ULL, 0x0000000000000E0AULL, 0x0000000000001C14ULL,
+	0x0000000000003828ULL, 0x0000000000007050ULL, 0x000000000000E0A0ULL, 0x000000000000C040ULL,
+	0x0000000000030203ULL, 0x0000000000070507ULL, 0x00000000000E0A0EULL, 0x00000000001C141CULL,
+	0x0000000000382838ULL, 0x0000000000705070ULL, 0x0000000000E0A0E0ULL, 0x0000000000C040C0ULL,
+	0x0000000003020300ULL, 0x0000000007050700ULL, 0x000000000E0A0E00ULL, 0x000000001C141C00ULL,
+	0x0000000038283800ULL, 0x0000000070507000ULL, 0x00000000E0A0E000ULL, 0x00000000C040C000ULL,
+	0x0000000302030000ULL, 0x0000000705070000ULL, 0x0000000E0A0E0000ULL, 0x0000001C141C0000ULL,
+	0x0000003828380000ULL, 0x0000007050700000ULL, 0x000000E0A0E00000ULL, 0x000000C040C00000ULL,
+	0x0000030203000000ULL, 0x0000070507000000ULL, 0x00000E0A0E000000ULL, 0x00001C141C000000ULL,
+	0x0000382838000000ULL, 0x0000705070000000ULL, 0x0000E0A0E0000000ULL, 0x0000C040C0000000ULL,
+	0x0003020300000000ULL, 0x0007050700000000ULL, 0x000E0A0E00000000ULL, 0x001C141C00000000ULL,
+	0x0038283800000000ULL, 0x0070507000000000ULL, 0x00E0A0E000000000ULL, 0x00C040C000000000ULL,
+	0x0302030000000000ULL, 0x0705070000000000ULL, 0x0E0A0E0000000000ULL, 0x1C141C0000000000ULL,
+	0x3828380000000000ULL, 0x7050700000000000ULL, 0xE0A0E00000000000ULL, 0xC040C00000000000ULL,
+	0x0203000000000000ULL, 0x0507000000000000ULL, 0x0A0E000000000000ULL, 0x141C000000000000ULL,
+	0x2838000000000000ULL, 0x5070000000000000ULL, 0xA0E0000000000000ULL, 0x40C0000000000000ULL,
+};
+
+const Bitboard PawnAttackTable[NUM_PIECE_OWNERS - 1][NUM_SQUARES] = {
+	{
+		0x0000000000000200ULL, 0x0000000000000500ULL, 0x0000000000000A00ULL, 0x0000000000001400ULL,
+		0x0000000000002800ULL, 0x0000000000005000ULL, 0x000000000000A000ULL, 0x0000000000004000ULL,
+		0x0000000000020000ULL, 0x0000000000050000ULL, 0x00000000000A0000ULL, 0x0000000000140000ULL,
+		0x0000000000280000ULL, 0x0000000000500000ULL, 0x0000000000A00000ULL, 0x0000000000400000ULL,
+		0x0000000002000000ULL, 0x0000000005000000ULL, 0x000000000A000000ULL, 0x0000000014000000ULL,
+		0x0000000028000000ULL, 0x0000000050000000ULL, 0x00000000A0000000ULL, 0x0000000040000000ULL,
+		0x0000000200000000ULL, 0x0000000500000000ULL, 0x0000000A00000000ULL, 0x0000001400000000ULL,
+		0x0000002800000000ULL, 0x0000005000000000ULL, 0x000000A000000000ULL, 0x0000004000000000ULL,
+		0x0000020000000000ULL, 0x0000050000000000ULL, 0x00000A0000000000ULL, 0x0000140000000000ULL,
+		0x0000280000000000ULL, 0x0000500000000000ULL, 0x0000A00000000000ULL, 0x0000400000000000ULL,
+		0x0002000000000000ULL, 0x0005000000000000ULL, 0x000A000000000000ULL, 0x0014000000000000ULL,
+		0x0028000000000000ULL, 0x0050000000000000ULL, 0x00A0000000000000ULL, 0x0040000000000000ULL,
+		0x0200000000000000ULL, 0x0500000000000000ULL, 0x0A00000000000000ULL, 0x1400000000000000ULL,
+		0x2800000000000000ULL, 0x5000000000000000ULL, 0xA000000000000000ULL, 0x4000000000000000ULL,
+		0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL,
+		0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL,
+	},
+	{
+		0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL,
+		0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL,
+		0x0000000000000002ULL, 0x0000000000000005ULL, 0x000000000000000AULL, 0x0000000000000014ULL,
+		0x0000000000000028ULL, 0x0000000000000050ULL, 0x00000000000000A0ULL, 0x0000000000000040ULL,
+		0x0000000000000200ULL, 0x0000000000000500ULL, 0x0000000000000A00ULL, 0x0000000000001400ULL,
+		0x0000000000002800ULL, 0x0000000000005000ULL, 0x000000000000A000ULL, 0x0000000000004000ULL,
+		0x0000000000020000ULL, 0x0000000000050000ULL, 0x00000000000A0000ULL, 0x0000000000140000ULL,
+		0x0000000000280000ULL, 0x0000000000500000ULL, 0x0000000000A00000ULL, 0x0000000000400000ULL,
+		0x0000000002000000ULL, 0x0000000005000000ULL, 0x000000000A000000ULL, 0x0000000014000000ULL,
+		0x0000000028000000ULL, 0x0000000050000000ULL, 0x00000000A0000000ULL, 0x0000000040000000ULL,
+		0x0000000200000000ULL, 0x0000000500000000ULL, 0x0000000A00000000ULL, 0x0000001400000000ULL,
+		0x0000002800000000ULL, 0x0000005000000000ULL, 0x000000A000000000ULL, 0x0000004000000000ULL,
+		0x0000020000000000ULL, 0x0000050000000000ULL, 0x00000A0000000000ULL, 0x0000140000000000ULL,
+		0x0000280000000000ULL, 0x0000500000000000ULL, 0x0000A00000000000ULL, 0x0000400000000000ULL,
+		0x0002000000000000ULL, 0x0005000000000000ULL, 0x000A000000000000ULL, 0x0014000000000000ULL,
+		0x0028000000000000ULL, 0x0050000000000000ULL, 0x00A0000000000000ULL, 0x0040000000000000ULL,
+	},
+};
+
+const Bitboard PawnPushTable[NUM_PIECE_OWNERS - 1][NUM_SQUARES] = {
+	{
+		0x0000000000000100ULL, 0x0000000000000200ULL, 0x0000000000000400ULL, 0x0000000000000800ULL,
+		0x0000000000001000ULL, 0x0000000000002000ULL, 0x0000000000004000ULL, 0x0000000000008000ULL,
+		0x0000000000010000ULL, 0x0000000000020000ULL, 0x0000000000040000ULL, 0x0000000000080000ULL,
+		0x0000000000100000ULL, 0x0000000000200000ULL, 0x0000000000400000ULL, 0x0000000000800000ULL,
+		0x0000000001000000ULL, 0x0000000002000000ULL, 0x0000000004000000ULL, 0x0000000008000000ULL,
+		0x0000000010000000ULL, 0x0000000020000000ULL, 0x0000000040000000ULL, 0x0000000080000000ULL,
+		0x0000000100000000ULL, 0x0000000200000000ULL, 0x0000000400000000ULL, 0x0000000800000000ULL,
+		0x0000001000000000ULL, 0x0000002000000000ULL, 0x0000004000000000ULL, 0x0000008000000000ULL,
+		0x0000010000000000ULL, 0x0000020000000000ULL, 0x0000040000000000ULL, 0x0000080000000000ULL,
+		0x0000100000000000ULL, 0x0000200000000000ULL, 0x0000400000000000ULL, 0x0000800000000000ULL,
+		0x0001000000000000ULL, 0x0002000000000000ULL, 0x0004000000000000ULL, 0x0008000000000000ULL,
+		0x0010000000000000ULL, 0x0020000000000000ULL, 0x0040000000000000ULL, 0x0080000000000000ULL,
+		0x0100000000000000ULL, 0x0200000000000000ULL, 0x0400000000000000ULL, 0x0800000000000000ULL,
+		0x1000000000000000ULL, 0x2000000000000000ULL, 0x4000000000000000ULL, 0x8000000000000000ULL,
+		0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL,
+		0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL,
+	},
+	{
+		0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL,
+		0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL,
+		0x0000000000000001ULL, 0x0000000000000002ULL, 0x0000000000000004ULL, 0x0000000000000008ULL,
+		0x0000000000000010ULL, 0x0000000000000020ULL, 0x0000000000000040ULL, 0x0000000000000080ULL,
+		0x0000000000000100ULL, 0x0000000000000200ULL, 0x0000000000000400ULL, 0x0000000000000800ULL,
+		0x0000000000001000ULL, 0x0000000000002000ULL, 0x0000000000004000ULL, 0x0000000000008000ULL,
+		0x0000000000010000ULL, 0x0000000000020000ULL, 0x0000000000040000ULL, 0x0000000000080000ULL,
+		0x0000000000100000ULL, 0x0000000000200000ULL, 0x0000000000400000ULL, 0x0000000000800000ULL,
+		0x0000000001000000ULL, 0x0000000002000000ULL, 0x0000000004000000ULL, 0x0000000008000000ULL,
+		0x0000000010000000ULL, 0x0000000020000000ULL, 0x0000000040000000ULL, 0x0000000080000000ULL,
+		0x0000000100000000ULL, 0x0000000200000000ULL, 0x0000000400000000ULL, 0x0000000800000000ULL,
+		0x0000001000000000ULL, 0x0000002000000000ULL, 0x0000004000000000ULL, 0x0000008000000000ULL,
+		0x0000010000000000ULL, 0x0000020000000000ULL, 0x0000040000000000ULL, 0x0000080000000000ULL,
+		0x0000100000000000ULL, 0x0000200000000000ULL, 0x0000400000000000ULL, 0x0000800000000000ULL,
+		0x0001000000000000ULL, 0x0002000000000000ULL, 0x0004000000000000ULL, 0x0008000000000000ULL,
+		0x0010000000000000ULL, 0x0020000000000000ULL, 0x0040000000000000ULL, 0x0080000000000000ULL,
+	},
+};
+
+const uint64_t ZobristPieceKeys[NUM_PIECE_OWNERS - 1][NUM_PIECE_TYPES - 1][NUM_SQUARES] = {
+	{
+		{
+			0x0D83B3E29A21487AULL, 0x54C44C79F1FE9D67ULL, 0xA845F342007A0E78ULL, 0x7D6E0B878A794779ULL,
+			0x90D8D6E5A10DD485ULL, 0x9DE6CF0F6D5A586EULL, 0xD566404840A2AB9DULL, 0x674BFECE098C4828ULL,
+			0x87D6E3D2AFC200ACULL, 0xD2F57AC518CBB99DULL, 0x002A74B4AEB82DB2ULL, 0xBC858F30D87296D1ULL,
+			0x26D141D7B47A58A8ULL, 0xEC0202237FAA74FDULL, 0x13404CD3E565DFA1ULL, 0x54B07C175848B28DULL,
+			0x25072963263F0842ULL, 0x02ECC50074CCCF5FULL, 0xDACD1F060D908A3DULL, 0x3C9AE8905BD77AE6ULL,
+			0x9F7BC7DB18D2566CULL, 0xAC76AEB5A047DBC6ULL, 0xB71EB0AE33B29F39ULL, 0x3DF20C533DCC306CULL,
+			0xABCDBAA682DE9209ULL, 0x6786D31B243AC0A4ULL, 0x849D9D80831E02D9ULL, 0xE2C9AB92EF636718ULL,
+			0x0296F3277CFD51ACULL, 0x0BE60E507909C1FDULL, 0x7956B9155FFD2ADBULL, 0x88A5489881B0E754ULL,
+			0xC99E7D7A6B1D3CCDULL, 0x0DB292F12F361B02ULL, 0xE7E8D30A316965CFULL, 0x88048DB0941040FBULL,
+			0x1D1BBC9E745ED9C7ULL, 0x22717EEF126D3A5AULL, 0x834BC6881BE7BFC5ULL, 0x1301453FC472F3F7ULL,
+			0x24A212ADF6CFEEE2ULL, 0xEEF2FC479582DAD0ULL, 0x7BB62743D4A82368ULL, 0xE7B4EF83DC7C569AULL,
+			0x1C97D6C17A1CE09BULL, 0xAEB34774571E0746ULL, 0x8DACA89158B251F3ULL, 0xFAFF30D01D4B1980ULL,
+			0xEC4798F19082AB12ULL, 0xE5215DB40AB9CE72ULL, 0xC3E9CE5AEDCECE77ULL, 0x49D1DCFB32D131EDULL,
+			0x918E9E3E333146E3ULL, 0x50D51696787F55B4ULL, 0xAA58A03BE88D5002ULL, 0xDA37A1FD3C69FEBCULL,
+			0x22FB986FBA1247F5ULL, 0x2CD822CEC6864769ULL, 0x2F8B786E4EA0081EULL, 0x993065D78EA4114DULL,
+			0x2B4BBEC88B15FC32ULL, 0xF5E013034672AD9EULL, 0x9C29A128FD9EF57CULL, 0x1636F8E20698E92DULL,
+		},
+		{
+			0xF45A4999063C350FULL, 0x16513F36F7CB2F45ULL, 0x20CE772C97AD0958ULL, 0x8E8C2E8E1C50C30AULL,
+			0x8F90BC11DE2C3B28ULL, 0x1D9CD265CAF9AAAEULL, 0x85E846DD95161004ULL, 0xCBA1C108A6DE41C7ULL,
+			0x1A5C7D55F70F690CULL, 0xDF299A6336A13A58ULL, 0xB51970AD741828D5ULL, 0x2150FF5E05151306ULL,
+			0x8E9E171E8959989EULL, 0xC1560FA6A2C6A718ULL, 0x401F06C6C16C1346ULL, 0x22CB9BE13E9F2B4BULL,
+			0xDB6E9ABF1BD51537ULL, 0x59CE4401BED86164ULL, 0x23A0BD555B58C420ULL, 0xFD6402DDE56B1FD6ULL,
+			0xF03B990BF89BD645ULL, 0x607E3CD84C201DE6ULL, 0x4EF15DE9FF656DA2ULL, 0xD527A619652F472FULL,
+			0x22FF9CD34B252992ULL, 0x0F7A4199AB0018F9ULL, 0x789C99B9B7104BFCULL, 0x047E5413EF331597ULL,
+			0x31E064E2BA08761BULL, 0xF2A4CDF6B08CCFACULL, 0xF9BB2C6AA3B74B51ULL, 0x6E649BE9309A7AADULL,
+			0x788BA774A28D717DULL, 0x3B786508B3474F50ULL, 0x7A92ACA2442CC9AFULL, 0x0F3D9DE53F6EF4B2ULL,
+			0x2983CEB87BD3BFA0ULL, 0x81C12D1D5E35716DULL, 0xA9490F9724BE51EFULL, 0x090C066CE32F7B0FULL,
+			0x6736980B063D46FCULL, 0x22B6F7BA6874F40EULL, 0x13AEFBB6611D895EULL, 0x8F253558E6843A7AULL,
+			0x51EBB86D8D0C734DULL, 0x90180EDCFF467A55ULL, 0x04427A2D1FAF915EULL, 0xD4867309EEFBA770ULL,
+			0x1AEA2E225B7214BCULL, 0x2E50398765648C31ULL, 0x76431F96F583C75BULL, 0x280033594D19939EULL,
+			0x58190CE2C2414047ULL, 0x1327051BEB2689C5ULL, 0xB3144734100136CDULL, 0x4F7A4D14869444CEULL,
+			0xED9E20549B1B7B78ULL, 0xC5EE11EC791B3496ULL, 0x9947308E5EEDFFEFULL, 0x316C9690EE0C70D1ULL,
+			0x7FEA0E38A55133A5ULL, 0xC0DC7FE4035C2A04ULL, 0x24FC0C1BF156A11BULL, 0xA572C6B5864BA0D0ULL,
+		},
+		{
+			0x88DB05EBFDDC3595ULL, 0x0BC67A3122477386ULL, 0x77EDF125663C7432ULL, 0x6867A15651B04305ULL,
+			0xF592CF31B758CD24ULL, 0xB669F0D1DEDD2E28ULL, 0x8CA1DE1C7DEAFEA2ULL, 0x0909942274B9B172ULL,
+			0x0449DF7D0945D7C6ULL, 0xC01ADBF218811247ULL, 0xC10BCFE747655EABULL, 0x2E1D1A15EE91C75AULL,
+			0x41CFE0FBC4FC3C46ULL, 0x368BB671FCD0DCABULL, 0xAA3E00EEAC2E55FBULL, 0xA06EA8985C782934ULL,
+			0x564BB5206784E31CULL, 0x4B4A4C675825D403ULL, 0x3FC0A672CE011F9AULL, 0xF894B2069ED3BAA1ULL,
+			0xB78236ECB3BC7FC7ULL, 0x22028AB89C3BD9D5ULL, 0x1A4BAF5A322E6BFCULL, 0x28210B625E28BF1BULL,
+			0xF3E95FEDB46B2AFEULL, 0x580923E26247E3C8ULL, 0x8DC44786994E29D9ULL, 0xB1F392D67E3942B3ULL,
+			0x873C4851DFCDE1DCULL, 0x42FE93D5DBAAB15AULL, 0xB26165E06734BBDCULL, 0x42619D700FE8CCC6ULL,
+			0x900B4F50F056A8EBULL, 0x8D71E9D793AD44ACULL, 0x415A7734FB443813ULL, 0xE2896F17C14DFCD3ULL,
+			0xDB5C91E1D58193ECULL, 0x562EE5858D0706A9ULL, 0x7749B33661E31373ULL, 0x8CA5E072B1779C58ULL,
+			0x37056D9DD0908885ULL, 0xD05E1DF029239DB5ULL, 0x0E3CFCB291BFEDD0ULL, 0xD100E7D72114B9B5ULL,
+			0xAA0FD4D74BCE46D7ULL, 0x1BA005CDE3A759F5ULL, 0xB7EB75C4D7552F10ULL, 0x9AD08804F3C63CE9ULL,
+			0x584781CC7E12955BULL, 0x8FE04A8B6F754118ULL, 0x8478617A71514673ULL, 0x4A15E97704A221A2ULL,
+			0x0C0199E5FD62FB31ULL, 0xD6821937ACFA0D14ULL, 0x3A16306F71F1609EULL, 0x87854F5910CBFCC2ULL,
+			0x6B40B6C52EAA0111ULL, 0xC22335DF5F82A553ULL, 0x01CD54F7D6B1590AULL, 0xC89E771698361EE2ULL,
+			0xBC6C1A787108417DULL, 0xEA4BEFEFEED2EA6AULL, 0x5A4D99192D2DB52DULL, 0xCA5D09BB770227D6ULL,
+		},
+		{
+			0x9C67809021DBB8F7ULL, 0x01D6BFB0B2AEADB3ULL, 0x117E2265A41E3AF6ULL, 0x7E646F83EF7F574AULL,
+			0x09A35CB31619144BULL, 0x00935950923B5EBCULL, 0xC11D3B09D3843FE3ULL, 0xDD15E00D40A66863ULL,
+			0x74DB9E5CABDB3D65ULL, 0xC0691EE84AD531B1ULL, 0x2943D8AF6F18DBABULL, 0xFC9BA5ABBDFB7EC3ULL,
+			0xAC930CBEA81EBE4EULL, 0xF0E4D4E7AEA01F97ULL, 0x723E0750A256BCD5ULL, 0xEA12DEC97762A563ULL,
+			0x42BFA136FB470C95ULL, 0x22A9D11EEAF9DD00ULL, 0x0EC2B57ABAD69BE5ULL, 0x0581E3F1E9F98734ULL,
+			0xF515A4AD972533B0ULL, 0x58F3FCE7352F740EULL, 0x031325CF02AE8527ULL, 0xD38A8CDEB00EC899ULL,
+			0x0035ED9CCE51CAFBULL, 0xBFAEC149D824AA9DULL, 0x2D9344D7980E1EA0ULL, 0x0B5FE23B9C74B013ULL,
+			0xEBB8DCB72A9610D2ULL, 0xE885E97DEF050487ULL, 0x9539649E72C08486ULL, 0xF39D2F24C62FB8BFULL,
+			0x38181065DA35C1D0ULL, 0x3C058FE39CDE9D71ULL, 0x15ABE19D426D9585ULL, 0xCCD957269FE4BEBDULL,
+			0x5E456F05DA713295ULL, 0xA40B9264A8D71050ULL, 0x519BACAB1BB9CA5BULL, 0xDCADB6DBD56D7843ULL,
+			0xBC8D2E831392B4A6ULL, 0x55EF9EAFBB3CCEC0ULL, 0xD2617334124B6E15ULL, 0x889383E0DA3753AFULL,
+			0x350B01C11C827908ULL, 0xAD971EA9F0A64B9BULL, 0x0C22BCEA6460B9F2ULL, 0xD9589D6BB89933AAULL,
+			0xF235F49C27A4F6D2ULL, 0x97EB1F74ACA9FDF1ULL, 0x3FAE2EFDD6B174B2ULL, 0x9C63D02EADE2FF56ULL,
+			0x1B53D4A260F4C976ULL, 0x5C6BB8C4B1D51CA0ULL, 0x1A62543C3EEBD7D6ULL, 0x80F8CDA7D0A288CDULL,
+			0x509562DB09123352ULL, 0xC71E98E16435977FULL, 0xEC47425150958FA4ULL, 0xF8F6C1042F59719FULL,
+			0x28C845D482D5C643ULL, 0x56A4FB6DDE1B056CULL, 0x33433C7CDEEBB9DFULL, 0x4197C5087894D2C6ULL,
+		},
+		{
+			0xAA89EE3616B2696BULL, 0x85E9FF5F7B408003ULL, 0xC86EEAE8CECBDB16ULL, 0x6D4C16105075F7F2ULL,
+			0xBA07C9B7292A73CBULL, 0x8F3268D70F8B7A44ULL, 0x23FCC18404A3068BULL, 0x0790CCE85D125F85ULL,
+			0xF62E8B1AF6BD3E7EULL, 0x75CC02968C803278ULL, 0x4F7BF90188BACEF6ULL, 0x0E5E3FECFAA58539ULL,
+			0x2F55EBC6CE5DB424ULL, 0xDFC2972BA6DAAC11ULL, 0x3901786209821492ULL, 0x65B4D987CBF06A61ULL,
+			0x233010965342F61EULL, 0x421636DFBD754D7EULL, 0xA4E72B5CAD632711ULL, 0x6F57C65117DCC97EULL,
+			0x0BD29E61468E9BF4ULL, 0x18EBA022E4A0E9A2ULL, 0xB6FE1612CA0ACB27ULL, 0xB7D8295C32275247ULL,
+			0xFE5CD90D412BD652ULL, 0xB831691199F6595DULL, 0x56ECBE6A85FB008AULL, 0xE467BAFB4C0A0046ULL,
+			0xC762FB58CC7A4ACBULL, 0x3C662857E29F4D9EULL, 0x289CAC99518D1CEAULL, 0xF4A282A8F09AEAACULL,
+			0x4D728D1DA98A8F69ULL, 0x150C90DABF606DA4ULL, 0x21FAE041D245514CULL, 0x4E9F138B57FB7424ULL,
+			0xF3EFA7E0AAE5C239ULL, 0x36F951EF77EF4A50ULL, 0xC84107615BFB3CD1ULL, 0xFC5EF91DE7DBAC66ULL,
+			0x09D206A9D13D1D2DULL, 0x8733E1B9024FA48DULL, 0x95E1B10513E438FEULL, 0x8DE3B1AAB31713C2ULL,
+			0x05BE603BB1CBB322ULL, 0x7371E49DF88486E2ULL, 0x0EFE03683A358D43ULL, 0x4D7DA3DF59592AFCULL,
+			0x4E46D2A041869078ULL, 0x21F3BFA17D2B9511ULL, 0x33C9B6AEB21525B5ULL, 0x5140EDA3CE5788ECULL,
+			0x2BD0551FB927D6C6ULL, 0x28739C33D943359EULL, 0x202E67E7831206BEULL, 0x8DEE483D124723CCULL,
+			0xE0876C3ADCBF5DDEULL, 0x0D2C7DD1D4A4E705ULL, 0x1E6EC80A48858B4DULL, 0xA9FAD798A50A7F0FULL,
+			0x86B788652CDBEC87ULL, 0xC58DF2F7BFFB77DCULL, 0xF2C5BC1C7D7FC295ULL, 0xA00344EA9E823672ULL,
+		},
+		{
+			0x26FB3E61451A01B4ULL, 0x478C60AB74E606BDULL, 0xF3B42E04601C6EC1ULL, 0x40340EB099768800ULL,
+			0x175879E720095DBEULL, 0x0100E9388BB59772ULL, 0x2F7BA67B50896528ULL, 0xD24E5ACBA311F984ULL,
+			0xEE922C015CA3E86EULL, 0xF06B2EFC819791B1ULL, 0xE191D9319B18D9D0ULL, 0x7138FA38D3F239FBULL,
+			0xE76BF33EE706094AULL, 0x4F6D060D83CB6877ULL, 0xFD9DF0C0150FAFE4ULL, 0xEDD6A2E5A19DBFC8ULL,
+			0x832083CBAA733A32ULL, 0x58123D1C60E89A6EULL, 0x986A7BAB4FC21968ULL, 0x926D26FDE78C75E9ULL,
+			0x8D94E9E6E139A61CULL, 0xE6BB169303131CC0ULL, 0x040DD5F438660F19ULL, 0xF2C6245B19A74F4AULL,
+			0xD9145F75F78AF5DEULL, 0x576B0BE485015193ULL, 0x78EBAFC2EB1F410BULL, 0xAF4F226CB9A1A397ULL,
+			0x2442CE53E4422CDDULL, 0x91EA3AD7073BA585ULL, 0x8F66A77570F21FDDULL, 0x3EC9A6EBF0E0B738ULL,
+			0xEAAC954689013348ULL, 0x652D32A28B0CDCD4ULL, 0xC1179E9B5429D1FFULL, 0xBE79C7CE073EA2DAULL,
+			0xEDF596C0A2AC34F5ULL, 0x962434C163C74E92ULL, 0xD0DD806CD20D34F2ULL, 0x2AD04B17A68B4C60ULL,
+			0xBE2B9F01A1BF546DULL, 0x996C52053AE52FE7ULL, 0x0740B48D70B29950ULL, 0x585BB3FD72C9B9CEULL,
+			0x329E343D3078253FULL, 0x58DE5AA3BB7AF670ULL, 0xDB8AB4CD92D3FFF9ULL, 0x03D8987FE5C97184ULL,
+			0x6CF9CACAB66E2998ULL, 0x957AB8444AC4C6A7ULL, 0x5E43C3277DEC2B61ULL, 0xBB87375F487D1BA9ULL,
+			0xF87AD7DD7B5BFD45ULL, 0x8AC052203FCE4F28ULL, 0x0A6807AD974B37C7ULL, 0x4C4B7BAA6464292CULL,
+			0x3BCA04199E8327ABULL, 0x5B18E5417217EC76ULL, 0xDE4EBAF4319BC222ULL, 0xE4CCC9C5173B5996ULL,
+			0xF0E72BEAA6E7A31AULL, 0x8458F7FB9A6FF014ULL, 0x76BD62858AA75409ULL, 0x95CA61FFFB45A499ULL,
+		},
+	},
+	{
+		{
+			0x4CE6F6F39A90416BULL, 0x4CEC8D19B2E04109ULL, 0xA7904BE89EAEC54FULL, 0x799F257E9ACEB66AULL,
+			0xA109B6A3C667647CULL, 0x2CE874930FDFD20CULL, 0x642C9F1C416DBD3BULL, 0x7D0E54353961C123ULL,
+			0xABE9CD81B4661969ULL, 0x84441C75EB15E8C9ULL, 0x626A421BCC668E10ULL, 0xBF5E32FE26B37132ULL,
+			0xF4804EA2FEA4CDDDULL, 0xCA0E65ADD4B602E9ULL, 0x32F83B63425490A0ULL, 0xAE463D54A9B6CB8BULL,
+			0xDB28AA51E7ADBEF4ULL, 0x940991D182048428ULL, 0x3DE4E1692D7B5368ULL, 0xB755CCF43B045CF1ULL,
+			0xF4FC9CDB02A90210ULL, 0x19F6C1B29BDD412DULL, 0x5C0408B6122AA430ULL, 0x7232011D01298504ULL,
+			0x226AD8B4C28B7A86ULL, 0x829EA3F17D56E517ULL, 0x2F991824F3BE0658ULL, 0x1BD0034A8A04D4B6ULL,
+			0x03B015A02F5F08ACULL, 0xDEE6EEA11042792AULL, 0x1FEC61FFD9A34A3FULL, 0x25FCC84E99A131F3ULL,
+			0xC18DC76F0C61302EULL, 0x7BA1A5BADB4BD1A8ULL, 0x201BF5CBF48163F1ULL, 0xF6FFE96AED077972ULL,
+			0x4C25D3329F98FE9AULL, 0x79583B7DE08AFC74ULL, 0xB94D55E355BE6242ULL, 0xC79606D79B927941ULL,
+			0xE10650DEE4299402ULL, 0xDC7EAA2FEADE5232ULL, 0xA9769DE6FA0F4CE4ULL, 0x3E1BE6E7350A2AC8ULL,
+			0x056AE8E3DE05B1B1ULL, 0x686BA6D0DB6C8E4AULL, 0x21FA5F9E1DE7AEE2ULL, 0xD09759D22A566993ULL,
+			0x4887460BC004CF15ULL, 0x87A2A72B4A44939FULL, 0x83F30C39F28ADFCDULL, 0xAAB06D0475061092ULL,
+			0x5DB6A7A6226C4BEDULL, 0x8034368763978FC2ULL, 0x218125190ACB39BAULL, 0xFD7F5BF522870700ULL,
+			0x5363EBB90D967EA9ULL, 0x4636E4B10D30546FULL, 0xD0621FB75A500C60ULL, 0xAA68D53BCF174B9CULL,
+			0xF315B29EE49C109CULL, 0xCBDA1A0D11DFC543ULL, 0xD5557C9F463D3B2AULL, 0x005033757E0A1B02ULL,
+		},
+		{
+			0xB3AB4973AF5F0FD6ULL, 0xA9710E533969B6D6ULL, 0xEA6D56373B32D366ULL, 0x930A44FEA981E299ULL,
+			0xDA4B59ED1AB71B62ULL, 0x845F5F4BAE6A6F9BULL, 0x17ECA9FA7914A9B0ULL, 0x64EFC48F5F4161CBULL,
+			0xC1C785189F7ACA35ULL, 0xDDDB646207DFE4CFULL, 0xE7D66EDCA130A523ULL, 0xA7DCB6F294B7A2E7ULL,
+			0x6A87E8CF590C8C89ULL, 0x602EB471B1ADE8A1ULL, 0xAA8C10187B116234ULL, 0x8C3A90E56AB5D1B5ULL,
+			0x32F1D7DFF58FF1C6ULL, 0x442EC30AB600B729ULL, 0x7FCC3F8C27BABD09ULL, 0x18D95CBA0A24AD84ULL,
+			0x7147F592DF003715ULL, 0x591818342AE10AB3ULL, 0x9073558DBA92EBE9ULL, 0x694F11D83BB6A18CULL,
+			0x3390A4A8BBB14B4EULL, 0x5766BABFF7215DF2ULL, 0x02A2ADC62FEE7EF2ULL, 0x6C0581E54899A224ULL,
+			0x71B8B38BC4A43C08ULL, 0xDE356FA77371B0ADULL, 0xAD42F92285F769D0ULL, 0x8CA9126C0167BEBDULL,
+			0x76A278AA76F9AF49ULL, 0xFF210302118CBDA7ULL, 0xDB09F7C8D931DFE8ULL, 0xE4136DA5EAAFF746ULL,
+			0xD272966BB4EEDD3AULL, 0xCFB22BE50436E25BULL, 0xEDC305A392BFB722ULL, 0xD6E78EA5611E1643ULL,
+			0x21AE59499E9128ACULL, 0x90ACDBF3659D0BFFULL, 0x1772F0C777F8281BULL, 0x272DB9DE7573F1F2ULL,
+			0x991BEDC1326A180AULL, 0xC0F39E8654D6F477ULL, 0xDE280917A6661439ULL, 0xD99FD973AFFE194AULL,
+			0x63FB85C1089F0974ULL, 0x28D89B8842039232ULL, 0x024545C1150448C8ULL, 0xC67D318D6883AAE7ULL,
+			0x7207768A4585F42EULL, 0xACD11D0CD878A707ULL, 0xE9A13DCDFBF209FEULL, 0x1DEA73C19958E7ABULL,
+			0x222572466A26FA67ULL, 0x740275E1222A6868ULL, 0xCA663C3EB5C51984ULL, 0xAEBD2A5155D8239AULL,
+			0xFB4E0693FC8F1D25ULL, 0x1222F3FA1B2D6928ULL, 0xABF41B918F8629BFULL, 0x3308140022538975ULL,
+		},
+		{
+			0x7AF3A5AE2486168EULL, 0xFCAA541716BAF5ACULL, 0x7D41C370FD9577B9ULL, 0x9175C9A016F76637ULL,
+			0x8D20439507E50FE9ULL, 0x8D2C7EB3EC82FD66ULL, 0x6EFC20CA10FC7991ULL, 0xD1014793301A9087ULL,
+			0xC4EC0420DEB41FD5ULL, 0x2FCD3C5C5774EC19ULL, 0x7EA48918F204249FULL, 0x827015CA4F9DAC98ULL,
+			0xE4578A791068CCB8ULL, 0x796C6CE75EEC001EULL, 0x9192DBD8B998CE6DULL, 0xD1AF73DC41CF95B1ULL,
+			0xD297390E8112A547ULL, 0x31DB962B07560104ULL, 0x8BDA4D98D824A2C8ULL, 0x83BD28D5F3FC3AA4ULL,
+			0x61FBC870AAA11023ULL, 0x31C68F327A34F9C4ULL, 0x9A02F9342C2D9EA0ULL, 0xC255AE1979073C78ULL,
+			0x22259746A737EC26ULL, 0x49548E4093B5576AULL, 0xA11C55C4D492B62CULL, 0x0B40B6CB66978950ULL,
+			0xAD9AA643D9056E98ULL, 0x3682744882B11469ULL, 0xB09A06C9D55C9E50ULL, 0xECE5F895AE2DC383ULL,
+			0xE08608A16059CC58ULL, 0xEF7CD4B423049A20ULL, 0xEDA42A1558B5C058ULL, 0x0568B96DFCEB23F2ULL,
+			0x7ACEF346E7E8645BULL, 0xC9A07D2701C381B1ULL, 0x26E7E523BD653CA4ULL, 0x8EDBA16E97FCBAECULL,
+			0x5BA807270A9B20E9ULL, 0xAF24D3D5163BBD02ULL, 0x965268A1E06DB46AULL, 0xD7384D396821ED27ULL,
+			0x273E93F7C1BEB85CULL, 0x81694566D6B1B3C7ULL, 0xAF3FB813A3697E33ULL, 0xA7BCFEFF700D360BULL,
+			0x0DE4B676571905DEULL, 0xB115E2044FE8202DULL, 0xBE18B5358F877AECULL, 0xA57E6F8CCF4EA830ULL,
+			0x8F8BCE4B0910FE98ULL, 0x5D4237A59BD6FE7CULL, 0x5B297FA7533BFFCBULL, 0x6B1F39B5685CA295ULL,
+			0xEFEAB9E68232A4CCULL, 0xD278DFBDD2D8AADDULL, 0xAB8F499426E5194DULL, 0xC7B0D6695DAB6438ULL,
+			0x21C141BDAF2BC2EBULL, 0xFE409F17699F96FEULL, 0x80F04429AE89DB16ULL, 0xF9884650D4077163ULL,
+		},
+		{
+			0x658E4E79B83F54B2ULL, 0x85A32B47FEF63603ULL, 0x8240604F12E4D56EULL, 0xB7113C23263FD7E2ULL,
+			0xF21AF4AFD5F0E855ULL, 0xD9C57F4BF0F6A656ULL, 0x37B874CA9A847242ULL, 0x90AD0B982A1F2786ULL,
+			0x8D6D33E7BD634DCBULL, 0xBA13CBD667092D6FULL, 0xD37C10A416C29427ULL, 0xDA3C1904E9C4C524ULL,
+			0xF4C3C0EA66EF39D8ULL, 0x7AA9BA41515EA367ULL, 0xDD6632E42D6E7258ULL, 0x65C54E1E7720C2F2ULL,
+			0xF62B7431097B2F6CULL, 0xCB7D2ACC89AA460BULL, 0xB127EACAD3A7625BULL, 0x07FFEDF451720204ULL,
+			0x4C917BA1E3399A36ULL, 0x8AA628B9F5B520B5ULL, 0xC4E3ECB8E975602CULL, 0xA1344F8B9A42096DULL,
+			0xE14FB0B38471729FULL, 0xF2595A64E1085742ULL, 0x1A089A33A4B41F68ULL, 0xAA1C42C33E81855DULL,
+			0xAD16D9793ABA5D25ULL, 0x10ABDD3A72210D64ULL, 0x5247E5DA75861FDAULL, 0xAFEFB337DDD6E5A5ULL,
+			0xF67F80F41A939F40ULL, 0x82FB458923BFC4C2ULL, 0x5046CBD3D2D6A365ULL, 0xA6F2C75086F5B569ULL,
+			0x1B9E462499D4C92FULL, 0xF69DBA6C94E5C054ULL, 0xB5B3DF91397A249BULL, 0x4C7A833D7B36E969ULL,
+			0x87CE9D704B2F6BFEULL, 0x02C4EF365D2ED40BULL, 0x18D025FF50CDB3BBULL, 0xD4B0A016931C4AA0ULL,
+			0x38E44362AAE303BDULL, 0x3B4041631ABA0595ULL, 0xFF8F22601D387A57ULL, 0x79F96332A1DA8B3DULL,
+			0x0C1C56ACBAF169D5ULL, 0xE430B8DA1EAAE52CULL, 0xDFAC40A4F49EE99FULL, 0x5125C5CE17B26ED2ULL,
+			0xCBB802DF50E6A307ULL, 0x039753BC0568D7C6ULL, 0xFF440B44A395D00AULL, 0x33FAAF83325957F9ULL,
+			0xE210F8E527991E6CULL, 0x1DB75414BDC5707AULL, 0x24D21451C52D4485ULL, 0xE8FB9DBF17DF5F67ULL,
+			0x14AF44F64EE4BC45ULL, 0xA19BE695809307FBULL, 0xB67290C3075DB5F5ULL, 0xB8601ED757750152ULL,
+		},
+		{
+			0xD28563AABEAF2F25ULL, 0x6B75E796DB893414ULL, 0xE0ED28CB1D0D990CULL, 0x87E46FB2A6099A50ULL,
+			0x911CAA9AA785CE86ULL, 0x1B8A1EAF4F63DBB7ULL, 0x02587902343A9F3AULL, 0x1BAB76A98C2DAB8EULL,
+			0x1807867992C328DBULL, 0xF0D861B6416A5F9BULL, 0xC5B3D8B278C2B665ULL, 0x840105EB23117C82ULL,
+			0x699E5CC713C21544ULL, 0x4C497878A497A136ULL, 0xA52881BA65B9C4D4ULL, 0xA2B25FF51214FBADULL,
+			0xA0B7ED7BB7D170FDULL, 0x6F5B0175175A3829ULL, 0x5D49756B3B888F73ULL, 0x5804AA745F4D440DULL,
+			0xD3A8CE9AED3437A8ULL, 0x4C960E23FD26BF57ULL, 0x9483C44F13FDB2A8ULL, 0x5AF89E6A4CBFE003ULL,
+			0xD205E14C7125651EULL, 0xFFC8FF578D323553ULL, 0xD7474A6689C21763ULL, 0x479C4708A39D76E1ULL,
+			0xD43A8AD9C68DCD2EULL, 0x557B6290E63D92E0ULL, 0x520CD54A8B453C23ULL, 0x4D9D0449FC27CD01ULL,
+			0xEE12EFFF860235A3ULL, 0x9DF8335975ADD26AULL, 0x24331EA979763F95ULL, 0x003A4310FE431B87ULL,
+			0x5159CF025674B696ULL, 0xF38DD0D45B48C85EULL, 0xFDA91B8B83202658ULL, 0xB78843350F2D0C6EULL,
+			0x109EAF35FE75AD4AULL, 0xD33BC557E58EAB7DULL, 0xC2D67BBCCC526897ULL, 0x1091C036030451B8ULL,
+			0x65BA8E0F90AF41DFULL, 0x9431BC06E6E6C8D0ULL, 0x34E126CF0D5B327BULL, 0x1E5F6689A12355ECULL,
+			0x85A44216C20FB265ULL, 0x09A994E024B1C486ULL, 0xE46D2FD45824031DULL, 0xF9B4B001E81774B2ULL,
+			0x7B127255A87D7572ULL, 0x0D5A58D4E399B172ULL, 0x5ADF16CDAE6DF2A4ULL, 0x3E41F0D8112FF438ULL,
+			0x6D1F2B4F1F94965AULL, 0xCF5B0A686B282FD6ULL, 0xFBA54D8A8973CA52ULL, 0x8F187F71071BA7E8ULL,
+			0x6F40D663B5A4B322ULL, 0xB8D491E240B19527ULL, 0xED9DD11B7F9DCB25ULL, 0x0B7A76C4B2F8413EULL,
+		},
+		{
+			0xDDB670DE69290E99ULL, 0x3145179BF9DB4B06ULL, 0x91C2F90B614B636AULL, 0xE5568BA08A8740F1ULL,
+			0xDA8309AD37D3CD0DULL, 0x9BE575B56F5B9C84ULL, 0x952F939CC80E40E1ULL, 0xC2F557138425A666ULL,
+			0xC8D4EED88560D5F5ULL, 0xC036D0048D56905BULL, 0x878DE84401501FC1ULL, 0x46A141D3E1AE03C4ULL,
+			0x9453AAD22EE07415ULL, 0x30F54C2DD0DC7244ULL, 0x8CED92539B54DFC6ULL, 0xEA18CAF21E0DE96FULL,
+			0x45FFAA38A29D446CULL, 0xC6E104AAD711863EULL, 0xDE10EE625FBC0F54ULL, 0x53EF6878EC9E341BULL,
+			0xCA72B17C91E0A2C7ULL, 0xEE5428FBE02A2AC0ULL, 0x51370838BC8F71F6ULL, 0x879E31F04B42A29FULL,
+			0x1972543CA87DDD01ULL, 0x7E92214EACEA806BULL, 0x3EFB61F488789FC0ULL, 0x8357A5A1E9A16898ULL,
+			0xE1778E73DD4937C3ULL, 0x2557BCC2E237BE6FULL, 0xACAE0FB5DBBA2E43ULL, 0x88835D3E2E09902FULL,
+			0x919456DDCC4810B0ULL, 0x0DA3C97C0EA221F5ULL, 0x86F16B7F0F8BCCA4ULL, 0x625891945B07FE9BULL,
+			0x2C145FB28AE20FBFULL, 0x78155AA6EB8A00A9ULL, 0x28E56030AAF97841ULL, 0xA6F573709AB0F08AULL,
+			0xD61EBB0EBD8BD748ULL, 0xF159C1F0846A0C2BULL, 0x8255769FCA40B66CULL, 0x41C244AB2CE8B4FDULL,
+			0x1AE5E40F6EB37C39ULL, 0x206284D18A1EB091ULL, 0xC08E105419305D95ULL, 0x9DA07EF6E58BD817ULL,
+			0x8DFB974791D85D36ULL, 0xA84DF50D1E4DC31FULL, 0xDCC02E79BE44338BULL, 0x1964A6AAA45D4E14ULL,
+			0x84386662A3C4CEC1ULL, 0x1D8CD8D2F78F4A18ULL, 0x9F1998A28BFAAB57ULL, 0xBDB74C1421665EE0ULL,
+			0xBF0D1845D0FD41D4ULL, 0x27323394C55FA493ULL, 0x9A4401298742560DULL, 0x321640421F69D2D8ULL,
+			0xE5DA957E1BC5B100ULL, 0xB4B83894284E80A6ULL, 0x0DC8562697242F3AULL, 0xF5DC7904726406B8ULL,
+		},
+	},
+};
+
+const uint64_t ZobristBlackToMove = 0x401A18BB02D7D7F0ULL;
+
+/*
+ * Table sizes (flash):
+ * FillUpAttacks          4096 bytes
+ * AFileAttacks           4096 bytes
+ * DiagonalMasks           512 bytes
+ * AntiDiagonalMasks       512 bytes
+ * KnightAttackTable       512 bytes
+ * KingAttackTable         512 bytes
+ * PawnAttackTable        1024 bytes
+ * PawnPushTable          1024 bytes
+ * ZobristPieceKeys       6144 bytes
+ * ZobristBlackToMove        8 bytes
+ * total                 18440 bytes
+ */
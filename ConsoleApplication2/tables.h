@@ -0,0 +1,116 @@
+#ifndef TABLES_H_
+#define TABLES_H_
+
+#include "types.h"
+
+/*
+ * Sliding attacks use kindergarten bitboards: the occupancy of one line through the slider is gathered into a 6 bit
+ * index with a single multiply and shift, and the attacks are read from a small const table. Knights, kings and pawns
+ * don't depend on the occupancy, so their moves from each square are read straight from a table. The tables live in
+ * tables.c which is generated by tools/tablegen.c.
+ */
+
+#define LINE_OCCUPANCY_SIZE 64
+#define A_FILE 0x0101010101010101ULL
+#define B_FILE 0x0202020202020202ULL
+#define C7_H2_DIAGONAL 0x0004081020408000ULL
+
+#ifdef TABLEGEN
+#define TABLE_CONST
+#else
+#define TABLE_CONST const
+#endif
+
+// First rank attacks for a slider on [column] given the inner rank occupancy, copied into every row
+extern TABLE_CONST Bitboard FillUpAttacks[NUM_COLS][LINE_OCCUPANCY_SIZE];
+
+// A-file attacks for a slider on [row] given the inner file occupancy
+extern TABLE_CONST Bitboard AFileAttacks[NUM_ROWS][LINE_OCCUPANCY_SIZE];
+
+// Diagonal (a1-h8 direction) and anti-diagonal (h1-a8 direction) through each square
+extern TABLE_CONST Bitboard DiagonalMasks[NUM_SQUARES];
+extern TABLE_CONST Bitboard AntiDiagonalMasks[NUM_SQUARES];
+
+// Knight and king moves from each square
+extern TABLE_CONST Bitboard KnightAttackTable[NUM_SQUARES];
+extern TABLE_CONST Bitboard KingAttackTable[NUM_SQUARES];
+
+// Diagonal captures and single step pushes of a pawn on [owner - WHITE][square]. A pawn on the last row has neither.
+extern TABLE_CONST Bitboard PawnAttackTable[NUM_PIECE_OWNERS - 1][NUM_SQUARES];
+extern TABLE_CONST Bitboard PawnPushTable[NUM_PIECE_OWNERS - 1][NUM_SQUARES];
+
+// Zobrist keys: a position's key is the XOR of the keys of its pieces [owner - WHITE][type - PAWN][square], with
+// ZobristBlackToMove mixed in when it is black's turn
+extern TABLE_CONST uint64_t ZobristPieceKeys[NUM_PIECE_OWNERS - 1][NUM_PIECE_TYPES - 1][NUM_SQUARES];
+extern TABLE_CONST uint64_t ZobristBlackToMove;
+
+/**
+ * @brief Returns the attacks along lineMask for a slider on square. lineMask must be a row or diagonal through square.
+ */
+static inline Bitboard LineAttacks(uint8_t square, Bitboard occupied, Bitboard lineMask)
+{
+	uint8_t index = (uint8_t)(((occupied & lineMask) * B_FILE) >> 58);
+	return lineMask & FillUpAttacks[SQUARE_COLUMN(square)][index];
+}
+
+/**
+ * @brief Returns the attacks along the column of square
+ */
+static inline Bitboard FileAttacks(uint8_t square, Bitboard occupied)
+{
+	uint8_t index = (uint8_t)(((A_FILE & (occupied >> SQUARE_COLUMN(square))) * C7_H2_DIAGONAL) >> 58);
+	return AFileAttacks[SQUARE_ROW(square)][index] << SQUARE_COLUMN(square);
+}
+
+/**
+ * @brief Returns every square a rook on square attacks, stopping at (and including) the first blocker on each ray
+ */
+static inline Bitboard RookAttacks(uint8_t square, Bitboard occupied)
+{
+	Bitboard rowMask = (Bitboard)0xFF << (square & 0x38);
+	return LineAttacks(square, occupied, rowMask) | FileAttacks(square, occupied);
+}
+
+/**
+ * @brief Returns every square a bishop on square attacks, stopping at (and including) the first blocker on each ray
+ */
+static inline Bitboard BishopAttacks(uint8_t square, Bitboard occupied)
+{
+	return LineAttacks(square, occupied, DiagonalMasks[square]) | LineAttacks(square, occupied, AntiDiagonalMasks[square]);
+}
+
+static inline Bitboard KnightAttacks(uint8_t square)
+{
+	return KnightAttackTable[square];
+}
+
+static inline Bitboard KingAttacks(uint8_t square)
+{
+	return KingAttackTable[square];
+}
+
+/**
+ * @brief Returns the squares an owner's pawn on square attacks diagonally
+ */
+static inline Bitboard PawnAttacksFrom(enum PieceOwner owner, uint8_t square)
+{
+	return PawnAttackTable[owner - WHITE][square];
+}
+
+/**
+ * @brief Returns the square in front of an owner's pawn on square, empty or not
+ */
+static inline Bitboard PawnPushes(enum PieceOwner owner, uint8_t square)
+{
+	return PawnPushTable[owner - WHITE][square];
+}
+
+/**
+ * @brief Returns the Zobrist key of piece standing on square, 0 for an empty square
+ */
+static inline uint64_t PieceZobristKey(Piece piece, uint8_t square)
+{
+	return piece == EMPTY_PIECE ? 0 : ZobristPieceKeys[piece >> 3][PIECE_TYPE(piece) - PAWN][square];
+}
+
+#endif /* TABLES_H_ */
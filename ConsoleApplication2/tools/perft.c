@@ -0,0 +1,519 @@
+/*
+ * Perft: counts the leaves of the legal move tree down to a fixed depth using the pathfinder's move generation and
+ * make/unmake. The suite compares the counts against known values as a correctness gate, and the timings give the move
+ * generator's throughput in nodes per second.
+ *
+ * The counts follow the board's rule set: castling and en passant are recognised by the tracker rather than generated
+ * by the pathfinder, and a pawn reaching the last row always becomes a queen. The expected counts below were produced
+ * by an independent generator under the same rules, so positions with castling rights, en passant or underpromotions
+ * deeper in the tree count fewer nodes than the usual published figures.
+ *
+ * Usage: perft <depth> [fen]   Divide by root move, then total nodes and nodes per second (start position by default)
+ *        perft suite [depth]   Run the standard positions, capping each to depth if given, and check the counts
+ *        perft leapers         Compare the knight, king and pawn move tables against working the moves out square
+ *                              by square with bounds checks, as the pathfinder used to
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../pathfinder.h"
+#include "../bitboard.h"
+#include "../tables.h"
+
+#define MAX_PERFT_DEPTH MAX_UNDO_DEPTH
+#define MAX_SUITE_DEPTH 6
+
+#define LEAPER_ROUNDS 200000
+
+#define START_POSITION_FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+
+/**
+ * @brief A standard perft position along with its node counts at depths 1, 2, ... (0 terminated)
+ */
+struct PerftPosition {
+	const char* name;
+	const char* fen;
+	uint64_t nodes[MAX_SUITE_DEPTH + 1];
+};
+
+static const struct PerftPosition PERFT_SUITE[] = {
+	{ "start", START_POSITION_FEN,
+		{ 20, 400, 8902, 197281, 4865351 } },
+	{ "kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+		{ 46, 1865, 86585, 3488552 } },
+	{ "endgame", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+		{ 14, 191, 2810, 43087, 671300 } },
+	{ "promotions", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+		{ 6, 222, 7855, 305965 } },
+	{ "discovered-checks", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+		{ 40, 1339, 51750, 1729274 } },
+	{ "middlegame", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+		{ 46, 2079, 89890, 3894594 } },
+};
+
+#define PERFT_SUITE_SIZE (sizeof(PERFT_SUITE) / sizeof(PERFT_SUITE[0]))
+
+/**
+ * @brief The legal moves of one ply, copied out of the pathfinder since generating the next ply overwrites them
+ */
+struct PerftMoves {
+	uint8_t numPieces;
+	uint8_t from[NUM_SQUARES];
+	Bitboard destinations[NUM_SQUARES];
+};
+
+// All plies are played on this one position with make/unmake
+static struct PathfinderContext Pathfinder;
+
+// Position //
+static uint8_t LoadFen(const char* fen, enum PieceOwner* side);
+static void GenerateMoves(enum PieceOwner side, struct PerftMoves* moves);
+
+// Counting //
+static uint64_t Perft(uint8_t depth, enum PieceOwner side);
+static uint64_t Divide(uint8_t depth, enum PieceOwner side);
+static uint8_t RunSuite(uint8_t maxDepth);
+
+// Leaper Tables (knights and kings ignore the owner, so all of them can be timed by the same loop) //
+typedef Bitboard (*LeaperFunction)(enum PieceOwner owner, uint8_t square);
+static uint8_t CompareLeapers(void);
+static double TimeLeaper(LeaperFunction leaper, Bitboard* checksum);
+static Bitboard TableKnightMoves(enum PieceOwner owner, uint8_t square);
+static Bitboard TableKingMoves(enum PieceOwner owner, uint8_t square);
+static Bitboard TablePawnMoves(enum PieceOwner owner, uint8_t square);
+static Bitboard SteppedKnightMoves(enum PieceOwner owner, uint8_t square);
+static Bitboard SteppedKingMoves(enum PieceOwner owner, uint8_t square);
+static Bitboard SteppedPawnMoves(enum PieceOwner owner, uint8_t square);
+
+// Utilities //
+static double ElapsedSeconds(const struct timespec* start);
+static enum PieceOwner EnemyOf(enum PieceOwner owner);
+static void PrintSquare(uint8_t square);
+static void PrintCacheStats(const struct LegalMoveCacheStats* stats);
+
+int main(int argc, char** argv)
+{
+	if (argc >= 2 && strcmp(argv[1], "suite") == 0)
+	{
+		uint8_t maxDepth = argc >= 3 ? (uint8_t)atoi(argv[2]) : MAX_SUITE_DEPTH;
+		return RunSuite(maxDepth) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (argc >= 2 && strcmp(argv[1], "leapers") == 0)
+	{
+		return CompareLeapers() ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (argc < 2 || atoi(argv[1]) < 1 || atoi(argv[1]) > MAX_PERFT_DEPTH)
+	{
+		fprintf(stderr, "usage: %s <depth 1-%d> [fen]\n       %s suite [depth]\n       %s leapers\n", argv[0], MAX_PERFT_DEPTH,
+			argv[0], argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	uint8_t depth = (uint8_t)atoi(argv[1]);
+	const char* fen = argc >= 3 ? argv[2] : START_POSITION_FEN;
+	enum PieceOwner side;
+
+	if (!LoadFen(fen, &side))
+	{
+		fprintf(stderr, "invalid fen: %s\n", fen);
+		return EXIT_FAILURE;
+	}
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	uint64_t nodes = Divide(depth, side);
+	double seconds = ElapsedSeconds(&start);
+
+	printf("\nnodes %" PRIu64 "  time %.3f s  %.0f nps\n", nodes, seconds, seconds > 0 ? nodes / seconds : 0);
+	PrintCacheStats(&Pathfinder.cacheStats);
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Counts the leaves "depth" plies below the current position, where side is to move. Leaves are counted in bulk
+ * from the number of legal destinations rather than by playing the last move.
+ */
+static uint64_t Perft(uint8_t depth, enum PieceOwner side)
+{
+	struct PerftMoves moves;
+	uint64_t nodes = 0;
+
+	GenerateMoves(side, &moves);
+
+	for (uint8_t i = 0; i < moves.numPieces; i++)
+	{
+		Bitboard destinations = moves.destinations[i];
+
+		if (depth == 1)
+		{
+			nodes += PopCount(destinations);
+			continue;
+		}
+
+		while (destinations)
+		{
+			uint8_t to = PopLowestSquare(&destinations);
+			MakeMoveContext(&Pathfinder, moves.from[i], to, QUEEN);
+			nodes += Perft(depth - 1, EnemyOf(side));
+			UnmakeMoveContext(&Pathfinder);
+		}
+	}
+
+	return nodes;
+}
+
+/**
+ * @brief Runs perft from the current position, printing the node count below each root move
+ */
+static uint64_t Divide(uint8_t depth, enum PieceOwner side)
+{
+	struct PerftMoves moves;
+	uint64_t nodes = 0;
+
+	GenerateMoves(side, &moves);
+
+	for (uint8_t i = 0; i < moves.numPieces; i++)
+	{
+		Bitboard destinations = moves.destinations[i];
+
+		while (destinations)
+		{
+			uint8_t to = PopLowestSquare(&destinations);
+			uint64_t moveNodes = 1;
+
+			if (depth > 1)
+			{
+				MakeMoveContext(&Pathfinder, moves.from[i], to, QUEEN);
+				moveNodes = Perft(depth - 1, EnemyOf(side));
+				UnmakeMoveContext(&Pathfinder);
+			}
+
+			PrintSquare(moves.from[i]);
+			PrintSquare(to);
+			printf(": %" PRIu64 "\n", moveNodes);
+			nodes += moveNodes;
+		}
+	}
+
+	return nodes;
+}
+
+/**
+ * @brief Runs every suite position up to maxDepth. Returns 1 if all the counts match, 0 otherwise.
+ */
+static uint8_t RunSuite(uint8_t maxDepth)
+{
+	uint64_t totalNodes = 0;
+	double totalSeconds = 0;
+	struct LegalMoveCacheStats totalCacheStats = { 0 };
+	uint8_t failures = 0;
+
+	for (size_t i = 0; i < PERFT_SUITE_SIZE; i++)
+	{
+		const struct PerftPosition* position = &PERFT_SUITE[i];
+		enum PieceOwner side;
+
+		for (uint8_t depth = 1; depth <= maxDepth && position->nodes[depth - 1]; depth++)
+		{
+			if (!LoadFen(position->fen, &side))
+			{
+				printf("%-18s invalid fen\n", position->name);
+				failures++;
+				break;
+			}
+
+			struct timespec start;
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			uint64_t nodes = Perft(depth, side);
+			double seconds = ElapsedSeconds(&start);
+
+			uint64_t expected = position->nodes[depth - 1];
+			printf("%-18s depth %u  nodes %10" PRIu64 "  expected %10" PRIu64 "  %s  %8.3f s\n", position->name, depth,
+				nodes, expected, nodes == expected ? "ok  " : "FAIL", seconds);
+
+			failures += nodes != expected;
+			totalNodes += nodes;
+			totalSeconds += seconds;
+			totalCacheStats.hits += Pathfinder.cacheStats.hits;
+			totalCacheStats.misses += Pathfinder.cacheStats.misses;
+			totalCacheStats.evictions += Pathfinder.cacheStats.evictions;
+		}
+	}
+
+	printf("\n%s: %" PRIu64 " nodes in %.3f s, %.0f nps\n", failures ? "FAILED" : "passed", totalNodes, totalSeconds,
+		totalSeconds > 0 ? totalNodes / totalSeconds : 0);
+	PrintCacheStats(&totalCacheStats);
+	return failures == 0;
+}
+
+/**
+ * @brief Checks the leaper tables against the stepped versions on every square, then times both. Returns 1 if they
+ * agree, 0 otherwise.
+ */
+static uint8_t CompareLeapers(void)
+{
+	const struct {
+		const char* name;
+		size_t tableSize;
+		LeaperFunction table;
+		LeaperFunction stepped;
+	} leapers[] = {
+		{ "knight", sizeof(KnightAttackTable), TableKnightMoves, SteppedKnightMoves },
+		{ "king", sizeof(KingAttackTable), TableKingMoves, SteppedKingMoves },
+		{ "pawn", sizeof(PawnAttackTable) + sizeof(PawnPushTable), TablePawnMoves, SteppedPawnMoves },
+	};
+	uint8_t failures = 0;
+
+	printf("%-8s %12s %10s %12s %8s\n", "leaper", "table bytes", "table ns", "stepped ns", "speedup");
+	for (size_t i = 0; i < sizeof(leapers) / sizeof(leapers[0]); i++)
+	{
+		for (enum PieceOwner owner = WHITE; owner <= BLACK; owner++)
+		{
+			for (uint8_t square = 0; square < NUM_SQUARES; square++)
+			{
+				if (leapers[i].table(owner, square) != leapers[i].stepped(owner, square))
+				{
+					printf("%s moves from ", leapers[i].name);
+					PrintSquare(square);
+					printf(" for %s don't match\n", owner == WHITE ? "white" : "black");
+					failures++;
+				}
+			}
+		}
+
+		// The checksums keep the lookups from being optimised away
+		Bitboard tableChecksum;
+		Bitboard steppedChecksum;
+		double tableSeconds = TimeLeaper(leapers[i].table, &tableChecksum);
+		double steppedSeconds = TimeLeaper(leapers[i].stepped, &steppedChecksum);
+		failures += tableChecksum != steppedChecksum;
+		double lookups = (double)LEAPER_ROUNDS * 2 * NUM_SQUARES;
+		printf("%-8s %12zu %10.2f %12.2f %7.1fx\n", leapers[i].name, leapers[i].tableSize, tableSeconds * 1e9 / lookups,
+			steppedSeconds * 1e9 / lookups, tableSeconds > 0 ? steppedSeconds / tableSeconds : 0);
+	}
+
+	printf("\n%s\n", failures ? "FAILED" : "tables match");
+	return failures == 0;
+}
+
+/**
+ * @brief Returns the seconds taken to look up the moves from every square for both teams LEAPER_ROUNDS times, with the
+ * XOR of every lookup in checksum
+ */
+static double TimeLeaper(LeaperFunction leaper, Bitboard* checksum)
+{
+	Bitboard moves = 0;
+	struct timespec start;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (uint32_t round = 0; round < LEAPER_ROUNDS; round++)
+	{
+		for (enum PieceOwner owner = WHITE; owner <= BLACK; owner++)
+		{
+			for (uint8_t square = 0; square < NUM_SQUARES; square++)
+			{
+				moves ^= leaper(owner, square);
+			}
+		}
+	}
+	*checksum = moves;
+	return ElapsedSeconds(&start);
+}
+
+static Bitboard TableKnightMoves(enum PieceOwner owner, uint8_t square)
+{
+	return KnightAttacks(square);
+}
+
+static Bitboard TableKingMoves(enum PieceOwner owner, uint8_t square)
+{
+	return KingAttacks(square);
+}
+
+/**
+ * @brief Pushes and captures of a pawn on square with every square empty, including the double push from its
+ * starting row
+ */
+static Bitboard TablePawnMoves(enum PieceOwner owner, uint8_t square)
+{
+	Bitboard moves = PawnPushes(owner, square);
+	if (SQUARE_ROW(square) == (owner == WHITE ? 1 : 6))
+	{
+		moves |= PawnPushes(owner, LowestSquare(moves));
+	}
+	return moves | PawnAttacksFrom(owner, square);
+}
+
+static Bitboard SteppedKnightMoves(enum PieceOwner owner, uint8_t square)
+{
+	const int8_t adders[8][2] = { {1, 2}, {-1, 2}, {1, -2}, {-1, -2}, {2, 1}, {-2, 1}, {2, -1}, {-2, -1} };
+	Bitboard moves = 0;
+
+	for (uint8_t move = 0; move < 8; move++)
+	{
+		int8_t row = SQUARE_ROW(square) + adders[move][0];
+		int8_t column = SQUARE_COLUMN(square) + adders[move][1];
+		if (row >= 0 && row < NUM_ROWS && column >= 0 && column < NUM_COLS)
+		{
+			moves |= SQUARE_BIT(SQUARE(row, column));
+		}
+	}
+	return moves;
+}
+
+static Bitboard SteppedKingMoves(enum PieceOwner owner, uint8_t square)
+{
+	Bitboard moves = 0;
+
+	for (int8_t i = -1; i <= 1; i++)
+	{
+		for (int8_t j = -1; j <= 1; j++)
+		{
+			int8_t row = SQUARE_ROW(square) + i;
+			int8_t column = SQUARE_COLUMN(square) + j;
+			if ((i != 0 || j != 0) && row >= 0 && row < NUM_ROWS && column >= 0 && column < NUM_COLS)
+			{
+				moves |= SQUARE_BIT(SQUARE(row, column));
+			}
+		}
+	}
+	return moves;
+}
+
+static Bitboard SteppedPawnMoves(enum PieceOwner owner, uint8_t square)
+{
+	int8_t forward = owner == WHITE ? 1 : -1;
+	int8_t row = SQUARE_ROW(square) + forward;
+	uint8_t column = SQUARE_COLUMN(square);
+	Bitboard moves = 0;
+
+	if (row < 0 || row >= NUM_ROWS)
+	{
+		return 0;
+	}
+
+	moves |= SQUARE_BIT(SQUARE(row, column));
+	if (SQUARE_ROW(square) == (owner == WHITE ? 1 : 6))
+	{
+		moves |= SQUARE_BIT(SQUARE(row + forward, column));
+	}
+	if (column > 0)
+	{
+		moves |= SQUARE_BIT(SQUARE(row, column - 1));
+	}
+	if (column < NUM_COLS - 1)
+	{
+		moves |= SQUARE_BIT(SQUARE(row, column + 1));
+	}
+	return moves;
+}
+
+/**
+ * @brief Loads the pathfinder with the placement, side to move and castling fields of a FEN string. The en passant
+ * square is ignored since the pathfinder doesn't generate those moves. Returns 1 on success, 0 otherwise.
+ */
+static uint8_t LoadFen(const char* fen, enum PieceOwner* side)
+{
+	static const char PIECE_LETTERS[NUM_PIECE_TYPES] = { ' ', 'p', 'n', 'b', 'r', 'q', 'k' };
+	Piece board[NUM_SQUARES];
+	int row = NUM_ROWS - 1;
+	int column = 0;
+
+	for (uint8_t square = 0; square < NUM_SQUARES; square++)
+	{
+		board[square] = EMPTY_PIECE;
+	}
+
+	for (; *fen && *fen != ' '; fen++)
+	{
+		if (*fen == '/')
+		{
+			row--;
+			column = 0;
+		}
+		else if (*fen >= '1' && *fen <= '8')
+		{
+			column += *fen - '0';
+		}
+		else
+		{
+			const char* letter = memchr(PIECE_LETTERS + PAWN, *fen | 0x20, NUM_PIECE_TYPES - PAWN);
+			if (!letter || row < 0 || column >= NUM_COLS)
+			{
+				return 0;
+			}
+
+			board[SQUARE(row, column++)] = PIECE(letter - PIECE_LETTERS, *fen & 0x20 ? BLACK : WHITE);
+		}
+	}
+
+	if (fen[0] != ' ' || (fen[1] != 'w' && fen[1] != 'b'))
+	{
+		return 0;
+	}
+	*side = fen[1] == 'w' ? WHITE : BLACK;
+
+	InitPathfinderContext(&Pathfinder);
+	LoadPositionContext(&Pathfinder, board);
+
+	// Castling field, all rights if it's missing
+	if (fen[2] == ' ')
+	{
+		Pathfinder.position.castleRights = 0;
+		for (fen += 3; *fen && *fen != ' '; fen++)
+		{
+			Pathfinder.position.castleRights |= *fen == 'Q' ? CASTLE_A1 : *fen == 'K' ? CASTLE_H1
+				: *fen == 'q' ? CASTLE_A8 : *fen == 'k' ? CASTLE_H8 : 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * @brief Generates side's legal moves on the current position and copies them into moves
+ */
+static void GenerateMoves(enum PieceOwner side, struct PerftMoves* moves)
+{
+	CalculatePositionLegalMovesContext(&Pathfinder, side);
+
+	Bitboard team = Pathfinder.position.owners[side];
+	moves->numPieces = 0;
+
+	while (team)
+	{
+		uint8_t from = PopLowestSquare(&team);
+		moves->from[moves->numPieces] = from;
+		moves->destinations[moves->numPieces++] = Pathfinder.legalMoveSet[from];
+	}
+}
+
+static double ElapsedSeconds(const struct timespec* start)
+{
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static enum PieceOwner EnemyOf(enum PieceOwner owner)
+{
+	return owner == WHITE ? BLACK : WHITE;
+}
+
+static void PrintSquare(uint8_t square)
+{
+	printf("%c%c", 'a' + SQUARE_COLUMN(square), '1' + SQUARE_ROW(square));
+}
+
+static void PrintCacheStats(const struct LegalMoveCacheStats* stats)
+{
+	uint32_t lookups = stats->hits + stats->misses;
+	printf("legal move cache (%d entries): %" PRIu32 " hits, %" PRIu32 " misses, %" PRIu32 " evictions, %.1f%% hit rate\n",
+		PATHFINDER_CACHE_SIZE, stats->hits, stats->misses, stats->evictions, lookups ? 100.0 * stats->hits / lookups : 0);
+}
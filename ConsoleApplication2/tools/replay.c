@@ -0,0 +1,455 @@
+/*
+ * Replay: pushes recorded sensor traces (see trace.h) back through the tracker and reports what it made of them. Every
+ * frame is fed to the simulated sensors and scanned just as the board scanned it, so the debouncer and the rules see
+ * the same samples in the same order and a replay always ends the same way.
+ *
+ * By default the scans in which a frame merely repeats are cut short once the debounce window has settled, since they
+ * can't change anything, and the trace runs as fast as the CPU allows. With -r every scan is replayed at the recorded
+ * pace instead.
+ *
+ * Built with INSTRUMENT (see instrument.h) the transition counts and latency histograms of every trace replayed are
+ * printed at the end.
+ *
+ * Usage: replay [-r] [-q] trace...   -r replays at the recorded speed, -q only prints the moves and the summary
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../tracker.h"
+#include "../trace.h"
+#include "../bitboard.h"
+#include "../instrument.h"
+
+#define MAX_REPLAY_MOVES 1024
+
+/**
+ * @brief A completed turn, worked out from how the chessboard changed between turn switches
+ */
+struct ReplayMove {
+	Piece piece;
+	uint8_t from;
+	uint8_t to;
+	uint8_t capture;
+	uint8_t castle;
+};
+
+/**
+ * @brief Totals of one trace, or of all of them
+ */
+struct ReplayStats {
+	uint32_t records;
+	uint64_t scans;
+	uint64_t replayedScans;
+	uint32_t events;
+	uint32_t transitions;
+	uint32_t moves;
+	uint32_t inferred;	// Moves InferMoveContext played
+};
+
+// Every trace is replayed on this one board
+static struct TrackerContext Tracker;
+
+static uint8_t RealTime;
+static uint8_t Quiet;
+static struct ReplayMove Moves[MAX_REPLAY_MOVES];
+static uint16_t NumMoves;
+static Piece TurnStartBoard[NUM_SQUARES];
+#ifdef INSTRUMENT
+static uint32_t TransitionCounts[NUM_TRACKER_STATES][NUM_TRACKER_EVENTS];	// Of every trace, the tracker's only has its own
+#endif
+
+// Replaying //
+static uint8_t ReplayFile(const char* path, struct ReplayStats* stats);
+static void ReplayScan(uint32_t timestamp, struct ReplayStats* stats);
+static void SetSensors(Bitboard frame);
+static void RecordMove(enum PieceOwner mover);
+
+// Reporting //
+static void PrintEvent(const struct SensorEvent* event, uint8_t transition);
+static void PrintMove(const struct ReplayMove* move);
+static void PrintMoveList(void);
+static void PrintStats(const char* name, const struct ReplayStats* stats, double seconds);
+
+// Utilities //
+static uint8_t* ReadFile(const char* path, uint32_t* length);
+static void SleepMilliseconds(uint32_t milliseconds);
+static double ElapsedSeconds(const struct timespec* start);
+#ifdef INSTRUMENT
+static void PrintLatencyLine(const char* line);
+#endif
+
+int main(int argc, char** argv)
+{
+	struct ReplayStats total = { 0 };
+	uint8_t failures = 0;
+	int numTraces = 0;
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-r") == 0)
+		{
+			RealTime = 1;
+		}
+		else if (strcmp(argv[i], "-q") == 0)
+		{
+			Quiet = 1;
+		}
+		else
+		{
+			struct ReplayStats stats = { 0 };
+			failures += !ReplayFile(argv[i], &stats);
+			numTraces++;
+
+			total.records += stats.records;
+			total.scans += stats.scans;
+			total.replayedScans += stats.replayedScans;
+			total.events += stats.events;
+			total.transitions += stats.transitions;
+			total.moves += stats.moves;
+			total.inferred += stats.inferred;
+		}
+	}
+
+	if (!numTraces)
+	{
+		fprintf(stderr, "usage: %s [-r] [-q] trace...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (numTraces > 1)
+	{
+		PrintStats("total", &total, ElapsedSeconds(&start));
+	}
+
+#ifdef INSTRUMENT
+	memcpy(Tracker.transitionCounts, TransitionCounts, sizeof(TransitionCounts));
+	DumpTrackerTransitionsContext(&Tracker, PrintLatencyLine);
+	DumpLatencyHistograms(PrintLatencyLine);
+#endif
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * @brief Replays one trace file from a freshly initialised tracker. Returns 0 if the file couldn't be replayed.
+ */
+static uint8_t ReplayFile(const char* path, struct ReplayStats* stats)
+{
+	uint32_t length;
+	uint8_t* data = ReadFile(path, &length);
+	struct TraceReader reader;
+	struct TraceRecord record;
+
+	if (!data || !OpenTraceReader(&reader, data, length))
+	{
+		fprintf(stderr, "%s: not a sensor trace\n", path);
+		free(data);
+		return 0;
+	}
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if (!Quiet)
+	{
+		printf("%s\n", path);
+	}
+
+	InitTrackerContext(&Tracker);
+	memcpy(TurnStartBoard, Tracker.chessboard, sizeof(TurnStartBoard));
+	NumMoves = 0;
+
+	// The first frame is scanned at the time the trace starts
+	Bitboard frame = reader.frame;
+	uint32_t timestamp = reader.timestamp;
+	SimAdvanceTimeContext(&Tracker, timestamp - Tracker.simTime);
+	SetSensors(frame);
+	ReplayScan(timestamp, stats);
+
+	while (ReadTraceRecord(&reader, &record))
+	{
+		// The frame repeated for every scan in between, which only matters until the debouncer has settled on it
+		uint32_t repeats = record.scans - 1;
+		uint32_t replayed = RealTime || repeats < DEBOUNCE_WINDOW ? repeats : DEBOUNCE_WINDOW;
+		uint32_t period = (record.timestamp - timestamp) / record.scans;
+
+		for (uint32_t i = 1; i <= replayed; i++)
+		{
+			if (RealTime)
+			{
+				SleepMilliseconds(period);
+			}
+			ReplayScan(timestamp + i * period, stats);
+		}
+
+		if (RealTime)
+		{
+			SleepMilliseconds(record.timestamp - timestamp - replayed * period);
+		}
+		timestamp = record.timestamp;
+		SetSensors(record.frame);
+		ReplayScan(timestamp, stats);
+
+		stats->records++;
+		stats->scans += record.scans;
+		stats->replayedScans += replayed + 1;
+	}
+
+	// Let whatever the last frame changed settle
+	for (uint8_t i = 0; i < DEBOUNCE_WINDOW; i++)
+	{
+		ReplayScan(timestamp, stats);
+	}
+
+	if (reader.truncated)
+	{
+		fprintf(stderr, "%s: trace ends in the middle of a record\n", path);
+	}
+	if (reader.malformed)
+	{
+		fprintf(stderr, "%s: trace has a record of no scans, the rest is skipped\n", path);
+	}
+
+	PrintMoveList();
+	PrintStats(path, stats, ElapsedSeconds(&start));
+#ifdef INSTRUMENT
+	for (uint8_t state = 0; state < NUM_TRACKER_STATES; state++)
+	{
+		for (uint8_t event = 0; event < NUM_TRACKER_EVENTS; event++)
+		{
+			TransitionCounts[state][event] += Tracker.transitionCounts[state][event];
+		}
+	}
+#endif
+#ifdef TRACKER_SPECULATE
+	struct SpeculationStats speculation = GetSpeculationStatsContext(&Tracker);
+	printf("speculation: %" PRIu32 " of %" PRIu32 " turn switches precomputed, %" PRIu32 " positions speculated\n",
+		speculation.hits, speculation.hits + speculation.misses, speculation.positions);
+#endif
+	free(data);
+	return 1;
+}
+
+/**
+ * @brief Scans the simulated sensors once at timestamp and runs the tracker on each event, reporting as it goes
+ */
+static void ReplayScan(uint32_t timestamp, struct ReplayStats* stats)
+{
+	struct SensorEvent event;
+	uint8_t transitionOccured = 0;
+
+	SimAdvanceTimeContext(&Tracker, timestamp - Tracker.simTime);
+	ScanContext(&Tracker);
+
+	// Track takes a look at the whole scan before its events
+	enum PieceOwner turn = Tracker.currentTurn;
+	if (InferMoveContext(&Tracker))
+	{
+		transitionOccured = 1;
+		stats->inferred++;
+		RecordMove(turn);
+		stats->moves++;
+	}
+
+	while (PopSensorEvent(&Tracker.events, &event))
+	{
+		enum PieceOwner turn = Tracker.currentTurn;
+		uint8_t transition = TrackEventContext(&Tracker, event);
+		transitionOccured |= transition;
+
+		stats->events++;
+		stats->transitions += transition;
+		if (!Quiet)
+		{
+			PrintEvent(&event, transition);
+		}
+
+		if (Tracker.currentTurn != turn)
+		{
+			RecordMove(turn);
+			stats->moves++;
+		}
+	}
+
+	// Quiet scans get the same background work as they do in Track
+	if (!transitionOccured)
+	{
+		TrackIdleContext(&Tracker);
+	}
+}
+
+/**
+ * @brief Puts the simulated sensors in the state of a recorded frame
+ */
+static void SetSensors(Bitboard frame)
+{
+	for (uint8_t square = 0; square < NUM_SQUARES; square++)
+	{
+		SimSetSensorContext(&Tracker, square, (frame & SQUARE_SENSOR_BIT(square)) != 0);
+	}
+}
+
+/**
+ * @brief Works out the move mover just completed from the squares it left and took since the last turn switch
+ */
+static void RecordMove(enum PieceOwner mover)
+{
+	struct ReplayMove move = { EMPTY_PIECE, 0, 0, 0, 0 };
+	Bitboard vacated = 0;
+	Bitboard taken = 0;
+
+	for (uint8_t square = 0; square < NUM_SQUARES; square++)
+	{
+		Piece before = TurnStartBoard[square];
+		Piece after = Tracker.chessboard[square];
+
+		if (before == after)
+		{
+			continue;
+		}
+		if (PIECE_OWNER(before) == mover)
+		{
+			vacated |= SQUARE_BIT(square);
+		}
+		if (PIECE_OWNER(after) == mover)
+		{
+			taken |= SQUARE_BIT(square);
+		}
+	}
+
+	if (vacated && taken)
+	{
+		// When castling both the king and the rook move, and the king's move is the one that is written down
+		for (Bitboard squares = vacated; squares; )
+		{
+			uint8_t square = PopLowestSquare(&squares);
+			if (square == LowestSquare(vacated) || PIECE_TYPE(TurnStartBoard[square]) == KING)
+			{
+				move.from = square;
+			}
+		}
+		for (Bitboard squares = taken; squares; )
+		{
+			uint8_t square = PopLowestSquare(&squares);
+			if (square == LowestSquare(taken) || PIECE_TYPE(Tracker.chessboard[square]) == KING)
+			{
+				move.to = square;
+			}
+		}
+
+		move.piece = TurnStartBoard[move.from];
+		move.capture = TurnStartBoard[move.to] != EMPTY_PIECE;
+		move.castle = PIECE_TYPE(move.piece) == KING && (SQUARE_COLUMN(move.to) == SQUARE_COLUMN(move.from) + 2
+			|| SQUARE_COLUMN(move.to) + 2 == SQUARE_COLUMN(move.from));
+	}
+
+	if (!Quiet)
+	{
+		printf("           move: ");
+		PrintMove(&move);
+		printf("\n");
+	}
+	if (NumMoves < MAX_REPLAY_MOVES)
+	{
+		Moves[NumMoves++] = move;
+	}
+	memcpy(TurnStartBoard, Tracker.chessboard, sizeof(TurnStartBoard));
+}
+
+static void PrintEvent(const struct SensorEvent* event, uint8_t transition)
+{
+	printf("%8" PRIu32 " ms  %c%c %-6s -> %-16s %s to move%s\n", event->timestamp, 'a' + SQUARE_COLUMN(event->square), '1' + SQUARE_ROW(event->square),
+		event->type == PLACE ? "place" : "pickup", GetTrackerStateName(Tracker.state),
+		Tracker.currentTurn == WHITE ? "white" : "black", transition ? "" : "  (no change)");
+}
+
+static void PrintMove(const struct ReplayMove* move)
+{
+	static const char PIECE_LETTERS[NUM_PIECE_TYPES] = { '?', 'P', 'N', 'B', 'R', 'Q', 'K' };
+
+	if (move->castle)
+	{
+		printf("%s", SQUARE_COLUMN(move->to) == 6 ? "O-O" : "O-O-O");
+		return;
+	}
+	printf("%c%c%c%c%c%c", PIECE_LETTERS[PIECE_TYPE(move->piece)], 'a' + SQUARE_COLUMN(move->from), '1' + SQUARE_ROW(move->from),
+		move->capture ? 'x' : '-', 'a' + SQUARE_COLUMN(move->to), '1' + SQUARE_ROW(move->to));
+}
+
+static void PrintMoveList(void)
+{
+	printf("moves:");
+	for (uint16_t i = 0; i < NumMoves; i++)
+	{
+		if (i % 2 == 0)
+		{
+			printf(" %u.", i / 2 + 1);
+		}
+		printf(" ");
+		PrintMove(&Moves[i]);
+	}
+	printf("%s\n", NumMoves ? "" : " none");
+}
+
+static void PrintStats(const char* name, const struct ReplayStats* stats, double seconds)
+{
+	printf("%s: %" PRIu32 " frame changes, %" PRIu64 " scans (%" PRIu64 " replayed), %" PRIu32 " events, %" PRIu32
+		" transitions, %" PRIu32 " moves, final state %s, %.3f s\n", name, stats->records, stats->scans,
+		stats->replayedScans, stats->events, stats->transitions, stats->moves, GetTrackerStateName(Tracker.state), seconds);
+#ifdef TRACKER_INFER_MOVES
+	printf("%s: %" PRIu32 " moves inferred from the sensed board\n", name, stats->inferred);
+#endif
+}
+
+/**
+ * @brief Reads a whole file into a buffer the caller frees. Returns NULL if it can't be read.
+ */
+static uint8_t* ReadFile(const char* path, uint32_t* length)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+	{
+		return NULL;
+	}
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	uint8_t* data = size > 0 ? malloc((size_t)size) : NULL;
+	if (data && fread(data, 1, (size_t)size, file) != (size_t)size)
+	{
+		free(data);
+		data = NULL;
+	}
+	fclose(file);
+
+	*length = (uint32_t)size;
+	return data;
+}
+
+static void SleepMilliseconds(uint32_t milliseconds)
+{
+	struct timespec delay = { milliseconds / 1000, (long)(milliseconds % 1000) * 1000000 };
+	nanosleep(&delay, NULL);
+}
+
+static double ElapsedSeconds(const struct timespec* start)
+{
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+#ifdef INSTRUMENT
+static void PrintLatencyLine(const char* line)
+{
+	printf("%s\n", line);
+}
+#endif
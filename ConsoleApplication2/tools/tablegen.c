@@ -0,0 +1,326 @@
+/*
+ * Generates tables.c: the const lookup tables used by the pathfinder. The tables are emitted as const data so they
+ * are placed in flash on the target instead of being built into RAM at startup.
+ *
+ * Usage: tablegen > tables.c (or make tables)
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Build the tables writable so the lookups in tables.h can be verified against the ray walker before emitting them
+#define TABLEGEN
+#include "../tables.h"
+#include "../bitboard.h"
+
+Bitboard FillUpAttacks[NUM_COLS][LINE_OCCUPANCY_SIZE];
+Bitboard AFileAttacks[NUM_ROWS][LINE_OCCUPANCY_SIZE];
+Bitboard DiagonalMasks[NUM_SQUARES];
+Bitboard AntiDiagonalMasks[NUM_SQUARES];
+Bitboard KnightAttackTable[NUM_SQUARES];
+Bitboard KingAttackTable[NUM_SQUARES];
+Bitboard PawnAttackTable[NUM_PIECE_OWNERS - 1][NUM_SQUARES];
+Bitboard PawnPushTable[NUM_PIECE_OWNERS - 1][NUM_SQUARES];
+uint64_t ZobristPieceKeys[NUM_PIECE_OWNERS - 1][NUM_PIECE_TYPES - 1][NUM_SQUARES];
+uint64_t ZobristBlackToMove;
+
+static char SizeReport[1024];
+static size_t SizeReportLength;
+static size_t TotalTableSize;
+
+/**
+ * @brief Walks from square in the (rowStep, columnStep) direction until the board edge or the first occupied square
+ */
+static Bitboard SlowRayAttacks(uint8_t square, Bitboard occupied, int rowStep, int columnStep)
+{
+	Bitboard attacks = 0;
+	int row = SQUARE_ROW(square) + rowStep;
+	int column = SQUARE_COLUMN(square) + columnStep;
+
+	while (row >= 0 && row < NUM_ROWS && column >= 0 && column < NUM_COLS)
+	{
+		attacks |= SQUARE_BIT(SQUARE(row, column));
+		if (occupied & SQUARE_BIT(SQUARE(row, column)))
+		{
+			break;
+		}
+		row += rowStep;
+		column += columnStep;
+	}
+	return attacks;
+}
+
+/**
+ * @brief Returns the squares of mask with every bit of index (LSB first) deciding whether the matching square is kept
+ */
+static Bitboard SubsetOf(Bitboard mask, unsigned index)
+{
+	Bitboard subset = 0;
+	for (unsigned bit = 0; mask; bit++)
+	{
+		Bitboard lowest = mask & (0 - mask);
+		if (index & (1u << bit))
+		{
+			subset |= lowest;
+		}
+		mask ^= lowest;
+	}
+	return subset;
+}
+
+static void GenerateLineMasks(void)
+{
+	for (uint8_t square = 0; square < NUM_SQUARES; square++)
+	{
+		DiagonalMasks[square] = SlowRayAttacks(square, 0, 1, 1) | SlowRayAttacks(square, 0, -1, -1);
+		AntiDiagonalMasks[square] = SlowRayAttacks(square, 0, 1, -1) | SlowRayAttacks(square, 0, -1, 1);
+	}
+}
+
+static void GenerateFillUpAttacks(void)
+{
+	for (uint8_t column = 0; column < NUM_COLS; column++)
+	{
+		// Enumerate every occupancy of the first rank, index it like RankAttacks does and record the attacks
+		for (unsigned occupancy = 0; occupancy < 256; occupancy++)
+		{
+			uint8_t index = (uint8_t)(((Bitboard)occupancy * B_FILE) >> 58);
+			Bitboard firstRankAttacks = SlowRayAttacks(column, occupancy, 0, 1) | SlowRayAttacks(column, occupancy, 0, -1);
+			FillUpAttacks[column][index] = firstRankAttacks * A_FILE;
+		}
+	}
+}
+
+static void GenerateAFileAttacks(void)
+{
+	for (uint8_t row = 0; row < NUM_ROWS; row++)
+	{
+		for (unsigned occupancy = 0; occupancy < 256; occupancy++)
+		{
+			Bitboard fileOccupancy = SubsetOf(A_FILE, occupancy);
+			uint8_t index = (uint8_t)((fileOccupancy * C7_H2_DIAGONAL) >> 58);
+			AFileAttacks[row][index] = SlowRayAttacks(SQUARE(row, 0), fileOccupancy, 1, 0) | SlowRayAttacks(SQUARE(row, 0), fileOccupancy, -1, 0);
+		}
+	}
+}
+
+/**
+ * @brief Returns the squares reached from square by each of the (rowStep, columnStep) steps that stay on the board
+ */
+static Bitboard LeaperAttacks(uint8_t square, const int (*steps)[2], size_t numSteps)
+{
+	Bitboard attacks = 0;
+
+	for (size_t step = 0; step < numSteps; step++)
+	{
+		int row = SQUARE_ROW(square) + steps[step][0];
+		int column = SQUARE_COLUMN(square) + steps[step][1];
+		if (row >= 0 && row < NUM_ROWS && column >= 0 && column < NUM_COLS)
+		{
+			attacks |= SQUARE_BIT(SQUARE(row, column));
+		}
+	}
+	return attacks;
+}
+
+static void GenerateLeaperAttacks(void)
+{
+	const int knightSteps[8][2] = { {1, 2}, {-1, 2}, {1, -2}, {-1, -2}, {2, 1}, {-2, 1}, {2, -1}, {-2, -1} };
+	const int kingSteps[8][2] = { {1, -1}, {1, 0}, {1, 1}, {0, -1}, {0, 1}, {-1, -1}, {-1, 0}, {-1, 1} };
+
+	for (uint8_t square = 0; square < NUM_SQUARES; square++)
+	{
+		KnightAttackTable[square] = LeaperAttacks(square, knightSteps, 8);
+		KingAttackTable[square] = LeaperAttacks(square, kingSteps, 8);
+
+		// White pawns move up the rows, black pawns down
+		for (uint8_t team = 0; team < NUM_PIECE_OWNERS - 1; team++)
+		{
+			int forward = team == WHITE - WHITE ? 1 : -1;
+			const int attackSteps[2][2] = { {forward, -1}, {forward, 1} };
+			const int pushSteps[1][2] = { {forward, 0} };
+
+			PawnAttackTable[team][square] = LeaperAttacks(square, attackSteps, 2);
+			PawnPushTable[team][square] = LeaperAttacks(square, pushSteps, 1);
+		}
+	}
+}
+
+/**
+ * @brief Runs the emitted lookups against the ray walker for every square and every occupancy of its lines
+ */
+static void VerifySlidingAttacks(void)
+{
+	for (uint8_t square = 0; square < NUM_SQUARES; square++)
+	{
+		Bitboard rookMask = (SlowRayAttacks(square, 0, 1, 0) | SlowRayAttacks(square, 0, -1, 0)
+			| SlowRayAttacks(square, 0, 0, 1) | SlowRayAttacks(square, 0, 0, -1));
+		Bitboard bishopMask = DiagonalMasks[square] | AntiDiagonalMasks[square];
+		Bitboard masks[2] = { rookMask, bishopMask };
+
+		for (uint8_t slider = 0; slider < 2; slider++)
+		{
+			unsigned numSubsets = 1u << PopCount(masks[slider]);
+			for (unsigned index = 0; index < numSubsets; index++)
+			{
+				Bitboard occupied = SubsetOf(masks[slider], index);
+				Bitboard expected;
+				Bitboard actual;
+
+				if (slider == 0)
+				{
+					expected = SlowRayAttacks(square, occupied, 1, 0) | SlowRayAttacks(square, occupied, -1, 0)
+						| SlowRayAttacks(square, occupied, 0, 1) | SlowRayAttacks(square, occupied, 0, -1);
+					actual = RookAttacks(square, occupied);
+				}
+				else
+				{
+					expected = SlowRayAttacks(square, occupied, 1, 1) | SlowRayAttacks(square, occupied, -1, -1)
+						| SlowRayAttacks(square, occupied, 1, -1) | SlowRayAttacks(square, occupied, -1, 1);
+					actual = BishopAttacks(square, occupied);
+				}
+
+				if (expected != actual)
+				{
+					fprintf(stderr, "tablegen: sliding attack mismatch on square %u\n", square);
+					exit(1);
+				}
+			}
+		}
+	}
+}
+
+/**
+ * @brief xorshift64* with a fixed seed, so regenerating the tables always gives the same keys
+ */
+static uint64_t NextRandom(void)
+{
+	static uint64_t state = 0x9E3779B97F4A7C15ULL;
+
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	return state * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * @brief Fills the Zobrist keys with random values, making sure none are 0 or repeated
+ */
+static void GenerateZobristKeys(void)
+{
+	uint64_t* keys = &ZobristPieceKeys[0][0][0];
+	size_t numKeys = sizeof(ZobristPieceKeys) / sizeof(ZobristPieceKeys[0][0][0]);
+
+	for (size_t i = 0; i < numKeys; i++)
+	{
+		keys[i] = NextRandom();
+	}
+	ZobristBlackToMove = NextRandom();
+
+	for (size_t i = 0; i < numKeys; i++)
+	{
+		for (size_t j = 0; j < i; j++)
+		{
+			if (keys[i] == 0 || keys[i] == keys[j] || keys[i] == ZobristBlackToMove)
+			{
+				fprintf(stderr, "tablegen: Zobrist key %zu is not unique\n", i);
+				exit(1);
+			}
+		}
+	}
+}
+
+/**
+ * @brief Prints the values of a table with the given shape, wrapping each inner array in a brace pair
+ */
+static void EmitValues(const uint64_t* values, const size_t* shape, size_t numDimensions, uint8_t indent)
+{
+	const size_t entriesPerRow = 4;
+
+	if (numDimensions > 1)
+	{
+		size_t stride = 1;
+		for (size_t dimension = 1; dimension < numDimensions; dimension++)
+		{
+			stride *= shape[dimension];
+		}
+
+		for (size_t i = 0; i < shape[0]; i++)
+		{
+			printf("%.*s{\n", indent, "\t\t\t\t");
+			EmitValues(values + i * stride, shape + 1, numDimensions - 1, indent + 1);
+			printf("%.*s},\n", indent, "\t\t\t\t");
+		}
+		return;
+	}
+
+	for (size_t i = 0; i < shape[0]; i++)
+	{
+		if (i % entriesPerRow == 0)
+		{
+			printf("%.*s", indent, "\t\t\t\t");
+		}
+		printf("0x%016" PRIX64 "ULL,", values[i]);
+		printf((i % entriesPerRow == entriesPerRow - 1) ? "\n" : " ");
+	}
+}
+
+/**
+ * @brief Prints table as a C initializer and adds it to the size report
+ */
+static void EmitTable(const char* type, const char* name, const char* dimensions, const uint64_t* table, const size_t* shape, size_t numDimensions)
+{
+	size_t numEntries = 1;
+	for (size_t dimension = 0; dimension < numDimensions; dimension++)
+	{
+		numEntries *= shape[dimension];
+	}
+
+	printf("const %s %s%s = {\n", type, name, dimensions);
+	EmitValues(table, shape, numDimensions, 1);
+	printf("};\n\n");
+
+	SizeReportLength += snprintf(SizeReport + SizeReportLength, sizeof(SizeReport) - SizeReportLength,
+		" * %-20s %6zu bytes\n", name, numEntries * sizeof(uint64_t));
+	TotalTableSize += numEntries * sizeof(uint64_t);
+}
+
+int main(void)
+{
+	GenerateLineMasks();
+	GenerateFillUpAttacks();
+	GenerateAFileAttacks();
+	VerifySlidingAttacks();
+	GenerateLeaperAttacks();
+	GenerateZobristKeys();
+
+	printf("/* Generated by tools/tablegen.c - do not edit. Regenerate with: make tables */\n\n");
+	printf("#include \"tables.h\"\n\n");
+
+	const size_t lineShape[2] = { NUM_COLS, LINE_OCCUPANCY_SIZE };
+	const size_t squareShape[1] = { NUM_SQUARES };
+	const size_t pawnShape[2] = { NUM_PIECE_OWNERS - 1, NUM_SQUARES };
+	const size_t zobristShape[3] = { NUM_PIECE_OWNERS - 1, NUM_PIECE_TYPES - 1, NUM_SQUARES };
+
+	EmitTable("Bitboard", "FillUpAttacks", "[NUM_COLS][LINE_OCCUPANCY_SIZE]", &FillUpAttacks[0][0], lineShape, 2);
+	EmitTable("Bitboard", "AFileAttacks", "[NUM_ROWS][LINE_OCCUPANCY_SIZE]", &AFileAttacks[0][0], lineShape, 2);
+	EmitTable("Bitboard", "DiagonalMasks", "[NUM_SQUARES]", DiagonalMasks, squareShape, 1);
+	EmitTable("Bitboard", "AntiDiagonalMasks", "[NUM_SQUARES]", AntiDiagonalMasks, squareShape, 1);
+	EmitTable("Bitboard", "KnightAttackTable", "[NUM_SQUARES]", KnightAttackTable, squareShape, 1);
+	EmitTable("Bitboard", "KingAttackTable", "[NUM_SQUARES]", KingAttackTable, squareShape, 1);
+	EmitTable("Bitboard", "PawnAttackTable", "[NUM_PIECE_OWNERS - 1][NUM_SQUARES]", &PawnAttackTable[0][0], pawnShape, 2);
+	EmitTable("Bitboard", "PawnPushTable", "[NUM_PIECE_OWNERS - 1][NUM_SQUARES]", &PawnPushTable[0][0], pawnShape, 2);
+	EmitTable("uint64_t", "ZobristPieceKeys", "[NUM_PIECE_OWNERS - 1][NUM_PIECE_TYPES - 1][NUM_SQUARES]", &ZobristPieceKeys[0][0][0], zobristShape, 3);
+	printf("const uint64_t ZobristBlackToMove = 0x%016" PRIX64 "ULL;\n\n", ZobristBlackToMove);
+	SizeReportLength += snprintf(SizeReport + SizeReportLength, sizeof(SizeReport) - SizeReportLength,
+		" * %-20s %6zu bytes\n", "ZobristBlackToMove", sizeof(ZobristBlackToMove));
+	TotalTableSize += sizeof(ZobristBlackToMove);
+
+	// Size report, both in the generated file and on the console
+	SizeReportLength += snprintf(SizeReport + SizeReportLength, sizeof(SizeReport) - SizeReportLength,
+		" * %-20s %6zu bytes\n", "total", TotalTableSize);
+	printf("/*\n * Table sizes (flash):\n%s */\n", SizeReport);
+	fprintf(stderr, "%s", SizeReport);
+	return 0;
+}
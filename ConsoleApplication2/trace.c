@@ -0,0 +1,150 @@
+#include "trace.h"
+#include "bitboard.h"
+#include "bytes.h"
+
+static uint8_t PutVarint(uint8_t* bytes, uint32_t value);
+static uint8_t GetVarint(struct TraceReader* reader, uint32_t* value);
+
+void InitTraceWriter(struct TraceWriter* writer, TraceWriteFunction write, void* user)
+{
+	writer->write = write;
+	writer->user = user;
+	writer->started = 0;
+	writer->lastFrame = 0;
+	writer->lastTimestamp = 0;
+	writer->scans = 0;
+	writer->records = 0;
+	writer->bytes = 0;
+}
+
+void RecordTraceFrame(struct TraceWriter* writer, uint32_t timestamp, Bitboard frame)
+{
+	// The first frame goes into the header whole, everything after it as the squares that flipped
+	if (!writer->started)
+	{
+		uint8_t header[TRACE_HEADER_SIZE] = { TRACE_MAGIC[0], TRACE_MAGIC[1], TRACE_MAGIC[2], TRACE_MAGIC[3] };
+		PutLittleEndian(header + 4, timestamp, 4);
+		PutLittleEndian(header + 8, frame, 8);
+		writer->write(writer->user, header, TRACE_HEADER_SIZE);
+
+		writer->started = 1;
+		writer->lastFrame = frame;
+		writer->lastTimestamp = timestamp;
+		writer->bytes += TRACE_HEADER_SIZE;
+		return;
+	}
+
+	writer->scans++;
+	Bitboard flipped = frame ^ writer->lastFrame;
+	if (!flipped)
+	{
+		return;
+	}
+
+	uint8_t record[TRACE_MAX_RECORD_SIZE];
+	uint8_t length = PutVarint(record, writer->scans);
+	length += PutVarint(record + length, timestamp - writer->lastTimestamp);
+	record[length++] = PopCount(flipped);
+	while (flipped)
+	{
+		record[length++] = PopLowestSquare(&flipped);
+	}
+	writer->write(writer->user, record, length);
+
+	writer->lastFrame = frame;
+	writer->lastTimestamp = timestamp;
+	writer->scans = 0;
+	writer->records++;
+	writer->bytes += length;
+}
+
+uint8_t OpenTraceReader(struct TraceReader* reader, const uint8_t* data, uint32_t length)
+{
+	if (length < TRACE_HEADER_SIZE || data[0] != TRACE_MAGIC[0] || data[1] != TRACE_MAGIC[1]
+		|| data[2] != TRACE_MAGIC[2] || data[3] != TRACE_MAGIC[3])
+	{
+		return 0;
+	}
+
+	reader->data = data;
+	reader->length = length;
+	reader->offset = TRACE_HEADER_SIZE;
+	reader->truncated = 0;
+	reader->malformed = 0;
+	reader->timestamp = (uint32_t)GetLittleEndian(data + 4, 4);
+	reader->frame = GetLittleEndian(data + 8, 8);
+	return 1;
+}
+
+uint8_t ReadTraceRecord(struct TraceReader* reader, struct TraceRecord* record)
+{
+	if (reader->offset == reader->length)
+	{
+		return 0;
+	}
+
+	uint32_t scans, elapsed;
+	if (!GetVarint(reader, &scans) || !GetVarint(reader, &elapsed) || reader->offset == reader->length)
+	{
+		reader->truncated = 1;
+		return 0;
+	}
+
+	// Every record counts at least the scan that saw its frame
+	if (scans == 0)
+	{
+		reader->malformed = 1;
+		return 0;
+	}
+
+	uint8_t numFlipped = reader->data[reader->offset++];
+	if (reader->length - reader->offset < numFlipped)
+	{
+		reader->truncated = 1;
+		return 0;
+	}
+
+	for (uint8_t i = 0; i < numFlipped; i++)
+	{
+		reader->frame ^= SQUARE_BIT(reader->data[reader->offset++] & (NUM_SQUARES - 1));
+	}
+	reader->timestamp += elapsed;
+
+	record->scans = scans;
+	record->timestamp = reader->timestamp;
+	record->frame = reader->frame;
+	return 1;
+}
+
+/**
+ * @brief Writes value as a varint and returns the number of bytes it took
+ */
+static uint8_t PutVarint(uint8_t* bytes, uint32_t value)
+{
+	uint8_t length = 0;
+	while (value >= 0x80)
+	{
+		bytes[length++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	bytes[length++] = (uint8_t)value;
+	return length;
+}
+
+/**
+ * @brief Reads a varint at the reader's offset. Returns 0 if the trace ends before it does.
+ */
+static uint8_t GetVarint(struct TraceReader* reader, uint32_t* value)
+{
+	*value = 0;
+	for (uint8_t shift = 0; shift < 35 && reader->offset < reader->length; shift += 7)
+	{
+		uint8_t byte = reader->data[reader->offset++];
+		*value |= (uint32_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
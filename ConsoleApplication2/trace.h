@@ -0,0 +1,79 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include "types.h"
+
+/*
+ * Compact binary record of the raw sensor frames a board scanned, before debouncing, so a misbehaving game can be
+ * replayed through the tracker later (tools/replay.c). Only frames that differ from the one before are stored:
+ *
+ * Header:  "CBT1", timestamp of the first frame (4 bytes little endian), first frame (8 bytes little endian)
+ * Record:  scans since the last record including this one (varint), milliseconds since the last record (varint),
+ *          number of squares that flipped (1 byte), the sensor bit (see SENSOR_BIT) of each of them (1 byte each)
+ *
+ * Varints are LEB128: 7 bits per byte, low bits first, the top bit set on every byte but the last. A move usually
+ * takes two records of 4 to 6 bytes each.
+ */
+
+#define TRACE_MAGIC "CBT1"
+#define TRACE_HEADER_SIZE 16
+#define TRACE_MAX_RECORD_SIZE (5 + 5 + 1 + NUM_SQUARES)
+
+/**
+ * @brief Where recorded bytes go: a file in the simulator, a flash region or the debug UART on the target
+ */
+typedef void (*TraceWriteFunction)(void* user, const uint8_t* bytes, uint8_t length);
+
+struct TraceWriter {
+	TraceWriteFunction write;
+	void* user;
+	uint8_t started;		// Whether the header has been written
+	Bitboard lastFrame;
+	uint32_t lastTimestamp;
+	uint32_t scans;			// Scans since the last record
+	uint32_t records;
+	uint32_t bytes;			// Bytes handed to write, header included
+};
+
+/**
+ * @brief A change of the sensed frame read back from a trace
+ */
+struct TraceRecord {
+	uint32_t scans;			// Scans since the previous frame, the first scan of the new frame included
+	uint32_t timestamp;		// Absolute, rebuilt from the deltas
+	Bitboard frame;
+};
+
+struct TraceReader {
+	const uint8_t* data;
+	uint32_t length;
+	uint32_t offset;
+	uint8_t truncated;		// Set if the trace ended in the middle of a record
+	uint8_t malformed;		// Set if a record claimed no scans, which a writer never records
+	uint32_t timestamp;
+	Bitboard frame;
+};
+
+/**
+ * @brief Starts a trace that hands its bytes to write. Nothing is written until the first frame is recorded.
+ */
+void InitTraceWriter(struct TraceWriter* writer, TraceWriteFunction write, void* user);
+
+/**
+ * @brief Records a scanned frame. Frames equal to the last one are only counted.
+ */
+void RecordTraceFrame(struct TraceWriter* writer, uint32_t timestamp, Bitboard frame);
+
+/**
+ * @brief Reads the header of the trace in data. Returns 0 if it isn't a trace, 1 otherwise with the first frame and its
+ * timestamp in the reader.
+ */
+uint8_t OpenTraceReader(struct TraceReader* reader, const uint8_t* data, uint32_t length);
+
+/**
+ * @brief Reads the next frame change. Returns 0 at the end of the trace or at a record that is cut short or malformed
+ * (see truncated and malformed), 1 otherwise.
+ */
+uint8_t ReadTraceRecord(struct TraceReader* reader, struct TraceRecord* record);
+
+#endif /* TRACE_H_ */
@@ -2,103 +2,152 @@
 #include "tracker.h"
 #include "pathfinder.h"
 #include "types.h"
+#include "bitboard.h"
+#include "instrument.h"
+#ifdef INSTRUMENT
+#include <stdio.h>
+#endif
 #ifdef SIM
-#include <windows.h>
 #include "sim.h"
 #else
 #include "chessclock.h"
 #endif
 
 // Placement Handlers //
-static void HandlePlace(struct PieceCoordinate placedPiece);
-static void HandlePlaceIllegalState(struct PieceCoordinate placedPiece);
-static void HandlePlaceKill(struct PieceCoordinate placedPiece);
-static void HandlePlaceCastling(struct PieceCoordinate placedPiece);
-static void HandlePlaceMove(struct PieceCoordinate placedPiece);
-static void HandlePlaceNoMove(struct PieceCoordinate placedPiece);
-static void HandlePlacePreemptPromotion(struct PieceCoordinate placedPiece);
-static void HandlePlacePromotion(struct PieceCoordinate placedPiece);
+static void HandlePlace(struct TrackerContext* context, PieceCoordinate placedPiece);
+static void HandlePlaceIllegalState(struct TrackerContext* context, PieceCoordinate placedPiece);
+static void HandlePlaceKill(struct TrackerContext* context, PieceCoordinate placedPiece);
+static void HandlePlaceCastling(struct TrackerContext* context, PieceCoordinate placedPiece);
+static void HandlePlaceMove(struct TrackerContext* context, PieceCoordinate placedPiece);
+static void HandlePlaceNoMove(struct TrackerContext* context, PieceCoordinate placedPiece);
+static void HandlePlacePreemptPromotion(struct TrackerContext* context, PieceCoordinate placedPiece);
+static void HandlePlacePromotion(struct TrackerContext* context, PieceCoordinate placedPiece);
 
 // Pickup Handlers //
-static void HandlePickup(struct PieceCoordinate pickedUpPiece);
-static void HandlePickupIllegalState(struct PieceCoordinate pickedUpPiece);
-static void HandlePickupPreemptKill(struct PieceCoordinate pickedUpPiece);
-static void HandlePickupKill(struct PieceCoordinate pickedUpPiece);
-static void HandlePickupCastling(struct PieceCoordinate pickedUpPiece);
-static void HandlePickupMove(struct PieceCoordinate pickedUpPiece);
-static void HandlePickupPromotion(struct PieceCoordinate pickedUpPiece);
+static void HandlePickup(struct TrackerContext* context, PieceCoordinate pickedUpPiece);
+static void HandlePickupIllegalState(struct TrackerContext* context, PieceCoordinate pickedUpPiece);
+static void HandlePickupPreemptKill(struct TrackerContext* context, PieceCoordinate pickedUpPiece);
+static void HandlePickupKill(struct TrackerContext* context, PieceCoordinate pickedUpPiece);
+static void HandlePickupCastling(struct TrackerContext* context, PieceCoordinate pickedUpPiece);
+static void HandlePickupMove(struct TrackerContext* context, PieceCoordinate pickedUpPiece);
+static void HandlePickupPromotion(struct TrackerContext* context, PieceCoordinate pickedUpPiece);
+
+// State Machine //
+static void DispatchTransition(struct TrackerContext* context, enum TrackerEvent event, PieceCoordinate pieceCoordinate);
+static enum TrackerState CalculateTrackerState(struct TrackerContext* context);
 
 // Internal Updaters //
-static void UpdateCastleFlags();
-static void AddIllegalPiece(struct PieceCoordinate current, struct PieceCoordinate destination);
-static void RemoveIllegalPiece(uint8_t index);
-static void CheckChessboardValidity(uint8_t switchTurns);
-static void EndTurn();
-static void SetPiece(uint8_t row, uint8_t column, struct Piece piece);
-static void SetPieceCoordinate(struct PieceCoordinate pieceCoordinate);
-static void ClearPiece(struct PieceCoordinate* pieceCoordinate);
+static void UpdateCastleFlags(struct TrackerContext* context);
+static void AddIllegalPiece(struct TrackerContext* context, PieceCoordinate current, PieceCoordinate destination);
+static void CheckChessboardValidity(struct TrackerContext* context, uint8_t switchTurns);
+static void EndTurn(struct TrackerContext* context);
+static uint16_t CalculateTurnMove(struct TrackerContext* context);
+static void SaveTrackerCheckpoint(struct TrackerContext* context);
+#ifdef TRACKER_INFER_MOVES
+static uint8_t InferCastling(struct TrackerContext* context, Bitboard occupied, Bitboard landed, uint8_t* kingFrom, uint8_t* kingTo);
+static void PlayInferredMove(struct TrackerContext* context, uint8_t from, uint8_t to);
+#endif
+static void SetPiece(struct TrackerContext* context, uint8_t square, Piece piece);
+static void ClearPiece(PieceCoordinate* pieceCoordinate);
 
 // Legal Move Detection //
-static uint8_t ValidateMove(struct PieceCoordinate from, struct PieceCoordinate to);
-static uint8_t ValidateKill(struct PieceCoordinate victim, struct PieceCoordinate killer);
-static uint8_t ValidateCastling(struct PieceCoordinate rook, struct PieceCoordinate king);
-static uint8_t DidOtherTeamPickupLast(struct Piece piece);
-static uint8_t DidSameTeamPickupLast(struct Piece piece);
+static uint8_t ValidateMove(struct TrackerContext* context, PieceCoordinate from, PieceCoordinate to);
+static uint8_t ValidateKill(struct TrackerContext* context, PieceCoordinate killer);
+static uint8_t ValidateCastling(struct TrackerContext* context, PieceCoordinate rook, PieceCoordinate king);
+static uint8_t DidOtherTeamPickupLast(struct TrackerContext* context, Piece piece);
+static uint8_t DidSameTeamPickupLast(struct TrackerContext* context, Piece piece);
 
 // Utilities //
-static uint8_t PawnReachedEnd(struct PieceCoordinate pieceCoordinate);
-static uint8_t PieceExists(struct PieceCoordinate placedPiece);
-
+static Bitboard ReadSensors(struct TrackerContext* context);
+#ifdef TRACKER_INFER_MOVES
+static Bitboard ReadScanned(struct TrackerContext* context);
+#endif
+static uint32_t GetTimestamp(struct TrackerContext* context);
+static uint8_t PawnReachedEnd(struct TrackerContext* context, PieceCoordinate pieceCoordinate);
+static uint8_t PieceExists(PieceCoordinate placedPiece);
 
 
-// State Fields //
-static struct Piece Chessboard[NUM_ROWS][NUM_COLS];
-static enum PieceOwner CurrentTurn;
-static enum TransitionType LastTransitionType;
-static struct PieceCoordinate LastPickedUpPiece;
 
-// Legal Piece Detection/Recovery Fields //
-static struct PieceCoordinate PieceToKill;
-static struct IllegalMove IllegalPieces[NUM_ILLEGAL_PIECES];
-static uint8_t NumIllegalPieces;
-static uint8_t SwitchTurnsAfterLegalState;
+// Context used by the single-board functions //
+static struct TrackerContext DefaultTrackerContext;
 
-// Castling //
-static uint8_t CanA1Castle;
-static uint8_t CanH1Castle;
-static uint8_t CanA8Castle;
-static uint8_t CanH8Castle;
-static uint8_t CanWhiteKingCastle;
-static uint8_t CanBlackKingCastle;
-static struct PieceCoordinate ExpectedKingCastleCoordinate;
-static struct PieceCoordinate ExpectedRookCastleCoordinate;
+/**
+ * @brief Handler run for an event in a state, along with its name for dumping the table
+ */
+struct TrackerTransition {
+	void (*handler)(struct TrackerContext* context, PieceCoordinate pieceCoordinate);
+#ifdef INSTRUMENT
+	const char* name;
+	enum LatencyProbe probe;
+#endif
+};
 
-// Promotion //
-static struct PieceCoordinate PawnToPromote;
+#ifdef INSTRUMENT
+#define TRANSITION(handler) { handler, #handler, PROBE_##handler }
+#else
+#define TRANSITION(handler) { handler }
+#endif
 
+// Indexed by [state][event], columns in the order of enum TrackerEvent
+static const struct TrackerTransition TRACKER_TRANSITIONS[NUM_TRACKER_STATES][NUM_TRACKER_EVENTS] = {
+	// STATE_NORMAL
+	{ TRANSITION(HandlePickupMove), TRANSITION(HandlePickupPreemptKill), TRANSITION(HandlePickupCastling), TRANSITION(HandlePlaceMove), TRANSITION(HandlePlaceNoMove) },
+	// STATE_KILL_PENDING
+	{ TRANSITION(HandlePickupKill), TRANSITION(HandlePickupPreemptKill), TRANSITION(HandlePickupKill), TRANSITION(HandlePlaceKill), TRANSITION(HandlePlaceNoMove) },
+	// STATE_CASTLING
+	{ TRANSITION(HandlePickupMove), TRANSITION(HandlePickupPreemptKill), TRANSITION(HandlePickupCastling), TRANSITION(HandlePlaceCastling), TRANSITION(HandlePlaceNoMove) },
+	// STATE_PROMOTION
+	{ TRANSITION(HandlePickupPromotion), TRANSITION(HandlePickupPreemptKill), TRANSITION(HandlePickupPromotion), TRANSITION(HandlePlacePromotion), TRANSITION(HandlePlaceNoMove) },
+	// STATE_ILLEGAL_RECOVERY
+	{ TRANSITION(HandlePickupIllegalState), TRANSITION(HandlePickupIllegalState), TRANSITION(HandlePickupIllegalState), TRANSITION(HandlePlaceIllegalState), TRANSITION(HandlePlaceIllegalState) },
+};
 
+#if defined(SIM) || defined(INSTRUMENT)
+static const char* const TRACKER_STATE_NAMES[NUM_TRACKER_STATES] = { "NORMAL", "KILL_PENDING", "CASTLING", "PROMOTION", "ILLEGAL_RECOVERY" };
+#endif
+#ifdef INSTRUMENT
+static const char* const TRACKER_EVENT_NAMES[NUM_TRACKER_EVENTS] = { "PICKUP", "PICKUP_ENEMY", "PICKUP_AGAIN", "PLACE", "PLACE_RETURN" };
+#endif
 
 #ifdef SIM
-uint8_t SimColumn = 0;
-volatile uint8_t SimSensors[NUM_ROWS][NUM_COLS] = {
-	{1, 1, 1, 1, 1, 1, 1, 1},
-	{1, 1, 1, 1, 1, 1, 1, 1},
-	{0, 0, 0, 0, 0, 0, 0, 0},
-	{0, 0, 0, 0, 0, 0, 0, 0},
-	{0, 0, 0, 0, 0, 0, 0, 0},
-	{0, 0, 0, 0, 0, 0, 0, 0},
-	{1, 1, 1, 1, 1, 1, 1, 1},
-	{1, 1, 1, 1, 1, 1, 1, 1},
-};
+void SimSetSensorContext(struct TrackerContext* context, uint8_t square, uint8_t value)
+{
+	context->simSensors[square] = value;
+}
+
+void SimAdvanceTimeContext(struct TrackerContext* context, uint32_t milliseconds)
+{
+	context->simTime += milliseconds;
+}
 
-void SimSetSensor(uint8_t row, uint8_t column, uint8_t value)
+static uint8_t SimGetSensor(struct TrackerContext* context, uint8_t row)
 {
-	SimSensors[row][column] = value;
+	return context->simSensors[SQUARE(row, context->simColumn)];
 }
 
-uint8_t SimGetSensor(uint8_t row)
+const char* GetTrackerStateName(enum TrackerState state)
 {
-	return SimSensors[row][SimColumn];
+	return state < NUM_TRACKER_STATES ? TRACKER_STATE_NAMES[state] : "UNKNOWN";
+}
+#endif
+
+#ifdef INSTRUMENT
+void DumpTrackerTransitionsContext(struct TrackerContext* context, LatencyPrintFunction print)
+{
+	char line[96];
+
+	snprintf(line, sizeof(line), "%-16s %-12s    %-26s %10s", "state", "event", "handler", "taken");
+	print(line);
+
+	for (uint8_t state = 0; state < NUM_TRACKER_STATES; state++)
+	{
+		for (uint8_t event = 0; event < NUM_TRACKER_EVENTS; event++)
+		{
+			snprintf(line, sizeof(line), "%-16s %-12s -> %-26s %10lu", TRACKER_STATE_NAMES[state], TRACKER_EVENT_NAMES[event],
+				TRACKER_TRANSITIONS[state][event].name, (unsigned long)context->transitionCounts[state][event]);
+			print(line);
+		}
+	}
 }
 #endif
 
@@ -138,24 +187,40 @@ static void InitGPIO_Pin(struct GPIO_Pin pin, uint32_t mode, uint32_t pull)
 }
 #endif
 
-void InitTracker()
+void InitTrackerContext(struct TrackerContext* context)
 {
-	// Initialize globals
-	LastTransitionType = PLACE;
-	CurrentTurn = WHITE;
-	CanA1Castle = 1;
-	CanH1Castle = 1;
-	CanA8Castle = 1;
-	CanH8Castle = 1;
-	CanWhiteKingCastle = 1;
-	CanBlackKingCastle = 1;
-	SwitchTurnsAfterLegalState = 0;
-
-	ClearPiece(&LastPickedUpPiece);
-	ClearPiece(&PieceToKill);
-	ClearPiece(&ExpectedKingCastleCoordinate);
-	ClearPiece(&ExpectedRookCastleCoordinate);
-	ClearPiece(&PawnToPromote);
+	// Initialize state
+	context->lastTransitionType = PLACE;
+	context->state = STATE_NORMAL;
+	context->currentTurn = WHITE;
+	context->canA1Castle = 1;
+	context->canH1Castle = 1;
+	context->canA8Castle = 1;
+	context->canH8Castle = 1;
+	context->canWhiteKingCastle = 1;
+	context->canBlackKingCastle = 1;
+	context->switchTurnsAfterLegalState = 0;
+
+	ClearPiece(&context->lastPickedUpPiece);
+	ClearPiece(&context->pieceToKill);
+	context->killers = 0;
+	ClearPiece(&context->expectedKingCastleCoordinate);
+	ClearPiece(&context->expectedRookCastleCoordinate);
+	ClearPiece(&context->pawnToPromote);
+#ifdef TRACKER_INFER_MOVES
+	context->landed = 0;
+	context->unordered = 0;
+#endif
+
+#ifdef INSTRUMENT
+	for (uint8_t state = 0; state < NUM_TRACKER_STATES; state++)
+	{
+		for (uint8_t event = 0; event < NUM_TRACKER_EVENTS; event++)
+		{
+			context->transitionCounts[state][event] = 0;
+		}
+	}
+#endif
 
 #ifndef SIM
 	// Initialize output column bits IO and the chessboard data structure
@@ -172,27 +237,60 @@ void InitTracker()
 #endif
 
 	// Initialize the board data structure to the initial chessboard
-	for (uint8_t column = 0; column < NUM_COLS; column++)
+	context->occupied = 0;
+	for (uint8_t square = 0; square < NUM_SQUARES; square++)
 	{
-		for (uint8_t row = 0; row < NUM_ROWS; row++)
-		{
-			Chessboard[row][column] = INITIAL_CHESSBOARD[row][column];
-		}
+		SetPiece(context, square, INITIAL_CHESSBOARD[square]);
+	}
+
+	// The scanner starts out expecting the pieces to be where the chessboard has them
+	InitDebouncer(&context->debouncer, context->occupied);
+	context->scanned = context->occupied;
+#if defined(TRACKER_ASYNC_SCAN) && defined(TRACKER_INFER_MOVES)
+	context->scanSequence = 0;
+#endif
+#ifdef TRACKER_INFER_MOVES
+	context->seen = context->occupied;
+#endif
+	InitSensorEventQueue(&context->events);
+	context->trace = 0;
+	context->checkpoint = 0;
+
+#ifdef INSTRUMENT
+	InitLatencyCounter();
+#endif
+
+#ifdef SIM
+	// Simulated sensors start out seeing the initial chessboard
+	context->simTime = 0;
+	context->simColumn = 0;
+	for (uint8_t square = 0; square < NUM_SQUARES; square++)
+	{
+		context->simSensors[square] = INITIAL_CHESSBOARD[square] != EMPTY_PIECE;
 	}
+#endif
 
 	// Initialize illegal piece destinations to empty pieces
-	NumIllegalPieces = 0;
-	for (uint8_t i = 0; i < NUM_ILLEGAL_PIECES; i++)
+	context->mustEmpty = 0;
+	context->mustFill = 0;
+	for (uint8_t square = 0; square < NUM_SQUARES; square++)
 	{
-		IllegalPieces[i].destination = EMPTY_PIECE_COORDINATE;
-		IllegalPieces[i].current = EMPTY_PIECE_COORDINATE;
+		context->expectedPieces[square] = EMPTY_PIECE;
 	}
 
 	// Initialize PathFinder
-	CalculateTeamsLegalMoves(CurrentTurn);
+	InitPathfinderContext(&context->pathfinder);
+#ifdef TRACKER_SPECULATE
+	InitSpeculation(&context->speculation);
+#endif
+#ifdef TRACKER_LAZY_LEGAL_MOVES
+	BeginTeamsLegalMovesContext(&context->pathfinder, context->chessboard, context->currentTurn);
+#else
+	CalculateTeamsLegalMovesContext(&context->pathfinder, context->chessboard, context->currentTurn);
+#endif
 }
 
-static void WriteColumn(uint8_t column)
+static void WriteColumn(struct TrackerContext* context, uint8_t column)
 {
 #ifndef SIM
 	uint8_t columnBit0 = (column & 1) >> 0;
@@ -203,11 +301,11 @@ static void WriteColumn(uint8_t column)
 	HAL_GPIO_WritePin(COLUMN_BIT_TO_PIN_TABLE[1].bus, COLUMN_BIT_TO_PIN_TABLE[1].pin, columnBit1);
 	HAL_GPIO_WritePin(COLUMN_BIT_TO_PIN_TABLE[2].bus, COLUMN_BIT_TO_PIN_TABLE[2].pin, columnBit2);
 #else
-	SimColumn = column;
+	context->simColumn = column;
 #endif
 }
 
-static uint8_t ReadRow(uint8_t rowNumber)
+static uint8_t ReadRow(struct TrackerContext* context, uint8_t rowNumber)
 {
 	uint8_t value;
 
@@ -215,469 +313,736 @@ static uint8_t ReadRow(uint8_t rowNumber)
 	struct GPIO_Pin rowPin = ROW_NUMBER_TO_PIN_TABLE[rowNumber];
 	GPIO_PinState value = HAL_GPIO_ReadPin(rowPin.bus, rowPin.pin);
 #else
-	value = SimGetSensor(rowNumber);
+	value = SimGetSensor(context, rowNumber);
 #endif
 
 	return value;
 }
 
-uint8_t Track()
+/**
+ * @brief Reads the whole board, one column byte at a time, into sensor bits (see SENSOR_BIT)
+ */
+static Bitboard ReadSensors(struct TrackerContext* context)
 {
-	uint8_t transitionOccured = 0;
+	Bitboard sensed = 0;
 
 	for (uint8_t column = 0; column < NUM_COLS; column++)
 	{
-		WriteColumn(column);
+		uint8_t columnSensors = 0;
 
+		WriteColumn(context, column);
 		for (uint8_t row = 0; row < NUM_ROWS; row++)
 		{
-			uint8_t cellValue = ReadRow(row);
+			columnSensors |= (ReadRow(context, row) != 0) << row;
+		}
+		sensed |= (Bitboard)columnSensors << (column << 3);
+	}
+	return sensed;
+}
 
-			struct PieceCoordinate currentPieceCoordinate = GetPieceCoordinate(row, column);
+#ifdef TRACKER_INFER_MOVES
+/**
+ * @brief Returns the scanned sensor bits. With TRACKER_ASYNC_SCAN the scanner may be changing them meanwhile, and 64
+ * bits take two loads on the target, so the read is retried until no update overlapped it.
+ */
+static Bitboard ReadScanned(struct TrackerContext* context)
+{
+#ifdef TRACKER_ASYNC_SCAN
+	uint32_t sequence;
+	Bitboard scanned;
 
-			// If there was no piece here but the IO is HIGH, a piece was placed
-			if ((currentPieceCoordinate.piece.type == NONE) && (cellValue == 1))
-			{
-				HandlePlace(currentPieceCoordinate);
-				transitionOccured = 1;
-			}
+	do
+	{
+		sequence = LOAD_ACQUIRE(context->scanSequence);
+		scanned = context->scanned;
+		THREAD_FENCE();
+	} while ((sequence & 1) || sequence != context->scanSequence);
+	return scanned;
+#else
+	return context->scanned;
+#endif
+}
+#endif
 
-			// If there was a piece here but the IO is LOW, a piece has been picked up
-			else if ((currentPieceCoordinate.piece.type != NONE) && (cellValue == 0))
-			{
-				HandlePickup(currentPieceCoordinate);
-				transitionOccured = 1;
-			}
+void ScanContext(struct TrackerContext* context)
+{
+	// Read the whole board first
+	Bitboard sensed = ReadSensors(context);
+
+	// Record the raw frame before the filter gets to it, so a replay sees exactly what the sensors did
+	if (context->trace)
+	{
+		RecordTraceFrame(context->trace, GetTimestamp(context), sensed);
+	}
+	sensed = DebounceSample(&context->debouncer, sensed);
+
+	// Queue the squares whose sensor changed since the last scan, in the order they were scanned
+	Bitboard changed = sensed ^ context->scanned;
+	if (!changed)
+	{
+		return;
+	}
+
+	uint32_t timestamp = GetTimestamp(context);
+#if defined(TRACKER_ASYNC_SCAN) && defined(TRACKER_INFER_MOVES)
+	STORE_RELEASE(context->scanSequence, context->scanSequence + 1);
+	THREAD_FENCE();
+#endif
+	while (changed)
+	{
+		uint8_t bit = PopLowestSquare(&changed);
+		struct SensorEvent event = { timestamp, SENSOR_SQUARE(bit), ((sensed >> bit) & 1) ? PLACE : PICKUP };
+
+		// If the queue is full, leave the rest of the changes for the next scan to queue instead of losing them
+		if (!PushSensorEvent(&context->events, event))
+		{
+			break;
 		}
+		context->scanned ^= (Bitboard)1 << bit;
+	}
+#if defined(TRACKER_ASYNC_SCAN) && defined(TRACKER_INFER_MOVES)
+	STORE_RELEASE(context->scanSequence, context->scanSequence + 1);
+#endif
+}
+
+uint8_t TrackContext(struct TrackerContext* context)
+{
+	uint8_t transitionOccured = 0;
+	struct SensorEvent event;
+	LATENCY_BEGIN(Track);
+
+#ifndef TRACKER_ASYNC_SCAN
+	ScanContext(context);
+#endif
+
+	transitionOccured |= InferMoveContext(context);
+	while (PopSensorEvent(&context->events, &event))
+	{
+		transitionOccured |= TrackEventContext(context, event);
+	}
+
+	// Use the quiet scans to get ahead on work the next transitions will need
+	if (!transitionOccured)
+	{
+		TrackIdleContext(context);
 	}
 
+	LATENCY_END(Track);
 	return transitionOccured;
 }
 
-static void HandlePlace(struct PieceCoordinate placedPiece)
+uint8_t TrackEventContext(struct TrackerContext* context, struct SensorEvent event)
 {
-	// If board is in illegal state
-	if (NumIllegalPieces > 0)
+	PieceCoordinate currentPieceCoordinate = GetPieceCoordinateContext(context, event.square);
+	uint8_t isOccupied = (context->occupied & SQUARE_SENSOR_BIT(event.square)) != 0;
+
+	// If there was no piece here but the IO is HIGH, a piece was placed
+	if (event.type == PLACE && !isOccupied)
 	{
-		HandlePlaceIllegalState(placedPiece);
+		HandlePlace(context, currentPieceCoordinate);
+		return 1;
 	}
 
-	// If the piece lifted did not move, don't do anything except update Chessboard
-	else if (IsPieceCoordinateSamePosition(placedPiece, LastPickedUpPiece))
+	// If there was a piece here but the IO is LOW, a piece has been picked up. A stray piece placed during
+	// recovery isn't on the chessboard, but lifting it is what recovery is waiting for.
+	if (event.type == PICKUP && (isOccupied || (context->mustEmpty & SQUARE_SENSOR_BIT(event.square))))
 	{
-		HandlePlaceNoMove(placedPiece);
+		HandlePickup(context, currentPieceCoordinate);
+		return 1;
 	}
 
-	// If there's a piece being killed, this placement should be in its stead
-	else if (PieceExists(PieceToKill))
+	return 0;
+}
+
+void TrackIdleContext(struct TrackerContext* context)
+{
+#ifdef TRACKER_SPECULATE
+	// While a piece is held, work out the other team's moves for where it may land
+	SpeculateContext(&context->speculation, TRACKER_SPECULATE_POSITIONS);
+#endif
+
+#ifdef TRACKER_LAZY_LEGAL_MOVES
+	// Get ahead on the moves of the pieces that haven't been picked up yet
+	FillLegalMovesContext(&context->pathfinder, TRACKER_IDLE_FILL_PIECES);
+#endif
+}
+
+uint8_t InferMoveContext(struct TrackerContext* context)
+{
+#ifdef TRACKER_INFER_MOVES
+	Bitboard scanned = ReadScanned(context);
+	Bitboard changed = scanned ^ context->seen;
+	Bitboard team = FlipDiagonal(context->pathfinder.position.owners[context->currentTurn]);
+	context->seen = scanned;
+
+	// A piece put down while one of ours is off its square may be where a move landed, whatever order the events say
+	if (team & ~scanned)
+	{
+		context->landed |= changed & scanned;
+	}
+	if (PopCount(changed) > 1)
 	{
-		HandlePlaceKill(placedPiece);
+		context->unordered = 1;
 	}
 
-	// If player is castling, this placement should be the king or rook being placed in the right spots
-	else if (PieceExists(ExpectedKingCastleCoordinate) || PieceExists(ExpectedRookCastleCoordinate))
+	// Events that came one at a time can't be out of order, so unless they made the board illegal they stand
+	if (!context->unordered && context->state != STATE_ILLEGAL_RECOVERY)
 	{
-		HandlePlaceCastling(placedPiece);
+		return 0;
 	}
 
-	// If promotion is occurring, this placed piece must be a knight or queen placed into PawnToPromote's place
-	else if (PieceExists(PawnToPromote))
+	// The pathfinder numbers squares row-major, the sensors column-major
+	Bitboard occupied = FlipDiagonal(scanned);
+	Bitboard landed = FlipDiagonal(context->landed);
+	uint8_t from, to;
+	if (InferMoveFromOccupancyContext(&context->pathfinder, occupied, landed, &from, &to) != 1
+		&& !InferCastling(context, occupied, landed, &from, &to))
 	{
-		HandlePlacePromotion(placedPiece);
+		return 0;
 	}
 
-	// Any other move, the last picked up piece is set to this position
-	else
+	// A pawn reaching the last row still has to be swapped for the piece it becomes, so leave promotions to the events
+	// and STATE_PROMOTION rather than guessing the piece
+	if (PawnReachedEnd(context, PIECE_COORDINATE(context->pathfinder.position.board[from], to)))
 	{
-		HandlePlaceMove(placedPiece);
+		return 0;
 	}
 
+	PlayInferredMove(context, from, to);
+	return 1;
+#else
+	return 0;
+#endif
+}
 
-	// If pawn reaches last row, it must be replaced by a queen or knight in this move 
-	if (PawnReachedEnd(placedPiece))
+void SetTraceWriterContext(struct TrackerContext* context, struct TraceWriter* writer)
+{
+	context->trace = writer;
+}
+
+void SetCheckpointStoreContext(struct TrackerContext* context, struct CheckpointStore* store)
+{
+	context->checkpoint = store;
+	if (store)
 	{
-		HandlePlacePreemptPromotion(placedPiece);
+		store->checkpoint.numMoves = 0;
 	}
-
-	LastTransitionType = PLACE;
 }
 
-static void HandlePlaceIllegalState(struct PieceCoordinate placedPiece)
+uint8_t ResumeTrackerContext(struct TrackerContext* context, struct CheckpointStore* store)
 {
-	PRINT_SIM("Chessboard in illegal state, validating...");
+	const struct Checkpoint* checkpoint = &store->checkpoint;
+	if (!store->sequence)
+	{
+		return 0;
+	}
 
-	for (uint8_t i = 0; i < NumIllegalPieces; i++)
+	// A board that was changed while the power was off, or a checkpoint that doesn't hold together, can't be trusted
+	Bitboard occupied = 0;
+	for (uint8_t square = 0; square < NUM_SQUARES; square++)
 	{
-		// If placing an illegal piece in it's proper destination, remove it from the illegal pieces array
-		if (IsPieceCoordinateSamePosition(IllegalPieces[i].destination, placedPiece))
+		if (GetCheckpointPiece(checkpoint, square) != EMPTY_PIECE)
 		{
-			SetPiece(placedPiece.row, placedPiece.column, IllegalPieces[i].destination.piece);
+			occupied |= SQUARE_SENSOR_BIT(square);
+		}
+	}
+	if (ReadSensors(context) != occupied || CalculateCheckpointKey(checkpoint) != checkpoint->key
+		|| (checkpoint->currentTurn != WHITE && checkpoint->currentTurn != BLACK))
+	{
+		return 0;
+	}
 
-			// Remove from illegal pieces array
-			RemoveIllegalPiece(i);
+	for (uint8_t square = 0; square < NUM_SQUARES; square++)
+	{
+		SetPiece(context, square, GetCheckpointPiece(checkpoint, square));
+	}
+	context->currentTurn = (enum PieceOwner)checkpoint->currentTurn;
+	context->canA1Castle = (checkpoint->castleFlags & CHECKPOINT_CASTLE_A1) != 0;
+	context->canH1Castle = (checkpoint->castleFlags & CHECKPOINT_CASTLE_H1) != 0;
+	context->canA8Castle = (checkpoint->castleFlags & CHECKPOINT_CASTLE_A8) != 0;
+	context->canH8Castle = (checkpoint->castleFlags & CHECKPOINT_CASTLE_H8) != 0;
+	context->canWhiteKingCastle = (checkpoint->castleFlags & CHECKPOINT_CASTLE_WHITE_KING) != 0;
+	context->canBlackKingCastle = (checkpoint->castleFlags & CHECKPOINT_CASTLE_BLACK_KING) != 0;
+
+	if (checkpoint->killSquare != CHECKPOINT_NO_SQUARE)
+	{
+		context->pieceToKill = PIECE_COORDINATE(checkpoint->killPiece, checkpoint->killSquare);
+	}
+	if (checkpoint->promotionSquare != CHECKPOINT_NO_SQUARE)
+	{
+		context->pawnToPromote = PIECE_COORDINATE(checkpoint->promotionPiece, checkpoint->promotionSquare);
+	}
+	context->state = CalculateTrackerState(context);
 
-			// If chessboard is valid, switch turns if flagged to do so
-			CheckChessboardValidity(SwitchTurnsAfterLegalState);
+	// The scanner starts out expecting the pieces to be where the chessboard has them
+	InitDebouncer(&context->debouncer, context->occupied);
+	context->scanned = context->occupied;
+#if defined(TRACKER_ASYNC_SCAN) && defined(TRACKER_INFER_MOVES)
+	context->scanSequence = 0;
+#endif
+#ifdef TRACKER_INFER_MOVES
+	context->seen = context->occupied;
+#endif
+	InitSensorEventQueue(&context->events);
 
-			return;
-		}
+	// Rebuild the legal moves of the team to move
+#ifdef TRACKER_LAZY_LEGAL_MOVES
+	BeginTeamsLegalMovesContext(&context->pathfinder, context->chessboard, context->currentTurn);
+#else
+	CalculateTeamsLegalMovesContext(&context->pathfinder, context->chessboard, context->currentTurn);
+#endif
+	if (PieceExists(context->pieceToKill))
+	{
+		context->killers = GetAttackersContext(&context->pathfinder, checkpoint->killSquare);
+	}
+
+	context->checkpoint = store;
+	PRINT_SIM("Resumed the saved game");
+	return 1;
+}
+
+inline struct SensorEventStats GetSensorEventStatsContext(struct TrackerContext* context)
+{
+	return context->events.stats;
+}
+
+inline struct DebounceStats GetDebounceStatsContext(struct TrackerContext* context)
+{
+	return context->debouncer.stats;
+}
+
+static void HandlePlace(struct TrackerContext* context, PieceCoordinate placedPiece)
+{
+	LATENCY_BEGIN(HandlePlace);
+
+	// If the piece lifted did not move, don't do anything except update Chessboard
+	enum TrackerEvent event = IsPieceCoordinateSamePosition(placedPiece, context->lastPickedUpPiece) ? EVENT_PLACE_RETURN : EVENT_PLACE;
+	DispatchTransition(context, event, placedPiece);
+
+	// If pawn reaches last row, it must be replaced by a queen or knight in this move 
+	if (PawnReachedEnd(context, placedPiece))
+	{
+		LATENCY_BEGIN(HandlePlacePreemptPromotion);
+		HandlePlacePreemptPromotion(context, placedPiece);
+		LATENCY_END(HandlePlacePreemptPromotion);
+	}
+
+	context->lastTransitionType = PLACE;
+	context->state = CalculateTrackerState(context);
+	LATENCY_END(HandlePlace);
+}
+
+static void HandlePlaceIllegalState(struct TrackerContext* context, PieceCoordinate placedPiece)
+{
+	PRINT_SIM("Chessboard in illegal state, validating...");
+
+	// If placing an illegal piece in it's proper destination, it is no longer illegal
+	uint8_t square = COORDINATE_SQUARE(placedPiece);
+	Bitboard bit = SQUARE_SENSOR_BIT(square);
+	if (context->mustFill & bit)
+	{
+		SetPiece(context, square, context->expectedPieces[square]);
+		context->mustFill &= ~bit;
+
+		// If chessboard is valid, switch turns if flagged to do so
+		CheckChessboardValidity(context, context->switchTurnsAfterLegalState);
+		return;
 	}
 
 	// A piece was placed in an unexpected destination, add it as an illegal piece that must be removed from the board
-	AddIllegalPiece(placedPiece, OFFBOARD_PIECE_COORDINATE);
+	AddIllegalPiece(context, placedPiece, OFFBOARD_PIECE_COORDINATE);
 }
 
-static void HandlePlaceNoMove(struct PieceCoordinate placedPiece)
+static void HandlePlaceNoMove(struct TrackerContext* context, PieceCoordinate placedPiece)
 {
-	SetPiece(placedPiece.row, placedPiece.column, LastPickedUpPiece.piece);
+	SetPiece(context, COORDINATE_SQUARE(placedPiece), COORDINATE_PIECE(context->lastPickedUpPiece));
 }
 
-static void HandlePlaceKill(struct PieceCoordinate placedPiece)
+static void HandlePlaceKill(struct TrackerContext* context, PieceCoordinate placedPiece)
 {
-	SetPiece(placedPiece.row, placedPiece.column, LastPickedUpPiece.piece);
+	SetPiece(context, COORDINATE_SQUARE(placedPiece), COORDINATE_PIECE(context->lastPickedUpPiece));
 
 	// If player put killer in victim's place, clear PieceToKill
-	if (IsPieceCoordinateSamePosition(PieceToKill, placedPiece))
+	if (IsPieceCoordinateSamePosition(context->pieceToKill, placedPiece))
 	{
-		ClearPiece(&PieceToKill);
-		EndTurn();
+		ClearPiece(&context->pieceToKill);
+		EndTurn(context);
 	}
 	// If player didn't put killer in the victim's spot, must put the killer in the victim spot
 	else
 	{
 		// Put killer in victim spot
-		struct PieceCoordinate killerDestination = PieceToKill;
-		killerDestination.piece = LastPickedUpPiece.piece;
-		AddIllegalPiece(placedPiece, killerDestination);
-		SwitchTurnsAfterLegalState = 1;
+		PieceCoordinate killerDestination = PIECE_COORDINATE(COORDINATE_PIECE(context->lastPickedUpPiece), COORDINATE_SQUARE(context->pieceToKill));
+		AddIllegalPiece(context, placedPiece, killerDestination);
+		context->switchTurnsAfterLegalState = 1;
 	}
 }
 
-static void HandlePlaceCastling(struct PieceCoordinate placedPiece)
+static void HandlePlaceCastling(struct TrackerContext* context, PieceCoordinate placedPiece)
 {
 	// If placing a piece in the King's expected location, assume it's a king and place it
-	if (IsPieceCoordinateSamePosition(ExpectedKingCastleCoordinate, placedPiece))
+	if (IsPieceCoordinateSamePosition(context->expectedKingCastleCoordinate, placedPiece))
 	{
-		SetPiece(placedPiece.row, placedPiece.column, ExpectedKingCastleCoordinate.piece);
-		ClearPiece(&ExpectedKingCastleCoordinate);
+		SetPiece(context, COORDINATE_SQUARE(placedPiece), COORDINATE_PIECE(context->expectedKingCastleCoordinate));
+		ClearPiece(&context->expectedKingCastleCoordinate);
 	}
 	// If placing a piece in the Rook's expected location, assume it's a rook and place it
-	else if (IsPieceCoordinateSamePosition(ExpectedRookCastleCoordinate, placedPiece))
+	else if (IsPieceCoordinateSamePosition(context->expectedRookCastleCoordinate, placedPiece))
 	{
-		SetPiece(placedPiece.row, placedPiece.column, ExpectedRookCastleCoordinate.piece);
-		ClearPiece(&ExpectedRookCastleCoordinate);
+		SetPiece(context, COORDINATE_SQUARE(placedPiece), COORDINATE_PIECE(context->expectedRookCastleCoordinate));
+		ClearPiece(&context->expectedRookCastleCoordinate);
 	}
 	// If placing piece in wrong location
 	else
 	{
 		// If King wasn't already placed in correct spot, put it in the correct spot
-		if (PieceExists(ExpectedKingCastleCoordinate))
+		if (PieceExists(context->expectedKingCastleCoordinate))
 		{
-			SetPiece(placedPiece.row, placedPiece.column, ExpectedKingCastleCoordinate.piece); // Assume the king was placed here (doesn't matter)
-			AddIllegalPiece(placedPiece, ExpectedKingCastleCoordinate);
-			SwitchTurnsAfterLegalState = 1;
+			SetPiece(context, COORDINATE_SQUARE(placedPiece), COORDINATE_PIECE(context->expectedKingCastleCoordinate)); // Assume the king was placed here (doesn't matter)
+			AddIllegalPiece(context, placedPiece, context->expectedKingCastleCoordinate);
+			context->switchTurnsAfterLegalState = 1;
 		}
 
 		// If Rook wasn't already placed in correct spot, put it in correct spot
-		if (PieceExists(ExpectedRookCastleCoordinate))
+		if (PieceExists(context->expectedRookCastleCoordinate))
 		{
-			SetPiece(placedPiece.row, placedPiece.column, ExpectedRookCastleCoordinate.piece); // Assume the rook was placed here (doesn't matter)
-			AddIllegalPiece(placedPiece, ExpectedRookCastleCoordinate);
-			SwitchTurnsAfterLegalState = 1;
+			SetPiece(context, COORDINATE_SQUARE(placedPiece), COORDINATE_PIECE(context->expectedRookCastleCoordinate)); // Assume the rook was placed here (doesn't matter)
+			AddIllegalPiece(context, placedPiece, context->expectedRookCastleCoordinate);
+			context->switchTurnsAfterLegalState = 1;
 		}
 	}
 
 	// If castling has been fulfilled
-	if (!PieceExists(ExpectedKingCastleCoordinate) && !PieceExists(ExpectedRookCastleCoordinate))
+	if (!PieceExists(context->expectedKingCastleCoordinate) && !PieceExists(context->expectedRookCastleCoordinate))
 	{
-		EndTurn();
+		EndTurn(context);
 	}
 }
 
-static void HandlePlaceMove(struct PieceCoordinate placedPiece)
+static void HandlePlaceMove(struct TrackerContext* context, PieceCoordinate placedPiece)
 {
-	uint8_t isMoveValid = ValidateMove(LastPickedUpPiece, placedPiece);
-	SetPiece(placedPiece.row, placedPiece.column, LastPickedUpPiece.piece);
+	uint8_t isMoveValid = ValidateMove(context, context->lastPickedUpPiece, placedPiece);
+	SetPiece(context, COORDINATE_SQUARE(placedPiece), COORDINATE_PIECE(context->lastPickedUpPiece));
 
 	if (isMoveValid)
 	{
-		EndTurn();
+		EndTurn(context);
 	}
 	// If move was invalid, put piece back
 	else
 	{
-		AddIllegalPiece(placedPiece, LastPickedUpPiece);
+		AddIllegalPiece(context, placedPiece, context->lastPickedUpPiece);
 	}
 }
 
-static void HandlePlacePreemptPromotion(struct PieceCoordinate placedPiece)
+static void HandlePlacePreemptPromotion(struct TrackerContext* context, PieceCoordinate placedPiece)
 {
-	PawnToPromote = placedPiece;
+	context->pawnToPromote = placedPiece;
 }
 
-static void HandlePlacePromotion(struct PieceCoordinate placedPiece)
+static void HandlePlacePromotion(struct TrackerContext* context, PieceCoordinate placedPiece)
 {
 	// If placed the promoted piece back into the pawn's old spot, get the PieceType (knight or queen) from the stored button state and set the piece as that type
-	if (IsPieceCoordinateSamePosition(placedPiece, PawnToPromote))
+	if (IsPieceCoordinateSamePosition(placedPiece, context->pawnToPromote))
 	{
 		/// @todo get button data, and set the right piececoordinate to the right PieceType
-		placedPiece.piece.type = QUEEN;
-		SetPiece(placedPiece.row, placedPiece.column, placedPiece.piece);
-		ClearPiece(&PawnToPromote); // promotion is done
+		SetPiece(context, COORDINATE_SQUARE(placedPiece), (COORDINATE_PIECE(context->pawnToPromote) & PIECE_BLACK) | QUEEN);
+		ClearPiece(&context->pawnToPromote); // promotion is done
 	}
 
 	// If player doesn't place the promotion into the pawn's old spot, it must be placed in the right spot
 	else
 	{
-		AddIllegalPiece(placedPiece, PawnToPromote);
+		AddIllegalPiece(context, placedPiece, context->pawnToPromote);
 	}
 }
 
 
 
-static void HandlePickup(struct PieceCoordinate pickedUpPiece)
+static void HandlePickup(struct TrackerContext* context, PieceCoordinate pickedUpPiece)
 {
-	SetPiece(pickedUpPiece.row, pickedUpPiece.column, EMPTY_PIECE);
+	LATENCY_BEGIN(HandlePickup);
 
-	// If a piece is picked up during an illegal state, if it's not an illegal piece it is NOW illegal
-	if (NumIllegalPieces > 0)
-	{
-		HandlePickupIllegalState(pickedUpPiece);
-	}
-	
-	// If player picked up piece from other team, they will kill it
-	else if (pickedUpPiece.piece.owner != CurrentTurn)
-	{
-		HandlePickupPreemptKill(pickedUpPiece);
-	}
+	uint8_t square = COORDINATE_SQUARE(pickedUpPiece);
+	enum PieceOwner owner = PIECE_OWNER(COORDINATE_PIECE(pickedUpPiece));
+	SetPiece(context, square, EMPTY_PIECE);
 
-	// If there's a piece to kill, this picked up piece must be able to kill it
-	else if (PieceExists(PieceToKill))
+#ifdef TRACKER_LAZY_LEGAL_MOVES
+	// Have this piece's moves ready by the time it is placed
+	if (owner == context->currentTurn)
 	{
-		HandlePickupKill(pickedUpPiece);
+		GeneratePieceLegalMovesContext(&context->pathfinder, square);
 	}
+#endif
 
-	// If there's a pawn to promote, the picked up piece must be this pawn
-	else if (PieceExists(PawnToPromote))
+	// Picking up an enemy piece means killing it, and picking up a second piece of our own means castling
+	enum TrackerEvent event = EVENT_PICKUP;
+	if (owner != context->currentTurn)
 	{
-		HandlePickupPromotion(pickedUpPiece);
+		event = EVENT_PICKUP_ENEMY;
 	}
-
-	// Same team picked up piece twice in a row, so castling is occurring
-	else if (DidSameTeamPickupLast(pickedUpPiece.piece))
+	else if (DidSameTeamPickupLast(context, COORDINATE_PIECE(pickedUpPiece)))
 	{
-		HandlePickupCastling(pickedUpPiece);
+		event = EVENT_PICKUP_AGAIN;
 	}
+	DispatchTransition(context, event, pickedUpPiece);
 
-	// If simple pickup
-	else
+	context->lastPickedUpPiece = pickedUpPiece;
+	context->lastTransitionType = PICKUP;
+	context->state = CalculateTrackerState(context);
+
+#ifdef TRACKER_SPECULATE
+	// A piece of ours lifted for a move or a kill is where the next position will come from
+	if (owner == context->currentTurn && (context->state == STATE_NORMAL || context->state == STATE_KILL_PENDING))
 	{
-		HandlePickupMove(pickedUpPiece);
+		BeginSpeculationContext(&context->speculation, &context->pathfinder, square);
 	}
+#endif
 
-	LastPickedUpPiece = pickedUpPiece;
-	LastTransitionType = PICKUP;
+	LATENCY_END(HandlePickup);
 }
 
-static void HandlePickupIllegalState(struct PieceCoordinate pickedUpPiece)
+static void HandlePickupIllegalState(struct TrackerContext* context, PieceCoordinate pickedUpPiece)
 {
 	PRINT_SIM("Chessboard in illegal state, validating...");
 
-	for (uint8_t i = 0; i < NumIllegalPieces; i++)
+	// If an illegal piece is lifted from where it shouldn't be, that square is fixed (its destination may still be waiting for it)
+	Bitboard bit = SQUARE_SENSOR_BIT(COORDINATE_SQUARE(pickedUpPiece));
+	if (context->mustEmpty & bit)
 	{
-		// If pickup for illegal piece, let it slide
-		if (IsPieceCoordinateEqual(IllegalPieces[i].current, pickedUpPiece))
-		{
-			// If pickup an illegal piece which is to be removed from the board is picked up, it is no longer illegal
-			if (IsPieceCoordinateEqual(IllegalPieces[i].destination, OFFBOARD_PIECE_COORDINATE))
-			{
-				// Remove from illegal pieces array
-				RemoveIllegalPiece(i);
+		context->mustEmpty &= ~bit;
 
-				// If chessboard is valid, switch turns if flagged to do so
-				CheckChessboardValidity(SwitchTurnsAfterLegalState);
-			}
-			return;
-		}
+		// If chessboard is valid, switch turns if flagged to do so
+		CheckChessboardValidity(context, context->switchTurnsAfterLegalState);
+		return;
 	}
 	
 	// Player picked up a piece that wasn't illegal, so it must be added as an illegal piece which must be placed back
-	AddIllegalPiece(OFFBOARD_PIECE_COORDINATE, pickedUpPiece);
+	AddIllegalPiece(context, OFFBOARD_PIECE_COORDINATE, pickedUpPiece);
 }
 
-static void HandlePickupPreemptKill(struct PieceCoordinate pickedUpPiece)
+static void HandlePickupPreemptKill(struct TrackerContext* context, PieceCoordinate pickedUpPiece)
 {
-	PieceToKill = pickedUpPiece;
+	context->pieceToKill = pickedUpPiece;
+
+	// Work out every piece that can take it now, while the player reaches for one
+	context->killers = GetAttackersContext(&context->pathfinder, COORDINATE_SQUARE(pickedUpPiece));
 }
 
-static void HandlePickupKill(struct PieceCoordinate pickedUpPiece)
+static void HandlePickupKill(struct TrackerContext* context, PieceCoordinate pickedUpPiece)
 {
 	// If piece can't kill PieceToKill, they need to be put back to their initial positions, and PieceToKill is not a piece to kill anymore
-	if (!ValidateKill(PieceToKill, pickedUpPiece))
+	if (!ValidateKill(context, pickedUpPiece))
 	{
-		AddIllegalPiece(OFFBOARD_PIECE_COORDINATE, PieceToKill);
-		AddIllegalPiece(OFFBOARD_PIECE_COORDINATE, pickedUpPiece);
-		ClearPiece(&PieceToKill);
+		AddIllegalPiece(context, OFFBOARD_PIECE_COORDINATE, context->pieceToKill);
+		AddIllegalPiece(context, OFFBOARD_PIECE_COORDINATE, pickedUpPiece);
+		ClearPiece(&context->pieceToKill);
 	}
 }
 
-static void HandlePickupCastling(struct PieceCoordinate pickedUpPiece)
+static void HandlePickupCastling(struct TrackerContext* context, PieceCoordinate pickedUpPiece)
 {
-	struct PieceCoordinate rook;
-	struct PieceCoordinate king;
+	PieceCoordinate rook;
+	PieceCoordinate king;
+
+	enum PieceType type = PIECE_TYPE(COORDINATE_PIECE(pickedUpPiece));
+	enum PieceType lastType = PIECE_TYPE(COORDINATE_PIECE(context->lastPickedUpPiece));
 
-	if (pickedUpPiece.piece.type == ROOK && LastPickedUpPiece.piece.type == KING)
+	if (type == ROOK && lastType == KING)
 	{
 		rook = pickedUpPiece;
-		king = LastPickedUpPiece;
+		king = context->lastPickedUpPiece;
 	}
-	else if (pickedUpPiece.piece.type == KING && LastPickedUpPiece.piece.type == ROOK)
+	else if (type == KING && lastType == ROOK)
 	{
-		rook = LastPickedUpPiece;
+		rook = context->lastPickedUpPiece;
 		king = pickedUpPiece;
 	}
 	// If the past two picked up pieces aren't a king and rook, put them back
 	else
 	{
-		AddIllegalPiece(OFFBOARD_PIECE_COORDINATE, pickedUpPiece);
-		AddIllegalPiece(OFFBOARD_PIECE_COORDINATE, LastPickedUpPiece);
+		AddIllegalPiece(context, OFFBOARD_PIECE_COORDINATE, pickedUpPiece);
+		AddIllegalPiece(context, OFFBOARD_PIECE_COORDINATE, context->lastPickedUpPiece);
 		return;
 	}
 
-	if (ValidateCastling(rook, king))
+	if (ValidateCastling(context, rook, king))
 	{
-		struct PieceCoordinate expectedKingPieceCoordinate;
-		struct PieceCoordinate expectedRookPieceCoordinate;
+		PieceCoordinate expectedKingPieceCoordinate;
+		PieceCoordinate expectedRookPieceCoordinate;
 		CalculateCastlingPositions(rook, &expectedKingPieceCoordinate, &expectedRookPieceCoordinate);
 
-		// If castling won't result in a self-check then it's valid so copy to globals. Otherwise fall through to AddIllegalPiece.
-		if (!WillResultInSelfCheck(rook, expectedRookPieceCoordinate) && !WillResultInSelfCheck(king, expectedKingPieceCoordinate))
-		{
-			ExpectedKingCastleCoordinate = expectedKingPieceCoordinate;
-			ExpectedRookCastleCoordinate = expectedRookPieceCoordinate;
-			return;
-		}
+		context->expectedKingCastleCoordinate = expectedKingPieceCoordinate;
+		context->expectedRookCastleCoordinate = expectedRookPieceCoordinate;
+		return;
 	}
 
-	AddIllegalPiece(OFFBOARD_PIECE_COORDINATE, pickedUpPiece);
-	AddIllegalPiece(OFFBOARD_PIECE_COORDINATE, LastPickedUpPiece);
+	AddIllegalPiece(context, OFFBOARD_PIECE_COORDINATE, pickedUpPiece);
+	AddIllegalPiece(context, OFFBOARD_PIECE_COORDINATE, context->lastPickedUpPiece);
 }
 
-static void HandlePickupPromotion(struct PieceCoordinate pickedUpPiece)
+static void HandlePickupPromotion(struct TrackerContext* context, PieceCoordinate pickedUpPiece)
 {
 	// All picked up pieces during a promotion must be the PawnToPromote, otherwise they must be placed back
-	if (!IsPieceCoordinateEqual(pickedUpPiece, PawnToPromote))
+	if (pickedUpPiece != context->pawnToPromote)
 	{
-		AddIllegalPiece(OFFBOARD_PIECE_COORDINATE, pickedUpPiece);
+		AddIllegalPiece(context, OFFBOARD_PIECE_COORDINATE, pickedUpPiece);
 	}
 }
 
-static void HandlePickupMove(struct PieceCoordinate pickedUpPiece)
+static void HandlePickupMove(struct TrackerContext* context, PieceCoordinate pickedUpPiece)
 {
 	// If this piece isn't owned by the current team, then they must put it back down
-	if (pickedUpPiece.piece.owner != CurrentTurn)
+	if (PIECE_OWNER(COORDINATE_PIECE(pickedUpPiece)) != context->currentTurn)
 	{
-		AddIllegalPiece(EMPTY_PIECE_COORDINATE, pickedUpPiece);
+		AddIllegalPiece(context, OFFBOARD_PIECE_COORDINATE, pickedUpPiece);
 	}
 }
 
 
 /**
- * @brief Put an illegal piece in the IllegalPieceDestinations array. Destination is the correct destination of the piece and Current is the current position of the piece.
+ * @brief Runs the handler the transition table has for event in the current state
  */
-static void AddIllegalPiece(struct PieceCoordinate current, struct PieceCoordinate destination)
+static void DispatchTransition(struct TrackerContext* context, enum TrackerEvent event, PieceCoordinate pieceCoordinate)
 {
-	PRINT_SIM_PIECE("Put piece in: ", destination);
+	const struct TrackerTransition* transition = &TRACKER_TRANSITIONS[context->state][event];
 
-	current.piece = destination.piece;
+#ifdef INSTRUMENT
+	context->transitionCounts[context->state][event]++;
+	uint32_t start = LatencyNow();
+	transition->handler(context, pieceCoordinate);
+	RecordLatency(transition->probe, LatencyNow() - start);
+#else
+	transition->handler(context, pieceCoordinate);
+#endif
+}
 
-	IllegalPieces[NumIllegalPieces].current = current;
-	IllegalPieces[NumIllegalPieces].destination = destination;
-	NumIllegalPieces++;
+/**
+ * @brief Works out which state the recovery, kill, castling and promotion fields put the tracker in
+ */
+static enum TrackerState CalculateTrackerState(struct TrackerContext* context)
+{
+	if (context->mustEmpty | context->mustFill)
+	{
+		return STATE_ILLEGAL_RECOVERY;
+	}
+	if (PieceExists(context->pieceToKill))
+	{
+		return STATE_KILL_PENDING;
+	}
+	if (PieceExists(context->expectedKingCastleCoordinate) || PieceExists(context->expectedRookCastleCoordinate))
+	{
+		return STATE_CASTLING;
+	}
+	if (PieceExists(context->pawnToPromote))
+	{
+		return STATE_PROMOTION;
+	}
+	return STATE_NORMAL;
 }
 
 /**
- * @brief Remove illegal piece from IllegalPieces array given its index
+ * @brief Mark an illegal piece. Current is where it is and must be lifted from, destination is where it must be put.
+ * Either can be OFFBOARD_PIECE_COORDINATE for a piece that must only be removed or only be put back.
  */
-static void RemoveIllegalPiece(uint8_t index)
+static void AddIllegalPiece(struct TrackerContext* context, PieceCoordinate current, PieceCoordinate destination)
 {
-	NumIllegalPieces--;
-	for (uint8_t i = index; i < NumIllegalPieces; i++)
+	PRINT_SIM_PIECE("Put piece in: ", destination);
+
+	if (COORDINATE_ON_BOARD(current))
+	{
+		context->mustEmpty |= SQUARE_SENSOR_BIT(COORDINATE_SQUARE(current));
+	}
+
+	if (COORDINATE_ON_BOARD(destination))
 	{
-		IllegalPieces[i] = IllegalPieces[i + 1];
+		context->mustFill |= SQUARE_SENSOR_BIT(COORDINATE_SQUARE(destination));
+		context->expectedPieces[COORDINATE_SQUARE(destination)] = COORDINATE_PIECE(destination);
 	}
 }
 
 /**
  * @brief Check if chessboard is valid and switch turns if flagged to do so
  */
-static void CheckChessboardValidity(uint8_t switchTurns)
+static void CheckChessboardValidity(struct TrackerContext* context, uint8_t switchTurns)
 {
-	if (NumIllegalPieces == 0)
+	if (!(context->mustEmpty | context->mustFill))
 	{
 		PRINT_SIM("Chessboard is valid!");
 		if (switchTurns)
 		{
-			EndTurn();
+			EndTurn(context);
 		}
 	}
 }
 
 /**
- * @brief Return 1 if the given killer can take the victim, 0 otherwise. If the victim cannot be killed, then this is an illegal/impossible kill
+ * @brief Return 1 if the given killer can take PieceToKill, 0 otherwise. If it cannot, then this is an illegal/impossible kill
  * so the victim and killer must return to their original spots, and a new move must be done.
  */
-static uint8_t ValidateKill(struct PieceCoordinate victim, struct PieceCoordinate killer)
+static uint8_t ValidateKill(struct TrackerContext* context, PieceCoordinate killer)
 {
-	// Temporarily add back victim and then check if it can be killed (need to be done for PAWN)
-	SetPieceCoordinate(victim);
-
-	uint8_t valid = ValidateMove(killer, victim);
-
-	// Clear victim again
-	victim.piece = EMPTY_PIECE;
-	SetPieceCoordinate(victim);
-
-	return valid;
+	// The killers were found when the victim was lifted (see HandlePickupPreemptKill)
+	return (context->killers & SQUARE_BIT(COORDINATE_SQUARE(killer))) != 0;
 }
 
 /**
  * @brief Return 1 if the "to" is in the legal paths for "from", 0 otherwise. If the move is invalid, then the "from" must be placed back
  * in its original spot, and a new move must be done.
  */
-static uint8_t ValidateMove(struct PieceCoordinate from, struct PieceCoordinate to)
+static uint8_t ValidateMove(struct TrackerContext* context, PieceCoordinate from, PieceCoordinate to)
 {
-	return IsLegalMove(from, to);
+	return IsLegalMoveContext(&context->pathfinder, from, to);
 }
 
 /**
  * @brief Return 1 if the given rook can castle with the given king. If not, they should return to their original positions.
  */
-static uint8_t ValidateCastling(struct PieceCoordinate rook, struct PieceCoordinate king)
+static uint8_t ValidateCastling(struct TrackerContext* context, PieceCoordinate rook, PieceCoordinate king)
 {
+	uint8_t kingSquare = COORDINATE_SQUARE(king);
+	uint8_t rookSquare = COORDINATE_SQUARE(rook);
+	uint8_t allowed = 0;
+
 	// If white king can castle and the king and rook are in the starting row
-	if (king.row == 0 && rook.row == 0 && CanWhiteKingCastle)
+	if (SQUARE_ROW(kingSquare) == 0 && SQUARE_ROW(rookSquare) == 0 && context->canWhiteKingCastle)
 	{
-		return (rook.column == 0 && CanA1Castle) || (rook.column == 7 && CanH1Castle);
+		allowed = (rookSquare == ROOK_A1_COORDINATE && context->canA1Castle) || (rookSquare == ROOK_H1_COORDINATE && context->canH1Castle);
 	}
 	// If black king can castle and the king and rook are in the starting row
-	else if (king.row == 7 && rook.row == 7 && CanBlackKingCastle)
+	else if (SQUARE_ROW(kingSquare) == 7 && SQUARE_ROW(rookSquare) == 7 && context->canBlackKingCastle)
 	{
-		return (rook.column == 0 && CanA8Castle) || (rook.column == 7 && CanH8Castle);
+		allowed = (rookSquare == ROOK_A8_COORDINATE && context->canA8Castle) || (rookSquare == ROOK_H8_COORDINATE && context->canH8Castle);
 	}
-	return 0;
+	if (!allowed)
+	{
+		return 0;
+	}
+
+	// The king may not castle out of, through or into check
+	uint8_t kingTo = SQUARE(SQUARE_ROW(kingSquare), SQUARE_COLUMN(rookSquare) == NUM_COLS - 1 ? 6 : 2);
+	Bitboard kingPath = BetweenMask(kingSquare, kingTo) | SQUARE_BIT(kingSquare) | SQUARE_BIT(kingTo);
+	enum PieceOwner enemyTeam = PIECE_OWNER(COORDINATE_PIECE(king)) == WHITE ? BLACK : WHITE;
+	while (kingPath)
+	{
+		if (IsSquareAttackedByContext(&context->pathfinder, PopLowestSquare(&kingPath), enemyTeam))
+		{
+			return 0;
+		}
+	}
+	return 1;
 }
 
 
 #ifndef SIM
-uint8_t ValidateStartPositions()
+uint8_t ValidateStartPositionsContext(struct TrackerContext* context)
 {
 	for (uint8_t columnNumber = 0; columnNumber < NUM_COLS; columnNumber++)
 	{
-		WriteColumn(columnNumber);
+		WriteColumn(context, columnNumber);
 		for (uint8_t rowNumber = 0; rowNumber < NUM_ROWS; rowNumber++)
 		{
-			GPIO_PinState cellValue = ReadRow(rowNumber);
+			GPIO_PinState cellValue = ReadRow(context, rowNumber);
 
 			switch (rowNumber)
 			{
@@ -707,15 +1072,23 @@ uint8_t ValidateStartPositions()
 }
 #endif
 
-static void EndTurn()
+static void EndTurn(struct TrackerContext* context)
 {
-	UpdateCastleFlags();
+	LATENCY_BEGIN(EndTurn);
+	UpdateCastleFlags(context);
+
+	// The pathfinder still has the position the turn started from, so the move has to be worked out now
+	uint16_t move = context->checkpoint ? CalculateTurnMove(context) : 0;
 
-	SwitchTurnsAfterLegalState = 0;
+	context->switchTurnsAfterLegalState = 0;
+#ifdef TRACKER_INFER_MOVES
+	context->landed = 0;
+	context->unordered = 0;
+#endif
 
 	// Switch teams
-	CurrentTurn = CurrentTurn == WHITE ? BLACK : WHITE;
-	if (CurrentTurn == WHITE)
+	context->currentTurn = context->currentTurn == WHITE ? BLACK : WHITE;
+	if (context->currentTurn == WHITE)
 	{
 		PRINT_SIM("Switching team to WHITE");
 	}
@@ -724,112 +1097,414 @@ static void EndTurn()
 		PRINT_SIM("Switching team to BLACK");
 	}
 
-	// Invoke PathFinder to store all legal moves for this team
-	CalculateTeamsLegalMoves(CurrentTurn);
+	uint8_t adopted = 0;
+#ifdef TRACKER_SPECULATE
+	// If the move landed on a position speculated while the piece was held, this team's moves are already there
+	adopted = AdoptSpeculationContext(&context->pathfinder, &context->speculation, context->chessboard, context->currentTurn);
+#endif
+
+	// Invoke PathFinder to store all legal moves for this team, or in lazy builds just the position they will come from
+	if (!adopted)
+	{
+#ifdef TRACKER_LAZY_LEGAL_MOVES
+		BeginTeamsLegalMovesContext(&context->pathfinder, context->chessboard, context->currentTurn);
+#else
+		CalculateTeamsLegalMovesContext(&context->pathfinder, context->chessboard, context->currentTurn);
+#endif
+	}
+
+	LATENCY_END(EndTurn);
+
+	// Saving waits on the non-volatile memory, so it isn't part of the turn switch's latency
+	if (context->checkpoint)
+	{
+		AppendCheckpointMove(&context->checkpoint->checkpoint, move);
+		SaveTrackerCheckpoint(context);
+	}
+}
+
+/**
+ * @brief Works out the move the current team made this turn by comparing the chessboard with the position the
+ * pathfinder still has from the start of the turn. Castling is given as the king's move.
+ */
+static uint16_t CalculateTurnMove(struct TrackerContext* context)
+{
+	const struct Position* position = &context->pathfinder.position;
+	uint8_t from = NUM_SQUARES;
+	uint8_t to = NUM_SQUARES;
+
+	for (uint8_t square = 0; square < NUM_SQUARES; square++)
+	{
+		Piece before = position->board[square];
+		Piece after = context->chessboard[square];
+		if (before == after)
+		{
+			continue;
+		}
+
+		if (PIECE_OWNER(before) == context->currentTurn && (from == NUM_SQUARES || PIECE_TYPE(before) == KING))
+		{
+			from = square;
+		}
+		if (PIECE_OWNER(after) == context->currentTurn && (to == NUM_SQUARES || PIECE_TYPE(after) == KING))
+		{
+			to = square;
+		}
+	}
+
+	// The chessboard always changes by the end of a turn, but don't trust it to
+	if (from == NUM_SQUARES || to == NUM_SQUARES)
+	{
+		return CHECKPOINT_MOVE(0, 0, NONE);
+	}
+
+	enum PieceType moved = PIECE_TYPE(position->board[from]);
+	enum PieceType landed = PIECE_TYPE(context->chessboard[to]);
+	return CHECKPOINT_MOVE(from, to, moved == PAWN && landed != PAWN ? landed : NONE);
+}
+
+/**
+ * @brief Brings the checkpoint store's checkpoint up to date with the tracker and saves it
+ */
+static void SaveTrackerCheckpoint(struct TrackerContext* context)
+{
+	struct Checkpoint* checkpoint = &context->checkpoint->checkpoint;
+
+	for (uint8_t square = 0; square < NUM_SQUARES; square++)
+	{
+		SetCheckpointPiece(checkpoint, square, context->chessboard[square]);
+	}
+	checkpoint->currentTurn = (uint8_t)context->currentTurn;
+	checkpoint->castleFlags = (context->canA1Castle ? CHECKPOINT_CASTLE_A1 : 0)
+		| (context->canH1Castle ? CHECKPOINT_CASTLE_H1 : 0)
+		| (context->canA8Castle ? CHECKPOINT_CASTLE_A8 : 0)
+		| (context->canH8Castle ? CHECKPOINT_CASTLE_H8 : 0)
+		| (context->canWhiteKingCastle ? CHECKPOINT_CASTLE_WHITE_KING : 0)
+		| (context->canBlackKingCastle ? CHECKPOINT_CASTLE_BLACK_KING : 0);
+
+	checkpoint->killSquare = CHECKPOINT_NO_SQUARE;
+	checkpoint->killPiece = 0;
+	if (PieceExists(context->pieceToKill))
+	{
+		checkpoint->killSquare = COORDINATE_SQUARE(context->pieceToKill);
+		checkpoint->killPiece = COORDINATE_PIECE(context->pieceToKill);
+	}
+	checkpoint->promotionSquare = CHECKPOINT_NO_SQUARE;
+	checkpoint->promotionPiece = 0;
+	if (PieceExists(context->pawnToPromote))
+	{
+		checkpoint->promotionSquare = COORDINATE_SQUARE(context->pawnToPromote);
+		checkpoint->promotionPiece = COORDINATE_PIECE(context->pawnToPromote);
+	}
+
+	// The pathfinder has just loaded the chessboard, so its key is up to date
+	checkpoint->key = context->pathfinder.position.key;
+	SaveCheckpoint(context->checkpoint);
+}
+
+#ifdef TRACKER_INFER_MOVES
+/**
+ * @brief Returns 1 if occupied (indexed by SQUARE) is the turn's starting position with the current team castled, with
+ * the king's move in kingFrom and kingTo. Castling is the tracker's to allow (see ValidateCastling), not the pathfinder's.
+ */
+static uint8_t InferCastling(struct TrackerContext* context, Bitboard occupied, Bitboard landed, uint8_t* kingFrom, uint8_t* kingTo)
+{
+	const struct Position* position = &context->pathfinder.position;
+	Bitboard before = ~position->owners[NEUTRAL];
+	Bitboard team = position->owners[context->currentTurn];
+	uint8_t row = context->currentTurn == WHITE ? 0 : NUM_ROWS - 1;
+	PieceCoordinate king = GetPieceCoordinateContext(context, SQUARE(row, 4));
+
+	if (!(team & position->types[KING] & SQUARE_BIT(SQUARE(row, 4))))
+	{
+		return 0;
+	}
+
+	for (uint8_t rookColumn = 0; rookColumn < NUM_COLS; rookColumn += NUM_COLS - 1)
+	{
+		PieceCoordinate rook = GetPieceCoordinateContext(context, SQUARE(row, rookColumn));
+		uint8_t kingSide = rookColumn != 0;
+		Bitboard vacated = SQUARE_BIT(SQUARE(row, 4)) | SQUARE_BIT(SQUARE(row, rookColumn));
+		Bitboard filled = SQUARE_BIT(SQUARE(row, kingSide ? 6 : 2)) | SQUARE_BIT(SQUARE(row, kingSide ? 5 : 3));
+
+		if ((team & position->types[ROOK] & SQUARE_BIT(SQUARE(row, rookColumn))) && !(BetweenMask(SQUARE(row, 4), SQUARE(row, rookColumn)) & before)
+			&& (before & ~occupied) == vacated && (occupied & ~before) == filled && (landed & filled) == filled
+			&& ValidateCastling(context, rook, king))
+		{
+			*kingFrom = SQUARE(row, 4);
+			*kingTo = SQUARE(row, kingSide ? 6 : 2);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief Replaces whatever the events made of this turn with the move inferred from the sensed board, and ends the turn
+ */
+static void PlayInferredMove(struct TrackerContext* context, uint8_t from, uint8_t to)
+{
+	PRINT_SIM("Move inferred from the sensed board");
 
+	// The pathfinder still has the position the turn started from, so let it play the move (castling included) and copy
+	// the result. Promotions are never inferred (see InferMoveContext), so the promotion piece goes unused
+	MakeMoveContext(&context->pathfinder, from, to, QUEEN);
+	for (uint8_t square = 0; square < NUM_SQUARES; square++)
+	{
+		SetPiece(context, square, context->pathfinder.position.board[square]);
+	}
+	UnmakeMoveContext(&context->pathfinder);
+
+	// Nothing the events were waiting for applies to the move the board shows
+	context->mustEmpty = 0;
+	context->mustFill = 0;
+	context->killers = 0;
+	ClearPiece(&context->lastPickedUpPiece);
+	ClearPiece(&context->pieceToKill);
+	ClearPiece(&context->expectedKingCastleCoordinate);
+	ClearPiece(&context->expectedRookCastleCoordinate);
+	ClearPiece(&context->pawnToPromote);
+	context->lastTransitionType = PLACE;
+	context->state = STATE_NORMAL;
+
+	EndTurn(context);
 }
+#endif
 
-static void UpdateCastleFlags()
+static void UpdateCastleFlags(struct TrackerContext* context)
 {
 	// If any rooks moved, flag them as not castle-able
-	if (CanA1Castle && !IsPiecePresent(ROOK_A1_COORDINATE))
+	if (context->canA1Castle && !IsPiecePresentContext(context, ROOK_A1_COORDINATE))
 	{
-		CanA1Castle = 0;
+		context->canA1Castle = 0;
 	}
-	else if (CanH1Castle && !IsPiecePresent(ROOK_H1_COORDINATE))
+	else if (context->canH1Castle && !IsPiecePresentContext(context, ROOK_H1_COORDINATE))
 	{
-		CanH1Castle = 0;
+		context->canH1Castle = 0;
 	}
-	else if (CanA8Castle && !IsPiecePresent(ROOK_A8_COORDINATE))
+	else if (context->canA8Castle && !IsPiecePresentContext(context, ROOK_A8_COORDINATE))
 	{
-		CanA8Castle = 0;
+		context->canA8Castle = 0;
 	}
-	else if (CanH8Castle && !IsPiecePresent(ROOK_H8_COORDINATE))
+	else if (context->canH8Castle && !IsPiecePresentContext(context, ROOK_H8_COORDINATE))
 	{
-		CanH8Castle = 0;
+		context->canH8Castle = 0;
 	}
 	// If any kings moved, flag them as not castle-able
-	else if (CanWhiteKingCastle && !IsPiecePresent(WHITE_KING_COORDINATE))
+	else if (context->canWhiteKingCastle && !IsPiecePresentContext(context, WHITE_KING_COORDINATE))
 	{
-		CanWhiteKingCastle = 0;
+		context->canWhiteKingCastle = 0;
 	}
-	else if (CanBlackKingCastle && !IsPiecePresent(BLACK_KING_COORDINATE))
+	else if (context->canBlackKingCastle && !IsPiecePresentContext(context, BLACK_KING_COORDINATE))
 	{
-		CanBlackKingCastle = 0;
+		context->canBlackKingCastle = 0;
 	}
 }
 
-uint8_t PawnReachedEnd(struct PieceCoordinate pieceCoordinate)
+/**
+ * @brief Returns the time stamped on sensor events: the millisecond tick on the target, the virtual clock in the simulator
+ */
+static uint32_t GetTimestamp(struct TrackerContext* context)
+{
+#ifndef SIM
+	return HAL_GetTick();
+#else
+	return context->simTime;
+#endif
+}
+
+uint8_t PawnReachedEnd(struct TrackerContext* context, PieceCoordinate pieceCoordinate)
 {
-	uint8_t finalRow = CurrentTurn == WHITE ? 7 : 0;
-	return (pieceCoordinate.piece.owner == CurrentTurn) && (pieceCoordinate.piece.type == PAWN) && (pieceCoordinate.row == finalRow);
+	uint8_t finalRow = context->currentTurn == WHITE ? 7 : 0;
+	Piece piece = COORDINATE_PIECE(pieceCoordinate);
+	return (PIECE_OWNER(piece) == context->currentTurn) && (PIECE_TYPE(piece) == PAWN) && (SQUARE_ROW(COORDINATE_SQUARE(pieceCoordinate)) == finalRow);
 }
 
-inline uint8_t PieceExists(struct PieceCoordinate pieceCoordinate)
+inline uint8_t PieceExists(PieceCoordinate pieceCoordinate)
 {
-	return !IsPieceCoordinateEqual(pieceCoordinate, EMPTY_PIECE_COORDINATE);
+	return pieceCoordinate != EMPTY_PIECE_COORDINATE;
 }
 
-inline void ClearPiece(struct PieceCoordinate* pieceCoordinate)
+inline void ClearPiece(PieceCoordinate* pieceCoordinate)
 {
 	*pieceCoordinate = EMPTY_PIECE_COORDINATE;
 }
 
-inline void SetPiece(uint8_t row, uint8_t column, struct Piece piece)
+inline void SetPiece(struct TrackerContext* context, uint8_t square, Piece piece)
+{
+	context->chessboard[square] = piece;
+	if (piece != EMPTY_PIECE)
+	{
+		context->occupied |= SQUARE_SENSOR_BIT(square);
+	}
+	else
+	{
+		context->occupied &= ~SQUARE_SENSOR_BIT(square);
+	}
+}
+
+inline Piece GetPieceContext(struct TrackerContext* context, uint8_t square)
+{
+	return context->chessboard[square];
+}
+
+inline PieceCoordinate GetPieceCoordinateContext(struct TrackerContext* context, uint8_t square)
+{
+	return PIECE_COORDINATE(GetPieceContext(context, square), square);
+}
+
+inline uint8_t DidOtherTeamPickupLast(struct TrackerContext* context, Piece piece)
+{
+	return context->lastTransitionType == PICKUP && PIECE_OWNER(COORDINATE_PIECE(context->lastPickedUpPiece)) != PIECE_OWNER(piece);
+}
+
+inline uint8_t DidSameTeamPickupLast(struct TrackerContext* context, Piece piece)
+{
+	return context->lastTransitionType == PICKUP && PIECE_OWNER(COORDINATE_PIECE(context->lastPickedUpPiece)) == PIECE_OWNER(piece);
+}
+
+uint8_t IsPiecePresentContext(struct TrackerContext* context, uint8_t square)
+{
+	return context->chessboard[square] != EMPTY_PIECE;
+}
+
+inline uint8_t IsPieceCoordinateSamePosition(PieceCoordinate pieceCoordinate1, PieceCoordinate pieceCoordinate2)
+{
+	// Off the board has a1's square bits, so it has to be ruled out before comparing them
+	return COORDINATE_ON_BOARD(pieceCoordinate1) && COORDINATE_ON_BOARD(pieceCoordinate2)
+		&& COORDINATE_SQUARE(pieceCoordinate1) == COORDINATE_SQUARE(pieceCoordinate2);
+}
+
+inline enum PieceOwner GetCurrentTurnContext(struct TrackerContext* context)
+{
+	return context->currentTurn;
+}
+
+inline Bitboard GetKillersContext(struct TrackerContext* context)
+{
+	return PieceExists(context->pieceToKill) ? context->killers : 0;
+}
+
+#ifdef TRACKER_SPECULATE
+inline struct SpeculationStats GetSpeculationStatsContext(struct TrackerContext* context)
+{
+	return context->speculation.stats;
+}
+#endif
+
+struct TrackerContext* GetTrackerContext(void)
+{
+	return &DefaultTrackerContext;
+}
+
+// Default Context //
+void Scan()
+{
+	ScanContext(&DefaultTrackerContext);
+}
+
+uint8_t Track()
+{
+	return TrackContext(&DefaultTrackerContext);
+}
+
+uint8_t TrackEvent(struct SensorEvent event)
+{
+	return TrackEventContext(&DefaultTrackerContext, event);
+}
+
+void TrackIdle()
 {
-	Chessboard[row][column] = piece;
+	TrackIdleContext(&DefaultTrackerContext);
 }
 
-inline void SetPieceCoordinate(struct PieceCoordinate pieceCoordinate)
+uint8_t InferMove()
 {
-	Chessboard[pieceCoordinate.row][pieceCoordinate.column] = pieceCoordinate.piece;
+	return InferMoveContext(&DefaultTrackerContext);
 }
 
-inline struct Piece GetPiece(uint8_t row, uint8_t column)
+struct SensorEventStats GetSensorEventStats()
 {
-	return Chessboard[row][column];
+	return GetSensorEventStatsContext(&DefaultTrackerContext);
 }
 
-inline struct PieceCoordinate GetPieceCoordinate(uint8_t row, uint8_t column)
+#ifdef INSTRUMENT
+void DumpTrackerTransitions(LatencyPrintFunction print)
 {
-	struct PieceCoordinate pieceCoordinate = { GetPiece(row, column), row, column };
-	return pieceCoordinate;
+	DumpTrackerTransitionsContext(&DefaultTrackerContext, print);
 }
+#endif
 
-inline uint8_t DidOtherTeamPickupLast(struct Piece piece)
+struct DebounceStats GetDebounceStats()
 {
-	return LastTransitionType == PICKUP && LastPickedUpPiece.piece.owner != piece.owner;
+	return GetDebounceStatsContext(&DefaultTrackerContext);
 }
 
-inline uint8_t DidSameTeamPickupLast(struct Piece piece)
+void SetTraceWriter(struct TraceWriter* writer)
 {
-	return LastTransitionType == PICKUP && LastPickedUpPiece.piece.owner == piece.owner;
+	SetTraceWriterContext(&DefaultTrackerContext, writer);
 }
 
-inline uint8_t IsPieceEqual(struct Piece piece1, struct Piece piece2)
+void SetCheckpointStore(struct CheckpointStore* store)
 {
-	return piece1.owner == piece2.owner
-		&& piece1.type == piece2.type;
+	SetCheckpointStoreContext(&DefaultTrackerContext, store);
 }
 
-uint8_t IsPiecePresent(uint8_t row, uint8_t column)
+uint8_t ResumeTracker(struct CheckpointStore* store)
 {
-	return Chessboard[row][column].type != NONE;
+	return ResumeTrackerContext(&DefaultTrackerContext, store);
 }
 
-inline uint8_t IsPieceCoordinateEqual(struct PieceCoordinate pieceCoordinate1, struct PieceCoordinate pieceCoordinate2)
+Bitboard GetKillers()
 {
-	return IsPieceEqual(pieceCoordinate1.piece, pieceCoordinate2.piece)
-		&& pieceCoordinate1.row == pieceCoordinate2.row
-		&& pieceCoordinate1.column == pieceCoordinate2.column;
+	return GetKillersContext(&DefaultTrackerContext);
 }
 
-inline uint8_t IsPieceCoordinateSamePosition(struct PieceCoordinate pieceCoordinate1, struct PieceCoordinate pieceCoordinate2)
+#ifdef TRACKER_SPECULATE
+struct SpeculationStats GetSpeculationStats()
 {
-	return pieceCoordinate1.row == pieceCoordinate2.row && pieceCoordinate1.column == pieceCoordinate2.column;
+	return GetSpeculationStatsContext(&DefaultTrackerContext);
 }
+#endif
 
-inline enum PieceOwner GetCurrentTurn()
+void InitTracker()
 {
-	return CurrentTurn;
-}
\ No newline at end of file
+	InitTrackerContext(&DefaultTrackerContext);
+}
+
+#ifndef SIM
+uint8_t ValidateStartPositions()
+{
+	return ValidateStartPositionsContext(&DefaultTrackerContext);
+}
+#else
+void SimSetSensor(uint8_t square, uint8_t value)
+{
+	SimSetSensorContext(&DefaultTrackerContext, square, value);
+}
+
+void SimAdvanceTime(uint32_t milliseconds)
+{
+	SimAdvanceTimeContext(&DefaultTrackerContext, milliseconds);
+}
+#endif
+
+enum PieceOwner GetCurrentTurn()
+{
+	return GetCurrentTurnContext(&DefaultTrackerContext);
+}
+
+Piece GetPiece(uint8_t square)
+{
+	return GetPieceContext(&DefaultTrackerContext, square);
+}
+
+PieceCoordinate GetPieceCoordinate(uint8_t square)
+{
+	return GetPieceCoordinateContext(&DefaultTrackerContext, square);
+}
+
+uint8_t IsPiecePresent(uint8_t square)
+{
+	return IsPiecePresentContext(&DefaultTrackerContext, square);
+}
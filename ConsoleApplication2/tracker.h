@@ -6,17 +6,54 @@
 #endif
 
 #include "types.h"
+#include "pathfinder.h"
+#include "eventqueue.h"
+#include "debounce.h"
+#include "trace.h"
+#include "checkpoint.h"
+#include "instrument.h"
+
+/*
+ * Build options:
+ * TRACKER_LAZY_LEGAL_MOVES - only switch teams at the end of a turn, and generate each piece's legal moves when it is
+ *                            picked up or during scans without a transition, instead of the whole team's at once
+ * TRACKER_IDLE_FILL_PIECES - pieces whose moves a scan without a transition generates in lazy builds (default 2)
+ * TRACKER_ASYNC_SCAN       - Track only drains the sensor events, and Scan is called separately from a timer interrupt
+ *                            or thread. Otherwise Track scans the sensors itself before draining them.
+ * TRACKER_SPECULATE        - while the current team holds a piece, use scans without a transition to work out the other
+ *                            team's moves for the squares it may land on, so the turn switch only has to pick them up
+ *                            (see struct Speculation). Costs a second pathfinder context's worth of RAM.
+ * TRACKER_SPECULATE_POSITIONS - positions a scan without a transition speculates on (default 1)
+ * TRACKER_INFER_MOVES      - when several squares change in one scan, or the events leave the board in an illegal state,
+ *                            compare the sensed board with the one the turn started from and play the legal move that
+ *                            explains the difference (see InferMove). Lets fast players and slow scan rates through.
+ *                            Pawn moves onto the last row are never inferred; they go through STATE_PROMOTION as usual.
+ *                            With TRACKER_ASYNC_SCAN the scanned board is read under a sequence count the scanner bumps
+ *                            around each update, so a scan landing mid-read can't hand inference a board that never was.
+ */
 
 /* Constants */
 
-#define NUM_ILLEGAL_PIECES 32
+#ifndef TRACKER_IDLE_FILL_PIECES
+#define TRACKER_IDLE_FILL_PIECES 2
+#endif
+
+#ifndef TRACKER_SPECULATE_POSITIONS
+#define TRACKER_SPECULATE_POSITIONS 1
+#endif
+
 #define NUM_COL_BITS 3
-#define ROOK_A1_COORDINATE 0, 0
-#define ROOK_A8_COORDINATE 7, 0
-#define ROOK_H1_COORDINATE 0, 7
-#define ROOK_H8_COORDINATE 7, 7
-#define WHITE_KING_COORDINATE 0, 4
-#define BLACK_KING_COORDINATE 7, 4
+#define ROOK_A1_COORDINATE SQUARE(0, 0)
+#define ROOK_A8_COORDINATE SQUARE(7, 0)
+#define ROOK_H1_COORDINATE SQUARE(0, 7)
+#define ROOK_H8_COORDINATE SQUARE(7, 7)
+#define WHITE_KING_COORDINATE SQUARE(0, 4)
+#define BLACK_KING_COORDINATE SQUARE(7, 4)
+
+// The sensors are scanned a column at a time, so their bits are indexed column-major: bit = column * 8 + row
+#define SENSOR_BIT(row, column) ((Bitboard)1 << (((column) << 3) | (row)))
+#define SQUARE_SENSOR_BIT(square) SENSOR_BIT(SQUARE_ROW(square), SQUARE_COLUMN(square))
+#define SENSOR_SQUARE(bit) SQUARE((bit) & 7, (bit) >> 3)
 
 
 #ifndef SIM
@@ -39,31 +76,262 @@ volatile static const struct GPIO_Pin COLUMN_BIT_TO_PIN_TABLE[NUM_COL_BITS] = {
 
 };
 #else
-void SimSetSensor(uint8_t row, uint8_t column, uint8_t value);
-void SimMove(uint8_t rowInitial, uint8_t columnInitial, uint8_t rowFinal, uint8_t columnFinal);
+void SimSetSensor(uint8_t square, uint8_t value);
+
+/**
+ * @brief Moves the simulator's virtual clock, which stands in for the millisecond tick, forward
+ */
+void SimAdvanceTime(uint32_t milliseconds);
+
+void SimMove(uint8_t from, uint8_t to);
+#endif
+
+volatile static const Piece INITIAL_CHESSBOARD[NUM_SQUARES] = {
+	PIECE(ROOK, WHITE), PIECE(KNIGHT, WHITE), PIECE(BISHOP, WHITE), PIECE(QUEEN, WHITE), PIECE(KING, WHITE), PIECE(BISHOP, WHITE), PIECE(KNIGHT, WHITE), PIECE(ROOK, WHITE),
+	PIECE(PAWN, WHITE), PIECE(PAWN, WHITE), PIECE(PAWN, WHITE), PIECE(PAWN, WHITE), PIECE(PAWN, WHITE), PIECE(PAWN, WHITE), PIECE(PAWN, WHITE), PIECE(PAWN, WHITE),
+	EMPTY_PIECE, EMPTY_PIECE, EMPTY_PIECE, EMPTY_PIECE, EMPTY_PIECE, EMPTY_PIECE, EMPTY_PIECE, EMPTY_PIECE,
+	EMPTY_PIECE, EMPTY_PIECE, EMPTY_PIECE, EMPTY_PIECE, EMPTY_PIECE, EMPTY_PIECE, EMPTY_PIECE, EMPTY_PIECE,
+	EMPTY_PIECE, EMPTY_PIECE, EMPTY_PIECE, EMPTY_PIECE, EMPTY_PIECE, EMPTY_PIECE, EMPTY_PIECE, EMPTY_PIECE,
+	EMPTY_PIECE, EMPTY_PIECE, EMPTY_PIECE, EMPTY_PIECE, EMPTY_PIECE, EMPTY_PIECE, EMPTY_PIECE, EMPTY_PIECE,
+	PIECE(PAWN, BLACK), PIECE(PAWN, BLACK), PIECE(PAWN, BLACK), PIECE(PAWN, BLACK), PIECE(PAWN, BLACK), PIECE(PAWN, BLACK), PIECE(PAWN, BLACK), PIECE(PAWN, BLACK),
+	PIECE(ROOK, BLACK), PIECE(KNIGHT, BLACK), PIECE(BISHOP, BLACK), PIECE(QUEEN, BLACK), PIECE(KING, BLACK), PIECE(BISHOP, BLACK), PIECE(KNIGHT, BLACK), PIECE(ROOK, BLACK),
+};
+
+
+
+/* State Machine */
+
+/**
+ * @brief What the tracker is waiting for, in order of precedence when more than one applies
+ */
+enum TrackerState {
+	STATE_NORMAL,			// A move by the current team
+	STATE_KILL_PENDING,		// An enemy piece was picked up, a killer must take its square
+	STATE_CASTLING,			// The king and rook must be placed on their castled squares
+	STATE_PROMOTION,		// A pawn on the last row must be replaced
+	STATE_ILLEGAL_RECOVERY,	// Illegal pieces must be put back before anything else
+	NUM_TRACKER_STATES
+};
+
+/**
+ * @brief Sensor transitions, refined by what was picked up last so each state reacts with a single table lookup
+ */
+enum TrackerEvent {
+	EVENT_PICKUP,			// The current team picked up a piece
+	EVENT_PICKUP_ENEMY,		// The current team picked up one of the other team's pieces
+	EVENT_PICKUP_AGAIN,		// The current team picked up a second piece without placing the first
+	EVENT_PLACE,			// A piece was placed
+	EVENT_PLACE_RETURN,		// A piece was placed back where the last piece was picked up from
+	NUM_TRACKER_EVENTS
+};
+
+
+
+/* Context */
+
+/**
+ * @brief Everything the tracker knows about one physical (or simulated) board. Contexts are independent, so a single
+ * process can track many boards by giving each its own context. The functions without a context argument operate on
+ * the default context returned by GetTrackerContext.
+ */
+struct TrackerContext {
+	// State Fields //
+	Piece chessboard[NUM_SQUARES];
+	enum PieceOwner currentTurn;
+	enum TransitionType lastTransitionType;
+	PieceCoordinate lastPickedUpPiece;
+	enum TrackerState state;	// Follows from the fields below, recalculated after every transition
+	Bitboard occupied;	// Sensor bits (see SENSOR_BIT) of the squares chessboard has a piece on, kept up to date by SetPiece
+
+	// Legal Piece Detection/Recovery Fields //
+	PieceCoordinate pieceToKill;
+	Bitboard killers;	// Squares (see SQUARE) of the current team's pieces that may legally take pieceToKill
+	Bitboard mustEmpty;	// Sensor bits (see SENSOR_BIT) of the squares an illegal piece must be lifted from
+	Bitboard mustFill;	// Sensor bits of the squares a piece must be put back on
+	Piece expectedPieces[NUM_SQUARES];	// The piece each mustFill square is waiting for
+	uint8_t switchTurnsAfterLegalState;
+
+	// Castling //
+	uint8_t canA1Castle;
+	uint8_t canH1Castle;
+	uint8_t canA8Castle;
+	uint8_t canH8Castle;
+	uint8_t canWhiteKingCastle;
+	uint8_t canBlackKingCastle;
+	PieceCoordinate expectedKingCastleCoordinate;
+	PieceCoordinate expectedRookCastleCoordinate;
+
+	// Promotion //
+	PieceCoordinate pawnToPromote;
+
+#ifdef TRACKER_INFER_MOVES
+	// Move Inference //
+	Bitboard seen;		// Sensor bits scanned as of the last InferMoveContext
+	Bitboard landed;	// Sensor bits a piece was put on this turn while one of the current team's was off its square
+	uint8_t unordered;	// Whether several squares changed between two looks this turn, so their events may be out of order
 #endif
 
-volatile static const struct Piece INITIAL_CHESSBOARD[NUM_ROWS][NUM_COLS] = {
-	{{ROOK, WHITE},   {KNIGHT, WHITE}, {BISHOP, WHITE}, {QUEEN, WHITE},  {KING, WHITE},   {BISHOP, WHITE}, {KNIGHT, WHITE}, {ROOK, WHITE}},
-	{{PAWN, WHITE},   {PAWN, WHITE},   {PAWN, WHITE},   {PAWN, WHITE},   {PAWN, WHITE},   {PAWN, WHITE},   {PAWN, WHITE},   {PAWN, WHITE}},
-	{{NONE, NEUTRAL}, {NONE, NEUTRAL}, {NONE, NEUTRAL}, {NONE, NEUTRAL}, {NONE, NEUTRAL}, {NONE, NEUTRAL}, {NONE, NEUTRAL}, {NONE, NEUTRAL}},
-	{{NONE, NEUTRAL}, {NONE, NEUTRAL}, {NONE, NEUTRAL}, {NONE, NEUTRAL}, {NONE, NEUTRAL}, {NONE, NEUTRAL}, {NONE, NEUTRAL}, {NONE, NEUTRAL}},
-	{{NONE, NEUTRAL}, {NONE, NEUTRAL}, {NONE, NEUTRAL}, {NONE, NEUTRAL}, {NONE, NEUTRAL}, {NONE, NEUTRAL}, {NONE, NEUTRAL}, {NONE, NEUTRAL}},
-	{{NONE, NEUTRAL}, {NONE, NEUTRAL}, {NONE, NEUTRAL}, {NONE, NEUTRAL}, {NONE, NEUTRAL}, {NONE, NEUTRAL}, {NONE, NEUTRAL}, {NONE, NEUTRAL}},
-	{{PAWN, BLACK},   {PAWN, BLACK},   {PAWN, BLACK},   {PAWN, BLACK},   {PAWN, BLACK},   {PAWN, BLACK},   {PAWN, BLACK},   {PAWN, BLACK}},
-	{{ROOK, BLACK},   {KNIGHT, BLACK}, {BISHOP, BLACK}, {QUEEN, BLACK},  {KING, BLACK},   {BISHOP, BLACK}, {KNIGHT, BLACK}, {ROOK, BLACK}},
+#ifdef INSTRUMENT
+	// Times each entry of the transition table was taken
+	uint32_t transitionCounts[NUM_TRACKER_STATES][NUM_TRACKER_EVENTS];
+#endif
+
+	// Legal moves of this board's position
+	struct PathfinderContext pathfinder;
+#ifdef TRACKER_SPECULATE
+	struct Speculation speculation;	// The other team's moves after the held piece lands
+#endif
+
+	// Sensor Scanning (producer side, see ScanContext) //
+	struct Debouncer debouncer;
+	Bitboard scanned;	// Debounced sensor bits as of the last event pushed for each square
+#if defined(TRACKER_ASYNC_SCAN) && defined(TRACKER_INFER_MOVES)
+	volatile uint32_t scanSequence;	// Odd while ScanContext is changing scanned (see ReadScanned)
+#endif
+	struct SensorEventQueue events;
+	struct TraceWriter* trace;	// Every raw frame scanned is recorded here if set (see trace.h)
+	struct CheckpointStore* checkpoint;	// The game is saved here after every turn if set (see checkpoint.h)
+
+#ifdef SIM
+	uint32_t simTime;	// Virtual milliseconds, advanced by SimAdvanceTimeContext
+	uint8_t simColumn;
+	volatile uint8_t simSensors[NUM_SQUARES];
+#endif
 };
 
+/**
+ * @brief Returns the context used by the single-board functions below
+ */
+struct TrackerContext* GetTrackerContext(void);
+
+// Context API //
+void ScanContext(struct TrackerContext* context);
+uint8_t TrackContext(struct TrackerContext* context);
+uint8_t TrackEventContext(struct TrackerContext* context, struct SensorEvent event);
+void TrackIdleContext(struct TrackerContext* context);
+uint8_t InferMoveContext(struct TrackerContext* context);
+void SetTraceWriterContext(struct TrackerContext* context, struct TraceWriter* writer);
+void SetCheckpointStoreContext(struct TrackerContext* context, struct CheckpointStore* store);
+uint8_t ResumeTrackerContext(struct TrackerContext* context, struct CheckpointStore* store);
+struct SensorEventStats GetSensorEventStatsContext(struct TrackerContext* context);
+struct DebounceStats GetDebounceStatsContext(struct TrackerContext* context);
+void InitTrackerContext(struct TrackerContext* context);
+#ifndef SIM
+uint8_t ValidateStartPositionsContext(struct TrackerContext* context);
+#else
+void SimSetSensorContext(struct TrackerContext* context, uint8_t square, uint8_t value);
+void SimAdvanceTimeContext(struct TrackerContext* context, uint32_t milliseconds);
+const char* GetTrackerStateName(enum TrackerState state);	// As it appears in the transition table dump
+#endif
+#ifdef INSTRUMENT
+void DumpTrackerTransitionsContext(struct TrackerContext* context, LatencyPrintFunction print);
+#endif
+enum PieceOwner GetCurrentTurnContext(struct TrackerContext* context);
+Piece GetPieceContext(struct TrackerContext* context, uint8_t square);
+PieceCoordinate GetPieceCoordinateContext(struct TrackerContext* context, uint8_t square);
+uint8_t IsPiecePresentContext(struct TrackerContext* context, uint8_t square);
+Bitboard GetKillersContext(struct TrackerContext* context);
+#ifdef TRACKER_SPECULATE
+struct SpeculationStats GetSpeculationStatsContext(struct TrackerContext* context);
+#endif
+
 
 
 /* Functions */
 
 /**
- * @brief Write column bits to MUXs and read the value of each row. Keep track of piece moves.
+ * @brief Write column bits to MUXs and read the value of each row. Queue an event for every square that changed once
+ * it has settled (see debounce.h).
+ */
+void Scan(void);
+
+
+/**
+ * @brief Handle the queued sensor events (scanning first unless built with TRACKER_ASYNC_SCAN). Keep track of piece moves.
  */
 uint8_t Track(void);
 
 
+/**
+ * @brief Runs the rules for one sensor event that has already been popped off the queue. Returns 1 if it moved a piece
+ * on the chessboard, 0 if the chessboard already agreed with it.
+ */
+uint8_t TrackEvent(struct SensorEvent event);
+
+
+/**
+ * @brief Does the background work Track fits into scans without a transition (speculation, lazy move generation)
+ */
+void TrackIdle(void);
+
+
+/**
+ * @brief Looks at the squares that changed since it was last called, before their events are tracked. If this turn's
+ * events may come in the wrong order (several squares changed at once) or left the board in an illegal state, and the
+ * sensed board is exactly one legal move away from the turn's starting position, plays that move and ends the turn, so
+ * the events that follow already agree with the chessboard. Returns 1 if it did, 0 otherwise. Does nothing unless
+ * built with TRACKER_INFER_MOVES.
+ */
+uint8_t InferMove(void);
+
+
+/**
+ * @brief Starts recording every raw frame Scan reads into writer, or stops recording if writer is 0
+ */
+void SetTraceWriter(struct TraceWriter* writer);
+
+
+/**
+ * @brief Starts a new game in store: from now on the chessboard is saved to it at the end of every turn, along with
+ * the moves played. 0 stops saving.
+ */
+void SetCheckpointStore(struct CheckpointStore* store);
+
+
+/**
+ * @brief Picks up the game saved in store (see OpenCheckpointStore) after a reset, in place of the initial chessboard.
+ * The sensors are read once and must agree with the saved board, and the pieces must match the saved Zobrist key.
+ * Returns 1 if the game was resumed and is saved to store from then on, 0 if the tracker was left as InitTracker
+ * leaves it.
+ */
+uint8_t ResumeTracker(struct CheckpointStore* store);
+
+
+/**
+ * @brief Returns the overflow count and high-water mark of the sensor event queue
+ */
+struct SensorEventStats GetSensorEventStats(void);
+
+#ifdef INSTRUMENT
+/**
+ * @brief Prints the tracker's transition table, one line per entry with the number of times it was taken since
+ * InitTracker. The handlers' latencies are in the histograms (see DumpLatencyHistograms).
+ */
+void DumpTrackerTransitions(LatencyPrintFunction print);
+#endif
+
+
+/**
+ * @brief Returns the number of sensor glitches the debounce filter suppressed
+ */
+struct DebounceStats GetDebounceStats(void);
+
+
+/**
+ * @brief Returns the squares (see SQUARE) of the pieces that may take the enemy piece being held, so the board can
+ * light them as hints. 0 when no enemy piece is held.
+ */
+Bitboard GetKillers(void);
+
+
+#ifdef TRACKER_SPECULATE
+/**
+ * @brief Returns how many turn switches found their moves already speculated
+ */
+struct SpeculationStats GetSpeculationStats(void);
+#endif
+
+
 /**
  * @brief Initialize IO ports to use for tracking via the Hall Effect sensors.
  */
@@ -83,16 +351,14 @@ enum PieceOwner GetCurrentTurn();
 
 
 /**
- * @brief Returns the piece at the specified row and column.
+ * @brief Returns the piece on the specified square (see SQUARE).
  */
-struct Piece GetPiece(uint8_t row, uint8_t column);
-struct PieceCoordinate GetPieceCoordinate(uint8_t row, uint8_t column);
+Piece GetPiece(uint8_t square);
+PieceCoordinate GetPieceCoordinate(uint8_t square);
 
-// Comparison //
-uint8_t IsPieceEqual(struct Piece piece1, struct Piece piece2);
-uint8_t IsPiecePresent(uint8_t row, uint8_t column);
-uint8_t IsPieceCoordinateEqual(struct PieceCoordinate pieceCoordinate1, struct PieceCoordinate pieceCoordinate2);
-uint8_t IsPieceCoordinateSamePosition(struct PieceCoordinate pieceCoordinate1, struct PieceCoordinate pieceCoordinate2);
+// Comparison (pieces and piece coordinates are equal when their integers are) //
+uint8_t IsPiecePresent(uint8_t square);
+uint8_t IsPieceCoordinateSamePosition(PieceCoordinate pieceCoordinate1, PieceCoordinate pieceCoordinate2);
 
 // State 
 
@@ -9,11 +9,16 @@
 #define MAX_LEGAL_MOVES 27
 #define MAX_ROOK_MOVES 14
 #define MAX_BISHOP_MOVES 13
+#define NUM_SQUARES (NUM_ROWS * NUM_COLS)
 
-struct Coordinate {
-	int8_t row;
-	int8_t column;
-};
+// Squares are indexed row-major from (0, 0): square = row * 8 + column
+#define SQUARE(row, column) ((uint8_t)(((row) << 3) | (column)))
+#define SQUARE_ROW(square) ((uint8_t)((square) >> 3))
+#define SQUARE_COLUMN(square) ((uint8_t)((square) & 7))
+#define SQUARE_BIT(square) ((Bitboard)1 << (square))
+
+// One bit per square, bit index given by SQUARE()
+typedef uint64_t Bitboard;
 
 enum PieceType {
 	NONE,
@@ -45,33 +50,31 @@ struct GPIO_Pin {
 };
 */
 
-struct Piece {
-	enum PieceType type;
-	enum PieceOwner owner;
-};
-
-struct PieceCoordinate {
-	struct Piece piece;
-	uint8_t row;
-	uint8_t column;
-};
-
-
-struct IllegalMove {
-	struct PieceCoordinate destination;
-	struct PieceCoordinate current;
-};
-
-
-struct Moves {
-	struct PieceCoordinate from;
-	struct Coordinate moves[MAX_LEGAL_MOVES];
-	uint8_t numMoves;
-};
+/*
+ * Pieces are packed into 4 bits: the type in the low 3, and PIECE_BLACK for a black piece. EMPTY_PIECE (0) is an empty
+ * square, so comparing two pieces is comparing two integers.
+ */
+typedef uint8_t Piece;
 
+#define PIECE_BLACK 8
+#define PIECE(type, owner) ((Piece)((type) | ((owner) == BLACK ? PIECE_BLACK : 0)))
+#define PIECE_TYPE(piece) ((enum PieceType)((piece) & 7))
+#define PIECE_OWNER(piece) ((enum PieceOwner)(((piece) != 0) + ((piece) >> 3)))	// NEUTRAL, WHITE or BLACK
+#define EMPTY_PIECE ((Piece)0)
 
-volatile static const struct Piece EMPTY_PIECE = { NONE, NEUTRAL };
-volatile static const struct PieceCoordinate EMPTY_PIECE_COORDINATE = { {NONE, NEUTRAL}, 0, 0 };
-volatile static const struct PieceCoordinate OFFBOARD_PIECE_COORDINATE = { {NONE, NEUTRAL}, 0xFF, 0xFF };
+/*
+ * A piece on a square, packed into 16 bits: the square (see SQUARE) in the low 6 and the piece above them. Off the
+ * board is a bit of its own, so no piece coordinate on the board compares equal to OFFBOARD_PIECE_COORDINATE as a
+ * whole, but its square bits are those of a1: check COORDINATE_ON_BOARD before using COORDINATE_SQUARE on a
+ * coordinate that may be off the board. EMPTY_PIECE_COORDINATE is the empty piece on a1.
+ */
+typedef uint16_t PieceCoordinate;
+
+#define PIECE_COORDINATE(piece, square) ((PieceCoordinate)(((piece) << 6) | (square)))
+#define COORDINATE_PIECE(pieceCoordinate) ((Piece)(((pieceCoordinate) >> 6) & 0x0F))
+#define COORDINATE_SQUARE(pieceCoordinate) ((uint8_t)((pieceCoordinate) & 0x3F))
+#define COORDINATE_ON_BOARD(pieceCoordinate) (((pieceCoordinate) & OFFBOARD_PIECE_COORDINATE) == 0)
+#define EMPTY_PIECE_COORDINATE ((PieceCoordinate)0)
+#define OFFBOARD_PIECE_COORDINATE ((PieceCoordinate)0x8000)
 
 #endif /* TYPES_H_ */